@@ -1,5 +1,6 @@
 #include <gtest/gtest.h>
 #include <rai/node/node.hpp>
+#include <rai/versioning.hpp>
 
 #include <fstream>
 
@@ -267,7 +268,7 @@ TEST (block_store, frontier_retrieval)
     rai::block_store store (init, rai::unique_path ());
     ASSERT_TRUE (!init);
     rai::account account1 (0);
-    rai::account_info info1 (0, 0, 0, 0, 0);
+    rai::account_info info1 (0, 0, 0, 0, 0, 0, 0);
 	rai::transaction transaction (store.environment, nullptr, true);
     store.account_put (transaction, account1, info1);
     rai::account_info info2;
@@ -283,7 +284,7 @@ TEST (block_store, one_account)
     rai::account account (0);
     rai::block_hash hash (0);
 	rai::transaction transaction (store.environment, nullptr, true);
-    store.account_put (transaction, account, {hash, account, hash, 42, 100});
+    store.account_put (transaction, account, {hash, account, hash, 42, 100, 0, 0});
     auto begin (store.latest_begin (transaction));
     auto end (store.latest_end ());
     ASSERT_NE (end, begin);
@@ -327,8 +328,8 @@ TEST (block_store, two_account)
     rai::account account2 (3);
     rai::block_hash hash2 (4);
 	rai::transaction transaction (store.environment, nullptr, true);
-    store.account_put (transaction, account1, {hash1, account1, hash1, 42, 100});
-    store.account_put (transaction, account2, {hash2, account2, hash2, 84, 200});
+    store.account_put (transaction, account1, {hash1, account1, hash1, 42, 100, 0, 0});
+    store.account_put (transaction, account2, {hash2, account2, hash2, 84, 200, 0, 0});
     auto begin (store.latest_begin (transaction));
     auto end (store.latest_end ());
     ASSERT_NE (end, begin);
@@ -358,8 +359,8 @@ TEST (block_store, latest_find)
     rai::account account2 (3);
     rai::block_hash hash2 (4);
 	rai::transaction transaction (store.environment, nullptr, true);
-    store.account_put (transaction, account1, {hash1, account1, hash1, 100, 0});
-    store.account_put (transaction, account2, {hash2, account2, hash2, 200, 0});
+    store.account_put (transaction, account1, {hash1, account1, hash1, 100, 0, 0, 0});
+    store.account_put (transaction, account2, {hash2, account2, hash2, 200, 0, 0, 0});
     auto first (store.latest_begin (transaction));
     auto second (store.latest_begin (transaction));
     ++second;
@@ -621,18 +622,104 @@ TEST (block_store, upgrade_v2_v3)
 		ASSERT_EQ (6, ledger.weight (transaction, key2.pub));
 		rai::account_info info;
 		ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
-		info.rep_block = 42;
-		store.account_put (transaction, rai::test_genesis_key.pub, info);
+		rai::account_info_v3 info_old (info.head, 42, info.open_block, info.balance, info.modified);
+		auto status (mdb_put (transaction, store.accounts, rai::test_genesis_key.pub.val (), info_old.val (), 0));
+		ASSERT_EQ (0, status);
 	}
 	bool init (false);
 	rai::block_store store (init, path);
 	rai::ledger ledger (store);
 	rai::transaction transaction (store.environment, nullptr, true);
 	ASSERT_TRUE (!init);
-	ASSERT_EQ (3, store.version_get (transaction));
+	ASSERT_LT (2, store.version_get (transaction));
 	ASSERT_EQ (rai::genesis_amount, ledger.weight (transaction, key1.pub));
 	ASSERT_EQ (0, ledger.weight (transaction, key2.pub));
 	rai::account_info info;
 	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
 	ASSERT_EQ (change_hash, info.rep_block);
-}
\ No newline at end of file
+}
+
+TEST (block_store, upgrade_v3_v4)
+{
+	rai::block_hash send_hash;
+	auto path (rai::unique_path ());
+	{
+		bool init (false);
+		rai::block_store store (init, path);
+		ASSERT_TRUE (!init);
+		rai::transaction transaction (store.environment, nullptr, true);
+		rai::genesis genesis;
+		genesis.initialize (transaction, store);
+		rai::ledger ledger (store);
+		rai::send_block send (genesis.hash (), 0, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+		send_hash = send.hash ();
+		ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send).code);
+		store.version_put (transaction, 3);
+		rai::account_info info;
+		ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+		rai::account_info_v3 info_old (info.head, info.rep_block, info.open_block, info.balance, info.modified);
+		auto status (mdb_put (transaction, store.accounts, rai::test_genesis_key.pub.val (), info_old.val (), 0));
+		ASSERT_EQ (0, status);
+	}
+	bool init (false);
+	rai::block_store store (init, path);
+	ASSERT_TRUE (!init);
+	rai::transaction transaction (store.environment, nullptr, false);
+	ASSERT_EQ (4, store.version_get (transaction));
+	rai::account_info info;
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+	ASSERT_EQ (send_hash, info.head);
+	ASSERT_EQ (rai::genesis_amount - 100, info.balance.number ());
+	ASSERT_EQ (2, info.block_count);
+	ASSERT_EQ (0, info.confirmation_height);
+}
+
+TEST (block_store, block_cache)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::open_block block1 (0, 1, 0, rai::keypair ().prv, 0, 0);
+	auto hash1 (block1.hash ());
+	store.block_put (transaction, hash1, block1);
+	auto misses (store.cache.misses.load ());
+	auto hits (store.cache.hits.load ());
+	auto latest1 (store.block_get (transaction, hash1));
+	ASSERT_EQ (block1, *latest1);
+	ASSERT_EQ (misses + 1, store.cache.misses);
+	auto latest2 (store.block_get (transaction, hash1));
+	ASSERT_EQ (block1, *latest2);
+	ASSERT_EQ (hits + 1, store.cache.hits);
+	ASSERT_NE (latest1.get (), latest2.get ());
+	auto shared1 (store.block_get_shared (transaction, hash1));
+	auto shared2 (store.block_get_shared (transaction, hash1));
+	ASSERT_EQ (shared1, shared2);
+	ASSERT_EQ (hits + 3, store.cache.hits);
+	store.block_del (transaction, hash1);
+	ASSERT_EQ (nullptr, store.block_get (transaction, hash1));
+	ASSERT_EQ (misses + 2, store.cache.misses);
+	// A cached block this transaction can't see is a miss
+	rai::open_block block2 (0, 2, 0, rai::keypair ().prv, 0, 0);
+	store.cache.put (block2.hash (), std::make_shared <rai::open_block> (block2));
+	ASSERT_EQ (nullptr, store.block_get_shared (transaction, block2.hash ()));
+	ASSERT_EQ (hits + 3, store.cache.hits);
+	ASSERT_EQ (misses + 3, store.cache.misses);
+}
+
+TEST (block_cache, eviction)
+{
+	rai::block_cache cache (rai::block_cache::shard_count);
+	rai::keypair key1;
+	std::vector <rai::block_hash> hashes;
+	for (auto i (0); i < 64; ++i)
+	{
+		auto block (std::make_shared <rai::send_block> (i, 1, 2, key1.prv, key1.pub, 3));
+		hashes.push_back (block->hash ());
+		cache.put (block->hash (), block);
+	}
+	ASSERT_GE (rai::block_cache::shard_count, cache.size ());
+	ASSERT_NE (nullptr, cache.get (hashes.back ()));
+	cache.erase (hashes.back ());
+	ASSERT_EQ (nullptr, cache.get (hashes.back ()));
+}
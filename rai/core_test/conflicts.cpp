@@ -74,4 +74,24 @@ TEST (conflicts, add_two)
 		node_l->process_confirmed (block_a);
 	});
     ASSERT_EQ (2, node1.active.roots.size ());
-}
\ No newline at end of file
+}
+TEST (conflicts, local_vote_bundling)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	node1.config.vote_bundling = true;
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, node1.process (send1).code);
+	auto node_l (system.nodes [0]);
+	node1.active.start (send1, [node_l] (rai::block & block_a)
+	{
+		node_l->process_confirmed (block_a);
+	});
+	auto election (node1.active.roots.find (send1.root ())->election);
+	// Our own vote is counted straight away rather than waiting for a bundle
+	election->recompute_winner ();
+	ASSERT_NE (election->votes.rep_votes.end (), election->votes.rep_votes.find (rai::test_genesis_key.pub));
+}
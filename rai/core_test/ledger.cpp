@@ -756,6 +756,72 @@ TEST (votes, add_one)
 	ASSERT_EQ (rai::genesis_amount - 100, winner.first);
 }
 
+TEST (votes, add_hash)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, send1).code);
+	}
+	auto node_l (system.nodes [0]);
+	node1.active.start (send1, [node_l] (rai::block & block_a)
+	{
+		node_l->process_confirmed (block_a);
+	});
+	auto votes1 (node1.active.roots.find (send1.root ())->election);
+	// A hash the election doesn't know about can't add a block
+	rai::vote vote1 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, std::vector <rai::block_hash> (1, key1.pub));
+	node1.active.vote (vote1);
+	ASSERT_EQ (1, votes1->votes.rep_votes.size ());
+	std::vector <rai::block_hash> hashes;
+	hashes.push_back (key1.pub);
+	hashes.push_back (send1.hash ());
+	// Unless the caller validated it the signature is checked before any election sees the vote
+	rai::vote forged (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, hashes);
+	forged.sequence = 3;
+	node1.active.vote (forged);
+	ASSERT_EQ (1, votes1->votes.rep_votes.size ());
+	rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, hashes);
+	node1.active.vote (vote2);
+	ASSERT_EQ (2, votes1->votes.rep_votes.size ());
+	auto existing1 (votes1->votes.rep_votes.find (rai::test_genesis_key.pub));
+	ASSERT_NE (votes1->votes.rep_votes.end (), existing1);
+	ASSERT_EQ (send1, *existing1->second);
+}
+
+TEST (votes, add_hash_fork)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::keypair key2;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	rai::send_block send2 (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, send1).code);
+	}
+	auto node_l (system.nodes [0]);
+	node1.active.start (send1, [node_l] (rai::block & block_a)
+	{
+		node_l->process_confirmed (block_a);
+	});
+	auto votes1 (node1.active.roots.find (send1.root ())->election);
+	// The fork isn't in the ledger, a vote carrying it lets later votes by hash find the election
+	rai::vote vote1 (key1.pub, key1.prv, 1, send2.clone ());
+	node1.active.vote (vote1);
+	rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, std::vector <rai::block_hash> (1, send2.hash ()));
+	node1.active.vote (vote2);
+	auto existing1 (votes1->votes.rep_votes.find (rai::test_genesis_key.pub));
+	ASSERT_NE (votes1->votes.rep_votes.end (), existing1);
+	ASSERT_EQ (send2, *existing1->second);
+}
+
 TEST (votes, add_two)
 {
 	rai::system system (24000, 1);
@@ -853,6 +919,48 @@ TEST (votes, add_old)
 	ASSERT_EQ (send1, *winner.second);
 }
 
+// Votes move weight between running totals, weights are only reread after the representation table changes
+TEST (votes, tally_incremental)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	rai::send_block send2 (genesis.hash (), key1.pub, 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	rai::votes votes (send1);
+	rai::uint128_t weight;
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		weight = node1.ledger.weight (transaction, rai::test_genesis_key.pub);
+		auto tally1 (votes.tally (transaction, node1.store));
+		ASSERT_EQ (1, tally1.size ());
+		ASSERT_EQ (send1, *tally1.begin ()->second);
+		rai::vote vote1 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, send2.clone ());
+		ASSERT_TRUE (votes.vote (transaction, node1.store, vote1));
+		ASSERT_EQ (2, votes.totals.size ());
+		ASSERT_EQ (weight, votes.totals.at (send2.hash ()).weight);
+		rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, send1.clone ());
+		ASSERT_TRUE (votes.vote (transaction, node1.store, vote2));
+		ASSERT_EQ (1, votes.totals.size ());
+		ASSERT_EQ (weight, votes.totals.at (send1.hash ()).weight);
+		ASSERT_EQ (2, votes.totals.at (send1.hash ()).voters);
+		auto tally2 (votes.tally (transaction, node1.store));
+		ASSERT_EQ (1, tally2.size ());
+		ASSERT_EQ (weight, tally2.begin ()->first);
+		node1.store.representation_put (transaction, rai::test_genesis_key.pub, weight - 100);
+		auto tally3 (votes.tally (transaction, node1.store));
+		ASSERT_EQ (weight - 100, tally3.begin ()->first);
+		ASSERT_EQ (send1, *tally3.begin ()->second);
+	}
+	ASSERT_EQ (nullptr, node1.store.environment.representation_writer.load ());
+	ASSERT_EQ (node1.store.environment.representation_version, votes.weights_version + 1);
+	rai::transaction transaction (node1.store.environment, nullptr, false);
+	auto tally4 (votes.tally (transaction, node1.store));
+	ASSERT_EQ (weight - 100, tally4.begin ()->first);
+	ASSERT_EQ (node1.store.environment.representation_version, votes.weights_version);
+}
+
 // Query for block successor
 TEST (ledger, successor)
 {
@@ -1392,4 +1500,178 @@ TEST (ledger, stopped_rollback)
 	ASSERT_TRUE (store.block_exists (transaction, hash1));
 	ASSERT_TRUE (ledger.rollback (transaction, send.hash ()));
 	ASSERT_TRUE (store.block_exists (transaction, hash1));
-}
\ No newline at end of file
+}
+TEST (ledger, prune)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::genesis genesis;
+	genesis.initialize (transaction, store);
+	rai::keypair key2;
+	rai::send_block send1 (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::open_block open1 (send1.hash (), key2.pub, key2.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	rai::keypair key3;
+	rai::change_block change1 (send1.hash (), key3.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change1).code);
+	rai::change_block change2 (change1.hash (), key3.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change2).code);
+	// Only confirmed history is pruned
+	ASSERT_EQ (0, ledger.prune (transaction, rai::test_genesis_key.pub, 2));
+	ASSERT_EQ (0, store.pruned_count (transaction));
+	ASSERT_FALSE (ledger.confirm (transaction, change2.hash ()));
+	ASSERT_EQ (1, ledger.prune (transaction, rai::test_genesis_key.pub, 2));
+	ASSERT_FALSE (store.block_exists (transaction, send1.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, genesis.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, change1.hash ()));
+	ASSERT_EQ (change1.hash (), store.block_successor (transaction, genesis.hash ()));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, genesis.hash ()));
+	rai::block_hash boundary;
+	ASSERT_FALSE (store.pruned_get (transaction, rai::test_genesis_key.pub, boundary));
+	ASSERT_EQ (change1.hash (), boundary);
+	ASSERT_EQ (1, store.pruned_count (transaction));
+	ASSERT_EQ (0, ledger.prune (transaction, rai::test_genesis_key.pub, 2));
+	// Confirmed blocks can't be rolled back
+	ASSERT_TRUE (ledger.rollback (transaction, change1.hash ()));
+	ASSERT_EQ (change2.hash (), ledger.latest (transaction, rai::test_genesis_key.pub));
+	rai::keypair key4;
+	rai::change_block change3 (change2.hash (), key4.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change3).code);
+	ASSERT_EQ (rai::genesis_amount - 100, ledger.weight (transaction, key4.pub));
+	ASSERT_EQ (0, ledger.weight (transaction, key3.pub));
+	// The account has a pruned boundary so the balance walk runs and finds the history it needs is gone
+	ASSERT_TRUE (ledger.rollback (transaction, change2.hash ()));
+	ASSERT_EQ (change3.hash (), ledger.latest (transaction, rai::test_genesis_key.pub));
+}
+
+TEST (ledger, prune_keeps_pending)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::genesis genesis;
+	genesis.initialize (transaction, store);
+	rai::keypair key2;
+	rai::send_block send1 (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::change_block change1 (send1.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change1).code);
+	rai::change_block change2 (change1.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change2).code);
+	ASSERT_FALSE (ledger.confirm (transaction, change2.hash ()));
+	ASSERT_EQ (1, ledger.prune (transaction, rai::test_genesis_key.pub, 1));
+	ASSERT_FALSE (store.block_exists (transaction, change1.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, send1.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, genesis.hash ()));
+	ASSERT_EQ (change2.hash (), store.block_successor (transaction, send1.hash ()));
+	rai::open_block open1 (send1.hash (), key2.pub, key2.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	ASSERT_EQ (100, ledger.account_balance (transaction, key2.pub));
+}
+
+TEST (ledger, prune_successors)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::genesis genesis;
+	genesis.initialize (transaction, store);
+	rai::keypair key2;
+	rai::change_block change1 (genesis.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change1).code);
+	rai::send_block send1 (change1.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::change_block change2 (send1.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change2).code);
+	rai::change_block change3 (change2.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change3).code);
+	ASSERT_FALSE (ledger.confirm (transaction, change3.hash ()));
+	ASSERT_EQ (2, ledger.prune (transaction, rai::test_genesis_key.pub, 1));
+	ASSERT_EQ (send1.hash (), store.block_successor (transaction, genesis.hash ()));
+	ASSERT_EQ (change3.hash (), store.block_successor (transaction, send1.hash ()));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, send1.hash ()));
+	// The kept send's previous block is gone, its amount comes from the pending entry
+	ASSERT_EQ (100, ledger.amount (transaction, send1.hash ()));
+	rai::open_block open1 (send1.hash (), key2.pub, key2.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	rai::change_block change4 (change3.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, change4).code);
+	ASSERT_FALSE (ledger.confirm (transaction, change4.hash ()));
+	// The received send and the old boundary are dropped from the kept chain
+	ASSERT_EQ (2, ledger.prune (transaction, rai::test_genesis_key.pub, 1));
+	ASSERT_FALSE (store.block_exists (transaction, send1.hash ()));
+	ASSERT_FALSE (store.block_exists (transaction, change3.hash ()));
+	ASSERT_EQ (change4.hash (), store.block_successor (transaction, genesis.hash ()));
+	ASSERT_EQ (rai::test_genesis_key.pub, ledger.account (transaction, genesis.hash ()));
+}
+
+TEST (ledger, confirmation_height)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::genesis genesis;
+	genesis.initialize (transaction, store);
+	rai::keypair key2;
+	rai::send_block send1 (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::send_block send2 (send1.hash (), key2.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send2).code);
+	rai::account_info info;
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+	ASSERT_EQ (3, info.block_count);
+	ASSERT_EQ (1, info.confirmation_height);
+	ASSERT_EQ (1, ledger.height (transaction, genesis.hash ()));
+	ASSERT_EQ (2, ledger.height (transaction, send1.hash ()));
+	ASSERT_EQ (3, ledger.height (transaction, send2.hash ()));
+	ASSERT_EQ (0, ledger.height (transaction, 1));
+	rai::account account;
+	ASSERT_EQ (2, ledger.height (transaction, send1.hash (), account));
+	ASSERT_EQ (rai::test_genesis_key.pub, account);
+	ASSERT_FALSE (ledger.confirm (transaction, send1.hash ()));
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+	ASSERT_EQ (2, info.confirmation_height);
+	// Confirming an ancestor doesn't lower the height
+	ASSERT_FALSE (ledger.confirm (transaction, genesis.hash ()));
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+	ASSERT_EQ (2, info.confirmation_height);
+	ASSERT_TRUE (ledger.confirm (transaction, 1));
+	// send2 is above the confirmation height, send1 is not
+	ASSERT_FALSE (ledger.rollback (transaction, send2.hash ()));
+	ASSERT_EQ (send1.hash (), ledger.latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_TRUE (ledger.rollback (transaction, send1.hash ()));
+	ASSERT_EQ (send1.hash (), ledger.latest (transaction, rai::test_genesis_key.pub));
+	ASSERT_FALSE (store.account_get (transaction, rai::test_genesis_key.pub, info));
+	ASSERT_EQ (2, info.block_count);
+}
+
+TEST (ledger, confirmation_height_receive)
+{
+	bool init (false);
+	rai::block_store store (init, rai::unique_path ());
+	ASSERT_TRUE (!init);
+	rai::ledger ledger (store);
+	rai::transaction transaction (store.environment, nullptr, true);
+	rai::genesis genesis;
+	genesis.initialize (transaction, store);
+	rai::keypair key2;
+	rai::send_block send1 (genesis.hash (), key2.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, send1).code);
+	rai::open_block open1 (send1.hash (), key2.pub, key2.pub, key2.prv, key2.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, ledger.process (transaction, open1).code);
+	ASSERT_FALSE (ledger.confirm (transaction, open1.hash ()));
+	// Rolling back send1 would need the confirmed open block to be rolled back
+	ASSERT_TRUE (ledger.rollback (transaction, send1.hash ()));
+	ASSERT_TRUE (store.block_exists (transaction, open1.hash ()));
+	ASSERT_EQ (send1.hash (), ledger.latest (transaction, rai::test_genesis_key.pub));
+}
@@ -39,6 +39,31 @@ TEST (message, keepalive_deserialize)
     ASSERT_EQ (message1.peers, message2.peers);
 }
 
+TEST (message, keepalive_probe_serialization)
+{
+    rai::keepalive message1;
+	message1.probe_set (0x0123456789abcdef);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        message1.serialize (stream);
+    }
+	rai::keepalive plain;
+    std::vector <uint8_t> plain_bytes;
+    {
+        rai::vectorstream stream (plain_bytes);
+        plain.serialize (stream);
+    }
+	ASSERT_EQ (plain_bytes.size () + sizeof (uint64_t), bytes.size ());
+    rai::keepalive message2;
+    rai::bufferstream stream (bytes.data (), bytes.size ());
+    ASSERT_FALSE (message2.deserialize (stream));
+	ASSERT_TRUE (message2.probe ());
+	ASSERT_FALSE (message2.echo ());
+	ASSERT_EQ (0x0123456789abcdef, message2.nonce);
+    ASSERT_EQ (message1, message2);
+}
+
 TEST (message, publish_serialization)
 {
     rai::publish publish (std::unique_ptr <rai::block> (new rai::send_block (0, 1, 2, rai::keypair ().prv, 4, 5)));
@@ -87,4 +112,66 @@ TEST (message, confirm_ack_serialization)
     rai::confirm_ack con2 (error, stream2);
 	ASSERT_FALSE (error);
     ASSERT_EQ (con1, con2);
-}
\ No newline at end of file
+}
+
+TEST (message, confirm_ack_hash_serialization)
+{
+    rai::keypair key1;
+    std::vector <rai::block_hash> hashes;
+    for (size_t i (0); i < rai::vote::hashes_max; ++i)
+    {
+        hashes.push_back (rai::block_hash (i + 1));
+    }
+    rai::confirm_ack con1 (key1.pub, key1.prv, 0, hashes);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream1 (bytes);
+        con1.serialize (stream1);
+    }
+    rai::bufferstream stream2 (bytes.data (), bytes.size ());
+	bool error;
+    rai::confirm_ack con2 (error, stream2);
+	ASSERT_FALSE (error);
+    ASSERT_EQ (con1, con2);
+    ASSERT_EQ (nullptr, con2.vote.block);
+    ASSERT_EQ (hashes, con2.vote.hashes);
+    ASSERT_FALSE (rai::validate_message (key1.pub, con2.vote.hash (), con2.vote.signature));
+}
+
+TEST (message, confirm_req_hash_serialization)
+{
+    std::vector <std::pair <rai::block_hash, rai::block_hash>> roots_hashes;
+    for (size_t i (0); i < rai::confirm_req::roots_hashes_max; ++i)
+    {
+        roots_hashes.push_back (std::make_pair (rai::block_hash (i), rai::block_hash (i + 1)));
+    }
+    rai::confirm_req req1 (roots_hashes);
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream1 (bytes);
+        req1.serialize (stream1);
+    }
+    // Still fits the smallest datagram buffer
+    ASSERT_GE (512, bytes.size ());
+    rai::bufferstream stream2 (bytes.data (), bytes.size ());
+    rai::confirm_req req2;
+    ASSERT_FALSE (req2.deserialize (stream2));
+    ASSERT_EQ (req1, req2);
+    ASSERT_EQ (roots_hashes, req2.roots_hashes);
+}
+
+TEST (message, realtime_serialization)
+{
+    rai::realtime request1;
+    request1.port = 54000;
+    std::vector <uint8_t> bytes;
+    {
+        rai::vectorstream stream (bytes);
+        request1.serialize (stream);
+    }
+    ASSERT_EQ (10, bytes.size ());
+    rai::realtime request2;
+    rai::bufferstream buffer (bytes.data (), bytes.size ());
+    ASSERT_FALSE (request2.deserialize (buffer));
+    ASSERT_EQ (request1, request2);
+}
@@ -55,9 +55,9 @@ TEST (network, construction)
 TEST (network, self_discard)
 {
     rai::system system (24000, 1);
-	system.nodes [0]->network.remote = system.nodes [0]->network.endpoint ();
+	system.nodes [0]->network.receivers [0]->remote = system.nodes [0]->network.endpoint ();
 	ASSERT_EQ (0, system.nodes [0]->network.bad_sender_count);
-	system.nodes [0]->network.receive_action (boost::system::error_code {}, 0);
+	system.nodes [0]->network.receivers [0]->receive_action (boost::system::error_code {}, 0);
 	ASSERT_EQ (1, system.nodes [0]->network.bad_sender_count);
 }
 
@@ -70,7 +70,7 @@ TEST (network, send_keepalive)
     auto node1 (std::make_shared <rai::node> (init1, *system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
     node1->start ();
     system.nodes [0]->network.send_keepalive (node1->network.endpoint ());
-    auto initial (system.nodes [0]->network.keepalive_count);
+    auto initial (system.nodes [0]->network.keepalive_count.load ());
     ASSERT_EQ (0, system.nodes [0]->peers.list ().size ());
     ASSERT_EQ (0, node1->peers.list ().size ());
     auto iterations (0);
@@ -89,6 +89,114 @@ TEST (network, send_keepalive)
     node1->stop ();
 }
 
+TEST (network, keepalive_probe)
+{
+    rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	node1.config.latency_probing = true;
+	auto iterations (0);
+	// Probes are only echoed by peers that already know the sender
+	while (!node1.peers.known_peer (node2.network.endpoint ()) || !node2.peers.known_peer (node1.network.endpoint ()))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_TRUE (node1.peers.preferred (1).empty ());
+	node1.network.send_keepalive (node2.network.endpoint ());
+	iterations = 0;
+	while (node1.peers.preferred (1).empty ())
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (node2.network.endpoint (), node1.peers.preferred (1) [0]);
+	// Node2 didn't probe so it has nothing measured
+	ASSERT_TRUE (node2.peers.preferred (1).empty ());
+}
+
+TEST (network, multiple_receivers)
+{
+    rai::system system (24000, 1);
+	rai::node_config config (24001, system.logging);
+	config.network_receivers = 4;
+    rai::node_init init1;
+    auto node1 (std::make_shared <rai::node> (init1, *system.service, rai::unique_path (), system.alarm, config, system.work));
+	ASSERT_EQ (4, node1->network.receivers.size ());
+	for (auto & i: node1->network.receivers)
+	{
+		ASSERT_EQ (24001, i->socket.local_endpoint ().port ());
+	}
+    node1->start ();
+    system.nodes [0]->network.send_keepalive (node1->network.endpoint ());
+    auto iterations (0);
+    while (node1->network.keepalive_count == 0)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+	uint64_t received (0);
+	for (auto & i: node1->network.receivers)
+	{
+		received += i->receive_count;
+	}
+	ASSERT_LE (1, received);
+    node1->stop ();
+}
+
+TEST (network, udp_batching)
+{
+    rai::system system (24000, 1);
+	rai::node_config config (24001, system.logging);
+	config.udp_batching = true;
+    rai::node_init init1;
+    auto node1 (std::make_shared <rai::node> (init1, *system.service, rai::unique_path (), system.alarm, config, system.work));
+    node1->start ();
+	for (auto i (0); i < 10; ++i)
+	{
+		node1->network.send_keepalive (system.nodes [0]->network.endpoint ());
+		system.nodes [0]->network.send_keepalive (node1->network.endpoint ());
+	}
+    auto iterations (0);
+    while (node1->network.keepalive_count < 10 || system.nodes [0]->network.keepalive_count < 10)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    node1->stop ();
+}
+
+TEST (network, socket_buffers)
+{
+    rai::system system (24000, 1);
+	rai::node_config config (24001, system.logging);
+	config.socket_receive_buffer = 64 * 1024;
+	config.socket_send_buffer = 64 * 1024;
+    rai::node_init init1;
+    auto node1 (std::make_shared <rai::node> (init1, *system.service, rai::unique_path (), system.alarm, config, system.work));
+	boost::asio::socket_base::receive_buffer_size receive_buffer;
+	node1->network.socket.get_option (receive_buffer);
+	ASSERT_GE (receive_buffer.value (), config.socket_receive_buffer);
+	boost::asio::socket_base::send_buffer_size send_buffer;
+	node1->network.socket.get_option (send_buffer);
+	ASSERT_GE (send_buffer.value (), config.socket_send_buffer);
+    node1->start ();
+	system.nodes [0]->network.send_keepalive (node1->network.endpoint ());
+    auto iterations (0);
+    while (node1->network.keepalive_count == 0)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+	ASSERT_EQ (0, node1->network.drop_count ());
+    node1->stop ();
+}
+
 TEST (network, keepalive_ipv4)
 {
     rai::system system (24000, 1);
@@ -98,7 +206,7 @@ TEST (network, keepalive_ipv4)
     auto node1 (std::make_shared <rai::node> (init1, *system.service, 24001, rai::unique_path (), system.alarm, system.logging, system.work));
     node1->start ();
     node1->send_keepalive (rai::endpoint (boost::asio::ip::address_v4::loopback (), 24000));
-    auto initial (system.nodes [0]->network.keepalive_count);
+    auto initial (system.nodes [0]->network.keepalive_count.load ());
     auto iterations (0);
     while (system.nodes [0]->network.keepalive_count == initial)
     {
@@ -183,6 +291,60 @@ TEST (network, send_invalid_publish)
     ASSERT_EQ (genesis.hash (), system.nodes [1]->latest (rai::test_genesis_key.pub));
 }
 
+TEST (network, confirm_req_batch)
+{
+    rai::system system (24000, 2);
+    auto & node1 (*system.nodes [0]);
+    auto & node2 (*system.nodes [1]);
+    node1.config.vote_bundling = true;
+    node2.config.vote_bundling = true;
+	system.wallet (1)->insert_adhoc (rai::test_genesis_key.prv);
+    rai::genesis genesis;
+    rai::keypair key1;
+    // node2 has neither this block nor a successor to its root so only the genesis block gets a vote
+    rai::send_block send1 (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+    node1.confirm_req_batcher.add (*genesis.open);
+    node1.confirm_req_batcher.add (send1);
+    auto iterations (0);
+    while (node1.network.confirm_ack_count < 1 || node2.network.confirm_req_count < 1)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+    ASSERT_EQ (1, node1.confirm_req_batcher.request_count);
+    ASSERT_EQ (1, node2.network.confirm_req_count);
+    ASSERT_EQ (1, node2.vote_bundler.hash_count);
+}
+
+TEST (network, confirm_req_hash_unknown_peer)
+{
+    rai::system system (24000, 1);
+    auto & node1 (*system.nodes [0]);
+    node1.config.vote_bundling = true;
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+    rai::genesis genesis;
+    rai::confirm_req req (std::vector <std::pair <rai::block_hash, rai::block_hash>> (1, std::make_pair (genesis.hash (), genesis.hash ())));
+    rai::endpoint unknown (boost::asio::ip::address_v6::loopback (), 10000);
+    ASSERT_FALSE (node1.peers.known_peer (unknown));
+	node1.process_message (req, unknown);
+	node1.block_processor.flush ();
+	{
+		std::lock_guard <std::mutex> lock (node1.vote_bundler.mutex);
+		ASSERT_TRUE (node1.vote_bundler.remote.empty ());
+		ASSERT_FALSE (node1.vote_bundler.scheduled);
+	}
+    // Once contacted the same request is answered
+	node1.process_message (req, unknown);
+    auto iterations (0);
+    while (node1.vote_bundler.hash_count == 0)
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+}
+
 TEST (network, send_valid_confirm_ack)
 {
     rai::system system (24000, 2);
@@ -201,6 +363,7 @@ TEST (network, send_valid_confirm_ack)
         ++iterations;
         ASSERT_LT (iterations, 200);
     }
+	system.nodes [1]->block_processor.flush ();
     rai::block_hash latest3 (system.nodes [1]->latest (rai::test_genesis_key.pub));
     ASSERT_NE (latest2, latest3);
     ASSERT_EQ (hash2, latest3);
@@ -231,18 +394,47 @@ TEST (network, send_valid_publish)
     ASSERT_EQ (50, system.nodes [1]->balance (rai::test_genesis_key.pub));
 }
 
+TEST (network, capture_replay)
+{
+    rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	std::stringstream stream;
+	node2.network.capture = std::make_shared <rai::packet_capture> (stream);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::publish publish (std::unique_ptr <rai::block> (new rai::send_block (genesis.hash (), key1.pub, 50, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()))));
+	auto hash (publish.block->hash ());
+	node1.network.send_buffer (publish.to_bytes (), node2.network.endpoint (), 0, rai::send_priority::publish);
+    auto iterations (0);
+    while (!node2.ledger.block_exists (hash))
+    {
+        system.poll ();
+        ++iterations;
+        ASSERT_LT (iterations, 200);
+    }
+	auto captured (node2.network.capture->count);
+	node2.network.capture.reset ();
+	ASSERT_GE (captured, 1);
+	rai::system system2 (24002, 1);
+	auto & node3 (*system2.nodes [0]);
+	ASSERT_FALSE (node3.ledger.block_exists (hash));
+	rai::packet_replay replay (node3, stream);
+	ASSERT_FALSE (replay.run (0.0));
+	ASSERT_EQ (captured, replay.read_count);
+	ASSERT_EQ (1, replay.committed_count);
+	ASSERT_TRUE (node3.ledger.block_exists (hash));
+	// Senders were moved off the recorded endpoints
+	ASSERT_FALSE (node3.peers.known_peer (node1.network.endpoint ()));
+	ASSERT_TRUE (node3.peers.known_peer (rai::endpoint (boost::asio::ip::address_v6::loopback (), rai::packet_replay::sender_port)));
+}
+
 TEST (network, send_insufficient_work)
 {
     rai::system system (24000, 2);
     std::unique_ptr <rai::send_block> block (new rai::send_block (0, 1, 20, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0));
     rai::publish publish (std::move (block));
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-    {
-        rai::vectorstream stream (*bytes);
-        publish.serialize (stream);
-    }
-    auto node1 (system.nodes [1]->shared ());
-    system.nodes [0]->network.send_buffer (bytes->data (), bytes->size (), system.nodes [1]->network.endpoint (), 0, [bytes, node1] (boost::system::error_code const & ec, size_t size) {});
+    system.nodes [0]->network.send_buffer (publish.to_bytes (), system.nodes [1]->network.endpoint (), 0, rai::send_priority::publish);
     ASSERT_EQ (0, system.nodes [0]->network.insufficient_work_count);
     auto iterations (0);
     while (system.nodes [1]->network.insufficient_work_count == 0)
@@ -271,6 +463,22 @@ TEST (receivable_processor, confirm_insufficient_pos)
 	node1.process_message (con1, node1.network.endpoint ());
 }
 
+TEST (receivable_processor, confirm_hash_insufficient_weight)
+{
+    rai::system system (24000, 1);
+    auto & node1 (*system.nodes [0]);
+    rai::genesis genesis;
+    rai::send_block block1 (genesis.hash (), 0, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_EQ (rai::process_result::progress, node1.process (block1).code);
+    rai::keypair key1;
+    rai::confirm_ack con1 (key1.pub, key1.prv, 1, std::vector <rai::block_hash> (1, block1.hash ()));
+	node1.process_message (con1, node1.network.endpoint ());
+	ASSERT_EQ (1, node1.network.insufficient_weight_count);
+    rai::confirm_ack con2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, std::vector <rai::block_hash> (1, block1.hash ()));
+	node1.process_message (con2, node1.network.endpoint ());
+	ASSERT_EQ (1, node1.network.insufficient_weight_count);
+}
+
 TEST (receivable_processor, confirm_sufficient_pos)
 {
     rai::system system (24000, 1);
@@ -424,6 +632,37 @@ TEST (bulk_pull, no_end)
 	ASSERT_TRUE (request->request->end.is_zero ());
 }
 
+TEST (bulk_pull, pruned)
+{
+    rai::system system (24000, 1);
+    auto & node1 (*system.nodes [0]);
+    rai::genesis genesis;
+    rai::keypair key2;
+    rai::change_block change1 (genesis.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+    rai::change_block change2 (change1.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+    rai::change_block change3 (change2.hash (), key2.pub, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+    {
+        rai::transaction transaction (node1.store.environment, nullptr, true);
+        ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, change1).code);
+        ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, change2).code);
+        ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, change3).code);
+        ASSERT_FALSE (node1.ledger.confirm (transaction, change3.hash ()));
+        ASSERT_EQ (1, node1.ledger.prune (transaction, rai::test_genesis_key.pub, 2));
+    }
+    auto connection (std::make_shared <rai::bootstrap_server> (nullptr, system.nodes [0]));
+    std::unique_ptr <rai::bulk_pull> req1 (new rai::bulk_pull {});
+    req1->start = rai::test_genesis_key.pub;
+    req1->end.clear ();
+    connection->requests.push (std::unique_ptr <rai::message> {});
+    auto request1 (std::make_shared <rai::bulk_pull_server> (connection, std::move (req1)));
+    ASSERT_EQ (request1->request->end, request1->current);
+    std::unique_ptr <rai::bulk_pull> req2 (new rai::bulk_pull {});
+    req2->start = rai::test_genesis_key.pub;
+    req2->end = change2.hash ();
+    auto request2 (std::make_shared <rai::bulk_pull_server> (connection, std::move (req2)));
+    ASSERT_EQ (change3.hash (), request2->current);
+}
+
 TEST (bulk_pull, end_not_owned)
 {
     rai::system system (24000, 1);
@@ -900,3 +1139,265 @@ TEST (network, endpoint_bad_fd)
 	ASSERT_TRUE (endpoint.address ().is_loopback ());
 	ASSERT_EQ (0, endpoint.port ());
 }
+
+TEST (token_bucket, refill)
+{
+	rai::token_bucket bucket (10, 2);
+	auto now (std::chrono::steady_clock::now ());
+	ASSERT_FALSE (bucket.consume (now));
+	ASSERT_FALSE (bucket.consume (now));
+	ASSERT_TRUE (bucket.consume (now));
+	ASSERT_GT (bucket.delay (now).count (), 0);
+	ASSERT_FALSE (bucket.consume (now + std::chrono::milliseconds (100)));
+	rai::token_bucket unlimited (0, 0);
+	ASSERT_FALSE (unlimited.consume (now));
+	ASSERT_EQ (0, unlimited.delay (now).count ());
+}
+
+TEST (send_scheduler, priority)
+{
+	rai::send_scheduler scheduler (0, 0, 0, 0);
+	rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 24000);
+	scheduler.push ({nullptr, endpoint, 0, rai::send_priority::keepalive, nullptr});
+	scheduler.push ({nullptr, endpoint, 0, rai::send_priority::publish, nullptr});
+	scheduler.push ({nullptr, endpoint, 0, rai::send_priority::vote, nullptr});
+	scheduler.push ({nullptr, endpoint, 0, rai::send_priority::confirm_req, nullptr});
+	ASSERT_EQ (4, scheduler.size ());
+	std::vector <rai::send_info> sends;
+	std::chrono::steady_clock::time_point next;
+	scheduler.pop (sends, 3, std::chrono::steady_clock::now (), next);
+	ASSERT_EQ (3, sends.size ());
+	ASSERT_EQ (rai::send_priority::vote, sends [0].priority);
+	ASSERT_EQ (rai::send_priority::confirm_req, sends [1].priority);
+	ASSERT_EQ (rai::send_priority::publish, sends [2].priority);
+	ASSERT_EQ (1, scheduler.size ());
+}
+
+TEST (send_scheduler, peer_limit)
+{
+	rai::send_scheduler scheduler (0, 0, 1, 2);
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 24000);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 24001);
+	for (auto i (0); i < 3; ++i)
+	{
+		scheduler.push ({nullptr, endpoint1, 0, rai::send_priority::publish, nullptr});
+	}
+	scheduler.push ({nullptr, endpoint2, 0, rai::send_priority::publish, nullptr});
+	std::vector <rai::send_info> sends;
+	std::chrono::steady_clock::time_point next;
+	auto now (std::chrono::steady_clock::now ());
+	scheduler.pop (sends, 10, now, next);
+	ASSERT_EQ (3, sends.size ());
+	ASSERT_EQ (endpoint2, sends [2].endpoint);
+	ASSERT_EQ (1, scheduler.size ());
+	ASSERT_GT (next, now);
+	ASSERT_LT (next, std::chrono::steady_clock::time_point::max ());
+}
+
+TEST (send_scheduler, throttled_order)
+{
+	rai::send_scheduler scheduler (0, 0, 1, 1);
+	rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 24000);
+	for (auto i (0); i < 3; ++i)
+	{
+		scheduler.push ({nullptr, endpoint, static_cast <size_t> (i), rai::send_priority::publish, nullptr});
+	}
+	std::vector <rai::send_info> sends;
+	std::chrono::steady_clock::time_point next;
+	auto now (std::chrono::steady_clock::now ());
+	scheduler.pop (sends, 10, now, next);
+	ASSERT_EQ (1, sends.size ());
+	ASSERT_EQ (2, scheduler.throttled.size ());
+	// Each held send has its own token reserved, a second apart
+	auto due1 (next);
+	ASSERT_GT (due1, now);
+	scheduler.pop (sends, 10, due1, next);
+	ASSERT_EQ (2, sends.size ());
+	ASSERT_EQ (1, sends [1].rebroadcast);
+	ASSERT_GT (next, due1);
+	auto due2 (next);
+	scheduler.pop (sends, 10, due2, next);
+	ASSERT_EQ (3, sends.size ());
+	ASSERT_EQ (2, sends [2].rebroadcast);
+	ASSERT_EQ (0, scheduler.size ());
+}
+
+TEST (send_scheduler, retry)
+{
+	rai::send_scheduler scheduler (0, 0, 0, 0);
+	rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 24000);
+	auto now (std::chrono::steady_clock::now ());
+	scheduler.retry ({nullptr, endpoint, 1, rai::send_priority::publish, nullptr}, now + std::chrono::seconds (1));
+	std::vector <rai::send_info> sends;
+	std::chrono::steady_clock::time_point next;
+	scheduler.pop (sends, 10, now, next);
+	ASSERT_TRUE (sends.empty ());
+	ASSERT_EQ (now + std::chrono::seconds (1), next);
+	auto due (next);
+	scheduler.pop (sends, 10, due, next);
+	ASSERT_EQ (1, sends.size ());
+	ASSERT_EQ (0, scheduler.size ());
+}
+
+TEST (realtime_channel, publish)
+{
+    rai::system system (24000, 2);
+	for (auto & i: system.nodes)
+	{
+		i->config.realtime_tcp = true;
+	}
+	auto & node0 (*system.nodes [0]);
+	auto & node1 (*system.nodes [1]);
+	node0.network.realtime.connect (node1.network.endpoint ());
+    auto iterations1 (0);
+    while (node0.network.realtime.find (node1.network.endpoint ()) == nullptr || node1.network.realtime.find (node0.network.endpoint ()) == nullptr)
+    {
+        system.poll ();
+        ++iterations1;
+        ASSERT_LT (iterations1, 200);
+    }
+    rai::keypair key2;
+    rai::block_hash latest1 (node0.latest (rai::test_genesis_key.pub));
+    rai::send_block block2 (latest1, key2.pub, 50, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest1));
+    rai::publish publish (block2.clone ());
+    node0.network.send_buffer (publish.to_bytes (), node1.network.endpoint (), 0, rai::send_priority::publish);
+    auto iterations2 (0);
+    while (node1.latest (rai::test_genesis_key.pub) != block2.hash () || node0.network.realtime.sent_count == 0)
+    {
+        system.poll ();
+        ++iterations2;
+        ASSERT_LT (iterations2, 200);
+    }
+	ASSERT_LE (1, node1.network.realtime.received_count);
+}
+
+TEST (realtime_channel, send)
+{
+    rai::system system (24000, 2);
+	for (auto & i: system.nodes)
+	{
+		i->config.realtime_tcp = true;
+	}
+	auto & node0 (*system.nodes [0]);
+	auto & node1 (*system.nodes [1]);
+	node0.network.realtime.connect (node1.network.endpoint ());
+    auto iterations1 (0);
+    while (node0.network.realtime.find (node1.network.endpoint ()) == nullptr || node1.network.realtime.find (node0.network.endpoint ()) == nullptr)
+    {
+        system.poll ();
+        ++iterations1;
+        ASSERT_LT (iterations1, 200);
+    }
+	auto channel (node0.network.realtime.find (node1.network.endpoint ()));
+	rai::keepalive keepalive;
+	auto bytes (keepalive.to_bytes ());
+	auto received (node1.network.realtime.received_count.load ());
+	std::vector <boost::system::error_code> results;
+	ASSERT_FALSE (channel->send (bytes, [&results] (boost::system::error_code const & ec, size_t size_a) { results.push_back (ec); }));
+    auto iterations2 (0);
+    while (results.empty () || node1.network.realtime.received_count == received)
+    {
+        system.poll ();
+        ++iterations2;
+        ASSERT_LT (iterations2, 200);
+    }
+	ASSERT_FALSE (results [0]);
+	ASSERT_EQ (received + 1, node1.network.realtime.received_count);
+	// A failed write fails everything queued behind it
+	results.clear ();
+	boost::system::error_code ignored;
+	channel->socket->close (ignored);
+	ASSERT_FALSE (channel->send (bytes, [&results] (boost::system::error_code const & ec, size_t size_a) { results.push_back (ec); }));
+	ASSERT_FALSE (channel->send (bytes, [&results] (boost::system::error_code const & ec, size_t size_a) { results.push_back (ec); }));
+    auto iterations3 (0);
+    while (results.size () < 2)
+    {
+        system.poll ();
+        ++iterations3;
+        ASSERT_LT (iterations3, 200);
+    }
+	ASSERT_TRUE (results [0]);
+	ASSERT_TRUE (results [1]);
+	ASSERT_TRUE (channel->queue.empty ());
+	ASSERT_EQ (nullptr, node0.network.realtime.find (node1.network.endpoint ()));
+}
+
+TEST (realtime_channel, failed_write_udp)
+{
+    rai::system system (24000, 2);
+	for (auto & i: system.nodes)
+	{
+		i->config.realtime_tcp = true;
+	}
+	auto & node0 (*system.nodes [0]);
+	auto & node1 (*system.nodes [1]);
+	node0.network.realtime.connect (node1.network.endpoint ());
+    auto iterations1 (0);
+    while (node0.network.realtime.find (node1.network.endpoint ()) == nullptr)
+    {
+        system.poll ();
+        ++iterations1;
+        ASSERT_LT (iterations1, 200);
+    }
+	boost::system::error_code ignored;
+	node0.network.realtime.find (node1.network.endpoint ())->socket->close (ignored);
+	// The write on the closed channel fails and the publish is requeued over UDP
+    rai::keypair key2;
+    rai::block_hash latest1 (node0.latest (rai::test_genesis_key.pub));
+    rai::send_block block2 (latest1, key2.pub, 50, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (latest1));
+    rai::publish publish (block2.clone ());
+    node0.network.send_buffer (publish.to_bytes (), node1.network.endpoint (), 0, rai::send_priority::publish);
+    auto iterations2 (0);
+    while (node1.latest (rai::test_genesis_key.pub) != block2.hash ())
+    {
+        system.poll ();
+        ++iterations2;
+        ASSERT_LT (iterations2, 200);
+    }
+	ASSERT_EQ (0, node0.network.realtime.sent_count);
+}
+
+TEST (realtime_channel, inbound_limit)
+{
+    rai::system system (24000, 2);
+	for (auto & i: system.nodes)
+	{
+		i->config.realtime_tcp = true;
+	}
+	auto & node0 (*system.nodes [0]);
+	auto & node1 (*system.nodes [1]);
+	node1.config.realtime_channels_max = 0;
+	node0.network.realtime.connect (node1.network.endpoint ());
+	// node1 is full so it closes the inbound channel and node0's closes when the read fails
+    auto iterations1 (0);
+    while (!node0.network.realtime.connecting.empty () || node0.network.realtime.find (node1.network.endpoint ()) != nullptr)
+    {
+        system.poll ();
+        ++iterations1;
+        ASSERT_LT (iterations1, 200);
+    }
+	ASSERT_EQ (0, node1.network.realtime.size ());
+}
+
+TEST (realtime_channel, close_idle)
+{
+    rai::system system (24000, 2);
+	for (auto & i: system.nodes)
+	{
+		i->config.realtime_tcp = true;
+	}
+	auto & node0 (*system.nodes [0]);
+	auto & node1 (*system.nodes [1]);
+	node0.network.realtime.connect (node1.network.endpoint ());
+    auto iterations1 (0);
+    while (node0.network.realtime.find (node1.network.endpoint ()) == nullptr)
+    {
+        system.poll ();
+        ++iterations1;
+        ASSERT_LT (iterations1, 200);
+    }
+	node0.network.realtime.close_idle (std::chrono::steady_clock::now () - std::chrono::seconds (60));
+	ASSERT_NE (nullptr, node0.network.realtime.find (node1.network.endpoint ()));
+	node0.network.realtime.close_idle (std::chrono::steady_clock::now () + std::chrono::seconds (1));
+	ASSERT_EQ (nullptr, node0.network.realtime.find (node1.network.endpoint ()));
+}
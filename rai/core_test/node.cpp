@@ -466,19 +466,38 @@ TEST (node_config, serialization)
 	auto path (rai::unique_path ());
 	rai::logging logging1 (path);
 	rai::node_config config1 (100, logging1);
-	config1.packet_delay_microseconds = 10;
+	config1.send_rate = 10;
+	config1.send_peer_burst = 10;
+	config1.broadcast_fanout = 10;
+	config1.realtime_tcp = true;
+	config1.socket_receive_buffer = 10;
+	config1.socket_send_buffer = 10;
+	config1.vote_bundling = true;
+	config1.latency_probing = true;
+	config1.vote_minimum = 10;
 	config1.bootstrap_fraction_numerator = 10;
 	config1.creation_rebroadcast = 10;
 	config1.rebroadcast_delay = 10;
 	config1.receive_minimum = 10;
 	config1.inactive_supply = 10;
 	config1.password_fanout = 10;
+	config1.prune_depth = 10;
+	config1.network_receivers = 10;
+	config1.udp_batching = true;
 	boost::property_tree::ptree tree;
 	config1.serialize_json (tree);
 	rai::logging logging2 (path);
 	logging2.node_lifetime_tracing_value = !logging2.node_lifetime_tracing_value;
 	rai::node_config config2 (50, logging2);
-	ASSERT_NE (config2.packet_delay_microseconds, config1.packet_delay_microseconds);
+	ASSERT_NE (config2.send_rate, config1.send_rate);
+	ASSERT_NE (config2.send_peer_burst, config1.send_peer_burst);
+	ASSERT_NE (config2.broadcast_fanout, config1.broadcast_fanout);
+	ASSERT_NE (config2.realtime_tcp, config1.realtime_tcp);
+	ASSERT_NE (config2.socket_receive_buffer, config1.socket_receive_buffer);
+	ASSERT_NE (config2.socket_send_buffer, config1.socket_send_buffer);
+	ASSERT_NE (config2.vote_bundling, config1.vote_bundling);
+	ASSERT_NE (config2.latency_probing, config1.latency_probing);
+	ASSERT_NE (config2.vote_minimum, config1.vote_minimum);
 	ASSERT_NE (config2.bootstrap_fraction_numerator, config1.bootstrap_fraction_numerator);
 	ASSERT_NE (config2.creation_rebroadcast, config1.creation_rebroadcast);
 	ASSERT_NE (config2.rebroadcast_delay, config1.rebroadcast_delay);
@@ -486,10 +505,21 @@ TEST (node_config, serialization)
 	ASSERT_NE (config2.logging.node_lifetime_tracing_value, config1.logging.node_lifetime_tracing_value);
 	ASSERT_NE (config2.inactive_supply, config1.inactive_supply);
 	ASSERT_NE (config2.password_fanout, config1.password_fanout);
+	ASSERT_NE (config2.prune_depth, config1.prune_depth);
+	ASSERT_NE (config2.network_receivers, config1.network_receivers);
+	ASSERT_NE (config2.udp_batching, config1.udp_batching);
 	bool upgraded (false);
 	config2.deserialize_json (upgraded, tree);
 	ASSERT_FALSE (upgraded);
-	ASSERT_EQ (config2.packet_delay_microseconds, config1.packet_delay_microseconds);
+	ASSERT_EQ (config2.send_rate, config1.send_rate);
+	ASSERT_EQ (config2.send_peer_burst, config1.send_peer_burst);
+	ASSERT_EQ (config2.broadcast_fanout, config1.broadcast_fanout);
+	ASSERT_EQ (config2.realtime_tcp, config1.realtime_tcp);
+	ASSERT_EQ (config2.socket_receive_buffer, config1.socket_receive_buffer);
+	ASSERT_EQ (config2.socket_send_buffer, config1.socket_send_buffer);
+	ASSERT_EQ (config2.vote_bundling, config1.vote_bundling);
+	ASSERT_EQ (config2.latency_probing, config1.latency_probing);
+	ASSERT_EQ (config2.vote_minimum, config1.vote_minimum);
 	ASSERT_EQ (config2.bootstrap_fraction_numerator, config1.bootstrap_fraction_numerator);
 	ASSERT_EQ (config2.creation_rebroadcast, config1.creation_rebroadcast);
 	ASSERT_EQ (config2.rebroadcast_delay, config1.rebroadcast_delay);
@@ -497,6 +527,22 @@ TEST (node_config, serialization)
 	ASSERT_EQ (config2.logging.node_lifetime_tracing_value, config1.logging.node_lifetime_tracing_value);
 	ASSERT_EQ (config2.inactive_supply, config1.inactive_supply);
 	ASSERT_EQ (config2.password_fanout, config1.password_fanout);
+	ASSERT_EQ (config2.prune_depth, config1.prune_depth);
+	ASSERT_EQ (config2.network_receivers, config1.network_receivers);
+	ASSERT_EQ (config2.udp_batching, config1.udp_batching);
+}
+
+TEST (node_config, bad_bool)
+{
+	auto path (rai::unique_path ());
+	rai::logging logging1 (path);
+	rai::node_config config1 (100, logging1);
+	boost::property_tree::ptree tree;
+	config1.serialize_json (tree);
+	tree.put ("udp_batching", "maybe");
+	rai::node_config config2 (50, logging1);
+	bool upgraded (false);
+	ASSERT_TRUE (config2.deserialize_json (upgraded, tree));
 }
 
 TEST (node_config, v1_v2_upgrade)
@@ -598,6 +644,8 @@ TEST (node_config, v2_v3_upgrade)
 	ASSERT_NE (0, std::stoul (tree.get <std::string> ("password_fanout")));
 	ASSERT_NE (0, std::stoul (tree.get <std::string> ("password_fanout")));
 	ASSERT_TRUE (upgraded);
+	ASSERT_FALSE (tree.get_optional <std::string> ("packet_delay_microseconds"));
+	ASSERT_TRUE (!!tree.get_optional <std::string> ("send_rate"));
 	auto version (tree.get <std::string> ("version"));
 	ASSERT_GT (std::stoull (version), 2);
 }
@@ -1056,6 +1104,7 @@ TEST (node, fork_no_vote_quorum)
 	{
 		system.poll ();
 	}
+	node3.block_processor.flush ();
 	ASSERT_TRUE (node1.latest (rai::test_genesis_key.pub) == send1.hash ());
 	ASSERT_TRUE (node2.latest (rai::test_genesis_key.pub) == send1.hash ());
 	ASSERT_TRUE (node3.latest (rai::test_genesis_key.pub) == send1.hash ());
@@ -1100,4 +1149,216 @@ TEST (node, stopped_rollback)
 		ASSERT_TRUE (node3.ledger.block_exists (block1->hash ()));
 		ASSERT_FALSE (node3.ledger.block_exists (block2->hash ()));
 	}
-}
\ No newline at end of file
+}
+TEST (node, block_export_import)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	rai::keypair key1;
+	rai::genesis genesis;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	rai::open_block open1 (send1.hash (), 1, key1.pub, key1.prv, key1.pub, system.work.generate (key1.pub));
+	rai::send_block send2 (open1.hash (), rai::test_genesis_key.pub, 50, key1.prv, key1.pub, system.work.generate (open1.hash ()));
+	{
+		rai::transaction transaction (node1.store.environment, nullptr, true);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, send1).code);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, open1).code);
+		ASSERT_EQ (rai::process_result::progress, node1.ledger.process (transaction, send2).code);
+	}
+	std::stringstream stream;
+	rai::block_export exporter (node1.store, stream);
+	ASSERT_EQ (4, exporter.export_all ());
+	rai::block_import importer (node2, stream);
+	ASSERT_FALSE (importer.run ());
+	ASSERT_EQ (4, importer.read_count);
+	ASSERT_EQ (3, importer.progress_count);
+	ASSERT_EQ (1, importer.old_count);
+	ASSERT_EQ (0, importer.unresolved_count);
+	ASSERT_EQ (50, node2.balance (key1.pub));
+	rai::transaction transaction (node2.store.environment, nullptr, false);
+	ASSERT_EQ (node2.store.unchecked_end (), node2.store.unchecked_begin (transaction));
+}
+
+TEST (node, block_import_truncated)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	std::stringstream stream;
+	rai::block_export exporter (node1.store, stream);
+	ASSERT_EQ (1, exporter.export_all ());
+	auto contents (stream.str ());
+	std::stringstream truncated (contents.substr (0, contents.size () - 1));
+	rai::block_import importer (node1, truncated);
+	ASSERT_TRUE (importer.run ());
+	ASSERT_EQ (0, importer.read_count);
+}
+
+TEST (block_processor, process)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	rai::send_block send2 (send1.hash (), key1.pub, rai::genesis_amount - 200, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (send1.hash ()));
+	auto processed (false);
+	ASSERT_FALSE (node1.block_processor.add (send2.clone (), 0));
+	ASSERT_FALSE (node1.block_processor.add (send1.clone (), 0, [&processed] () { processed = true; }));
+	node1.block_processor.flush ();
+	ASSERT_TRUE (processed);
+	ASSERT_EQ (0, node1.block_processor.size ());
+	ASSERT_EQ (2, node1.block_processor.processed_count);
+	ASSERT_EQ (send2.hash (), node1.latest (rai::test_genesis_key.pub));
+	node1.block_processor.stop ();
+	ASSERT_TRUE (node1.block_processor.add (send1.clone (), 0));
+	ASSERT_EQ (1, node1.block_processor.drop_count);
+}
+
+TEST (block_processor, queue_priority)
+{
+	rai::block_processor_queue queue (4, 1);
+	rai::endpoint peer1 (boost::asio::ip::address_v6::loopback (), 24000);
+	rai::endpoint peer2 (boost::asio::ip::address_v6::loopback (), 24001);
+	rai::endpoint peer3 (boost::asio::ip::address_v6::loopback (), 24002);
+	auto now (std::chrono::steady_clock::now ());
+	std::vector <rai::block_processor_item> evicted;
+	ASSERT_FALSE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, peer1, 5}, evicted));
+	ASSERT_FALSE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, peer1, 3}, evicted));
+	// Half full, peer1 has used its share
+	ASSERT_TRUE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, peer1, 9}, evicted));
+	ASSERT_FALSE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, peer2, 1}, evicted));
+	ASSERT_FALSE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, peer3, 7}, evicted));
+	ASSERT_EQ (4, queue.size ());
+	// Full, a lower priority item is refused and a higher one evicts the lowest
+	ASSERT_TRUE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, rai::endpoint (), 1}, evicted));
+	ASSERT_FALSE (queue.push (rai::block_processor_item {nullptr, 0, now, nullptr, rai::block_origin::publish, rai::endpoint (), 8}, evicted));
+	ASSERT_EQ (4, queue.size ());
+	ASSERT_EQ (3, queue.drop_count);
+	ASSERT_EQ (1, evicted.size ());
+	ASSERT_EQ (1, evicted [0].priority);
+	ASSERT_EQ (8, queue.pop ().priority);
+	ASSERT_EQ (7, queue.pop ().priority);
+	ASSERT_EQ (5, queue.pop ().priority);
+	ASSERT_EQ (3, queue.pop ().priority);
+	ASSERT_TRUE (queue.empty ());
+	ASSERT_TRUE (queue.senders.empty ());
+}
+
+TEST (vote_filter, duplicate)
+{
+	rai::vote_filter filter;
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::vote vote1 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 1, std::unique_ptr <rai::block> (new rai::send_block (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0)));
+	ASSERT_FALSE (filter.filter (vote1, rai::genesis_amount));
+	ASSERT_TRUE (filter.filter (vote1, rai::genesis_amount));
+	ASSERT_EQ (1, filter.duplicate_count);
+	rai::vote vote2 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, vote1.block->clone ());
+	ASSERT_FALSE (filter.filter (vote2, rai::genesis_amount));
+	// A forged copy isn't mistaken for the signed vote
+	rai::vote vote3 (rai::test_genesis_key.pub, rai::test_genesis_key.prv, 2, vote1.block->clone ());
+	vote3.sequence = 3;
+	ASSERT_TRUE (filter.filter (vote3, rai::genesis_amount));
+	ASSERT_EQ (1, filter.invalid_count);
+	ASSERT_EQ (1, filter.size ());
+	// Accounts without weight never get an entry
+	rai::keypair key2;
+	ASSERT_TRUE (filter.filter (rai::vote (key2.pub, key2.prv, 1, vote1.block->clone ()), 0));
+	ASSERT_EQ (1, filter.unweighted_count);
+	ASSERT_EQ (1, filter.size ());
+}
+
+TEST (vote_filter, root_limit)
+{
+	rai::vote_filter filter;
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	uint64_t sequence (1);
+	auto start (std::chrono::steady_clock::now ());
+	for (size_t i (0); i < rai::vote_filter::root_votes; ++i)
+	{
+		ASSERT_FALSE (filter.filter (rai::vote (rai::test_genesis_key.pub, rai::test_genesis_key.prv, sequence++, send1.clone ()), rai::genesis_amount));
+	}
+	auto limited (filter.filter (rai::vote (rai::test_genesis_key.pub, rai::test_genesis_key.prv, sequence++, send1.clone ()), rai::genesis_amount));
+	if (std::chrono::steady_clock::now () - start < rai::vote_filter::window)
+	{
+		ASSERT_TRUE (limited);
+		ASSERT_EQ (1, filter.limited_count);
+	}
+	// Another root from the same representative has its own allowance
+	rai::send_block send2 (key1.pub, key1.pub, 0, rai::test_genesis_key.prv, rai::test_genesis_key.pub, 0);
+	ASSERT_FALSE (filter.filter (rai::vote (rai::test_genesis_key.pub, rai::test_genesis_key.prv, sequence++, send2.clone ()), rai::genesis_amount));
+	while (std::chrono::steady_clock::now () - start < rai::vote_filter::window)
+	{
+		std::this_thread::sleep_for (std::chrono::milliseconds (1));
+	}
+	ASSERT_FALSE (filter.filter (rai::vote (rai::test_genesis_key.pub, rai::test_genesis_key.prv, sequence++, send1.clone ()), rai::genesis_amount));
+	ASSERT_LT (0, filter.rates (1) [0].second);
+}
+
+TEST (vote_bundler, remote)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	auto & node2 (*system.nodes [1]);
+	system.wallet (0)->insert_adhoc (rai::test_genesis_key.prv);
+	std::vector <rai::block_hash> hashes;
+	for (size_t i (0); i < rai::vote::hashes_max + 1; ++i)
+	{
+		hashes.push_back (rai::block_hash (i + 1));
+		node1.vote_bundler.add (hashes.back (), node2.network.endpoint ());
+	}
+	node1.vote_bundler.add (hashes [0], node2.network.endpoint ());
+	auto iterations (0);
+	while (node2.network.confirm_ack_count < 2)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	ASSERT_EQ (2, node1.vote_bundler.signature_count);
+	ASSERT_EQ (hashes.size (), node1.vote_bundler.hash_count);
+}
+
+TEST (recent_blocks, duplicate)
+{
+	rai::recent_blocks recent;
+	rai::block_hash hash1 (rai::keypair ().pub);
+	rai::block_hash hash2 (rai::keypair ().pub);
+	ASSERT_FALSE (recent.check (hash1, 1));
+	recent.insert (hash1, 1);
+	ASSERT_TRUE (recent.check (hash1, 1));
+	ASSERT_FALSE (recent.check (hash1, 2));
+	ASSERT_FALSE (recent.check (hash2, 1));
+	ASSERT_EQ (1, recent.duplicate_count);
+	// Erasing a different copy leaves the entry
+	recent.erase (hash1, 2);
+	ASSERT_TRUE (recent.check (hash1, 1));
+	recent.erase (hash1, 1);
+	ASSERT_FALSE (recent.check (hash1, 1));
+}
+
+TEST (block_processor, duplicate_publish)
+{
+	rai::system system (24000, 2);
+	auto & node1 (*system.nodes [0]);
+	rai::genesis genesis;
+	rai::keypair key1;
+	rai::send_block send1 (genesis.hash (), key1.pub, rai::genesis_amount - 100, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (genesis.hash ()));
+	rai::publish publish (send1.clone ());
+	system.nodes [1]->network.send_buffer (publish.to_bytes (), node1.network.endpoint (), 0, rai::send_priority::publish);
+	system.nodes [1]->network.send_buffer (publish.to_bytes (), node1.network.endpoint (), 0, rai::send_priority::publish);
+	auto iterations (0);
+	while (node1.network.publish_count < 2)
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 200);
+	}
+	node1.block_processor.flush ();
+	ASSERT_LE (1, node1.recent_blocks.duplicate_count);
+	ASSERT_EQ (1, node1.block_processor.processed_count);
+	ASSERT_EQ (send1.hash (), node1.latest (rai::test_genesis_key.pub));
+}
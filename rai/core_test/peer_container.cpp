@@ -49,6 +49,7 @@ TEST (peer_container, old_known)
     rai::peer_container peers (self);
     ASSERT_FALSE (peers.insert (other));
     peers.peers.modify (peers.peers.begin (), [] (rai::peer_information & info) {info.last_contact = std::chrono::system_clock::time_point {};});
+    peers.refresh ();
     ASSERT_FALSE (peers.known_peer (other));
     ASSERT_TRUE (peers.insert (other));
     ASSERT_TRUE (peers.known_peer (other));
@@ -105,6 +106,8 @@ TEST (peer_container, fill_random_full)
     std::fill (target.begin (), target.end (), rai::endpoint (boost::asio::ip::address_v6::loopback (), 10000));
     peers.random_fill (target);
     ASSERT_TRUE (std::none_of (target.begin (), target.end (), [] (rai::endpoint const & endpoint_a) {return endpoint_a == rai::endpoint (boost::asio::ip::address_v6::loopback (), 10000); }));
+    std::set <rai::endpoint> distinct (target.begin (), target.end ());
+    ASSERT_EQ (target.size (), distinct.size ());
 }
 
 TEST (peer_container, fill_random_part)
@@ -134,4 +137,144 @@ TEST (peer_container, bootstrap_limit)
 	peers.bootstrap_failed (one);
 	auto list1 (peers.bootstrap_candidates ());
 	ASSERT_EQ (0, list1.size ());
-}
\ No newline at end of file
+}
+TEST (peer_container, sent_known)
+{
+    rai::peer_container peers (rai::endpoint {});
+	rai::endpoint one (boost::asio::ip::address_v6::loopback (), 2048);
+	rai::endpoint two (boost::asio::ip::address_v6::loopback (), 2049);
+	peers.insert (one);
+	peers.insert (two);
+	rai::block_hash hash1 (rai::keypair ().pub);
+	rai::block_hash hash2 (rai::keypair ().pub);
+	peers.insert (one, hash1);
+	peers.insert (one, hash2);
+	ASSERT_TRUE (peers.knows_about (one, hash1));
+	ASSERT_TRUE (peers.knows_about (one, hash2));
+	ASSERT_FALSE (peers.knows_about (two, hash1));
+	peers.sent (two, hash1);
+	ASSERT_TRUE (peers.knows_about (two, hash1));
+	ASSERT_EQ (3, peers.known_suppressed_count);
+	ASSERT_EQ (1, peers.known_sent_count);
+	rai::endpoint three (boost::asio::ip::address_v6::loopback (), 2050);
+	ASSERT_FALSE (peers.knows_about (three, hash1));
+	ASSERT_EQ (1, peers.known_sent_count);
+	ASSERT_GT (peers.known_false_positive_rate (), 0.0);
+}
+
+TEST (rolling_bloom, age_out)
+{
+	rai::rolling_bloom filter;
+	ASSERT_EQ (0.0, filter.false_positive_rate ());
+	std::vector <rai::block_hash> hashes;
+	for (uint64_t i (0); i < rai::rolling_bloom::capacity * 2 + 1; ++i)
+	{
+		rai::block_hash hash;
+		// Spread deterministic values over every word
+		for (uint64_t j (0); j < hash.qwords.size (); ++j)
+		{
+			hash.qwords [j] = (i * 4 + j + 1) * 0x9e3779b97f4a7c15ull;
+			hash.qwords [j] ^= hash.qwords [j] >> 29;
+		}
+		filter.insert (hash);
+		hashes.push_back (hash);
+	}
+	// The first generation was dropped, the most recent capacity hashes are always present
+	ASSERT_FALSE (filter.contains (hashes [0]));
+	for (auto i (hashes.end () - rai::rolling_bloom::capacity), n (hashes.end ()); i != n; ++i)
+	{
+		ASSERT_TRUE (filter.contains (*i));
+	}
+	ASSERT_GT (filter.false_positive_rate (), 0.0);
+	ASSERT_LT (filter.false_positive_rate (), 0.01);
+}
+
+TEST (peer_container, fanout)
+{
+	rai::peer_container peers (rai::endpoint {});
+	for (auto i (0); i < 10; ++i)
+	{
+		peers.insert (rai::endpoint (boost::asio::ip::address_v6::loopback (), 10000 + i));
+	}
+	auto all (peers.fanout (std::numeric_limits <size_t>::max ()));
+	ASSERT_EQ (10, all.size ());
+	ASSERT_EQ (10, std::unordered_set <rai::endpoint> (all.begin (), all.end ()).size ());
+	// Successive calls walk the permutation instead of picking the same peers
+	auto first (peers.fanout (5));
+	auto second (peers.fanout (5));
+	ASSERT_EQ (5, first.size ());
+	std::unordered_set <rai::endpoint> both (first.begin (), first.end ());
+	both.insert (second.begin (), second.end ());
+	ASSERT_EQ (10, both.size ());
+}
+
+TEST (peer_container, endpoint_key)
+{
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 10000);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 10001);
+	rai::endpoint_key key1 (endpoint1);
+	ASSERT_EQ (18, sizeof (key1.bytes));
+	ASSERT_EQ (endpoint1, key1.endpoint ());
+	ASSERT_EQ (key1, rai::endpoint_key (endpoint1));
+	ASSERT_NE (key1, rai::endpoint_key (endpoint2));
+	ASSERT_EQ (key1.hash (), rai::endpoint_key (endpoint1).hash ());
+	ASSERT_NE (key1.hash (), rai::endpoint_key (endpoint2).hash ());
+	// Unset IPv4 endpoints are keyed by their v4-mapped address
+	rai::endpoint endpoint3;
+	ASSERT_EQ (rai::endpoint (boost::asio::ip::address_v6::v4_mapped (endpoint3.address ().to_v4 ()), 0), rai::endpoint_key (endpoint3).endpoint ());
+	rai::peer_container peers (rai::endpoint {});
+	peers.insert (endpoint1);
+	ASSERT_NE (peers.peers.end (), peers.peers.find (key1));
+	ASSERT_EQ (peers.peers.end (), peers.peers.find (rai::endpoint_key (endpoint2)));
+}
+
+TEST (peer_container, probe)
+{
+	rai::peer_container peers (rai::endpoint {});
+	rai::endpoint endpoint1 (boost::asio::ip::address_v6::loopback (), 10000);
+	rai::endpoint endpoint2 (boost::asio::ip::address_v6::loopback (), 10001);
+	ASSERT_EQ (0, peers.probe (endpoint1));
+	peers.insert (endpoint1);
+	peers.insert (endpoint2);
+	auto nonce1 (peers.probe (endpoint1));
+	ASSERT_NE (0, nonce1);
+	// Probes are batched into the next publish
+	ASSERT_EQ (0, peers.snapshot ()->peers.find (rai::endpoint_key (endpoint1))->second.probe_nonce);
+	peers.publish_dirty ();
+	ASSERT_EQ (nonce1, peers.snapshot ()->peers.find (rai::endpoint_key (endpoint1))->second.probe_nonce);
+	// Probing again before the timeout keeps the outstanding nonce
+	ASSERT_EQ (nonce1, peers.probe (endpoint1));
+	ASSERT_TRUE (peers.probe_reply (endpoint1, nonce1 + 1));
+	ASSERT_TRUE (peers.probe_reply (endpoint2, nonce1));
+	ASSERT_TRUE (peers.preferred (2).empty ());
+	ASSERT_FALSE (peers.probe_reply (endpoint1, nonce1));
+	ASSERT_TRUE (peers.probe_reply (endpoint1, nonce1));
+	auto list (peers.bootstrap_candidates ());
+	ASSERT_EQ (2, list.size ());
+	ASSERT_EQ (endpoint1, list [0].endpoint);
+	ASSERT_GE (list [0].rtt, 0.0);
+	ASSERT_EQ (0.0, list [0].loss);
+	ASSERT_LT (list [1].rtt, 0.0);
+	ASSERT_EQ (std::numeric_limits <double>::infinity (), rai::peer_container::score (list [1]));
+	auto preferred (peers.preferred (2));
+	ASSERT_EQ (1, preferred.size ());
+	ASSERT_EQ (endpoint1, preferred [0]);
+	// A probe left unanswered past the timeout is counted as lost when the next one goes out
+	auto nonce2 (peers.probe (endpoint2));
+	ASSERT_NE (0, nonce2);
+	{
+		std::lock_guard <std::mutex> lock (peers.mutex);
+		peers.peers.modify (peers.peers.find (rai::endpoint_key (endpoint2)), [] (rai::peer_information & info_a)
+		{
+			info_a.probe_sent -= rai::peer_container::probe_timeout;
+		});
+	}
+	auto nonce3 (peers.probe (endpoint2));
+	ASSERT_NE (nonce2, nonce3);
+	ASSERT_FALSE (peers.probe_reply (endpoint2, nonce3));
+	list = peers.bootstrap_candidates ();
+	auto peer2 (std::find_if (list.begin (), list.end (), [&endpoint2] (rai::peer_information const & info_a) { return info_a.endpoint == endpoint2; }));
+	ASSERT_NE (list.end (), peer2);
+	ASSERT_GE (peer2->rtt, 0.0);
+	ASSERT_DOUBLE_EQ (rai::peer_container::probe_weight * (1.0 - rai::peer_container::probe_weight), peer2->loss);
+}
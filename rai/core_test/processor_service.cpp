@@ -130,3 +130,94 @@ TEST (alarm, top_execution)
 	service.stop ();
 	thread.join ();
 }
+
+TEST (alarm, cancel)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	std::atomic <bool> cancelled_ran (false);
+	std::promise <bool> promise;
+	auto operation (alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (5), [&] ()
+	{
+		cancelled_ran = true;
+	}));
+	alarm.cancel (operation);
+	alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (20), [&] ()
+	{
+		promise.set_value (false);
+	});
+	boost::asio::io_service::work work (service);
+	std::thread thread ([&service] ()
+	{
+		service.run ();
+	});
+	promise.get_future ().get ();
+	ASSERT_FALSE (cancelled_ran);
+	service.stop ();
+	thread.join ();
+}
+
+TEST (alarm, rounds)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	// Further out than one revolution of the wheel
+	auto delay (rai::alarm::tick * rai::alarm::slots * 2 + rai::alarm::tick * rai::alarm::slots / 2);
+	auto operation (alarm.add (std::chrono::system_clock::now () + delay, [] () {}));
+	{
+		std::lock_guard <std::mutex> lock (alarm.mutex);
+		ASSERT_EQ (2, operation->rounds);
+		ASSERT_EQ (1, alarm.count);
+	}
+	alarm.cancel (operation);
+}
+
+TEST (alarm, next_due)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	auto operation1 (alarm.add (std::chrono::system_clock::now () + rai::alarm::tick * rai::alarm::slots * 2 + rai::alarm::tick * rai::alarm::slots / 2, [] () {}));
+	{
+		std::lock_guard <std::mutex> lock (alarm.mutex);
+		// Nothing is due this revolution
+		ASSERT_EQ (alarm.current + rai::alarm::slots, alarm.next_due ());
+	}
+	auto operation2 (alarm.add (std::chrono::system_clock::now () + rai::alarm::tick * rai::alarm::slots / 2, [] () {}));
+	{
+		std::lock_guard <std::mutex> lock (alarm.mutex);
+		auto next (alarm.next_due ());
+		ASSERT_LT (alarm.current, next);
+		ASSERT_GT (alarm.current + rai::alarm::slots, next);
+	}
+	alarm.cancel (operation1);
+	alarm.cancel (operation2);
+}
+
+TEST (alarm, release)
+{
+	boost::asio::io_service service;
+	rai::alarm alarm (service);
+	auto captured (std::make_shared <int> (0));
+	auto operation1 (alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (60), [captured] () {}));
+	ASSERT_EQ (2, captured.use_count ());
+	// Cancelling releases the captures without waiting for the sweep
+	alarm.cancel (operation1);
+	ASSERT_EQ (1, captured.use_count ());
+	std::promise <bool> promise;
+	auto operation2 (alarm.add (std::chrono::system_clock::now (), [captured, &promise] ()
+	{
+		promise.set_value (false);
+	}));
+	ASSERT_EQ (2, captured.use_count ());
+	boost::asio::io_service::work work (service);
+	std::thread thread ([&service] ()
+	{
+		service.run ();
+	});
+	promise.get_future ().get ();
+	service.stop ();
+	thread.join ();
+	// The operation no longer holds the function once it has fired
+	ASSERT_EQ (1, captured.use_count ());
+	ASSERT_FALSE (operation2->function);
+}
@@ -639,6 +639,28 @@ TEST (rpc, chain)
 	thread1.join();
 }
 
+TEST (rpc, confirmation_height)
+{
+    rai::system system (24000, 1);
+	rai::keypair key;
+    auto pool (boost::make_shared <boost::network::utils::thread_pool> ());
+    rai::rpc rpc (system.service, pool, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	std::thread thread1 ([&rpc] () {rpc.server.run();});
+    boost::property_tree::ptree request;
+    request.put ("action", "confirmation_height");
+	request.put ("account", rai::test_genesis_key.pub.to_account ());
+	auto response (test_response (request, rpc, system.service));
+    ASSERT_EQ (boost::network::http::server <rai::rpc>::response::ok, response.second);
+	ASSERT_EQ ("1", response.first.get <std::string> ("confirmation_height"));
+	ASSERT_EQ ("1", response.first.get <std::string> ("block_count"));
+	request.put ("account", key.pub.to_account ());
+	auto response1 (test_response (request, rpc, system.service));
+    ASSERT_EQ (boost::network::http::server <rai::rpc>::response::bad_request, response1.second);
+	rpc.stop();
+	thread1.join();
+}
+
 TEST (rpc, chain_limit)
 {
     rai::system system (24000, 1);
@@ -680,7 +702,7 @@ TEST (rpc, frontier)
 		{
 			rai::keypair key;
 			source [key.pub] = key.prv.data;
-			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0));
+			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0, 0, 0));
 		}
 	}
 	rai::keypair key;
@@ -720,7 +742,7 @@ TEST (rpc, frontier_limited)
 		{
 			rai::keypair key;
 			source [key.pub] = key.prv.data;
-			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0));
+			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0, 0, 0));
 		}
 	}
 	rai::keypair key;
@@ -750,7 +772,7 @@ TEST (rpc, frontier_startpoint)
 		{
 			rai::keypair key;
 			source [key.pub] = key.prv.data;
-			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0));
+			system.nodes [0]->store.account_put (transaction, key.pub, rai::account_info (key.prv.data, 0, 0, 0, 0, 0, 0));
 		}
 	}
 	rai::keypair key;
@@ -1133,6 +1155,25 @@ TEST (rpc, peers)
 	thread1.join();
 }
 
+TEST (rpc, network_stats)
+{
+    rai::system system (24000, 2);
+    auto pool (boost::make_shared <boost::network::utils::thread_pool> ());
+    rai::rpc rpc (system.service, pool, *system.nodes [0], rai::rpc_config (true));
+	rpc.start ();
+	std::thread thread1 ([&rpc] () {rpc.server.run();});
+    boost::property_tree::ptree request;
+    request.put ("action", "network_stats");
+	auto response (test_response (request, rpc, system.service));
+    ASSERT_EQ (boost::network::http::server <rai::rpc>::response::ok, response.second);
+    auto & receivers_node (response.first.get_child ("receivers"));
+	ASSERT_EQ (system.nodes [0]->network.receivers.size (), receivers_node.size ());
+	ASSERT_EQ ("24000", receivers_node.begin ()->second.get <std::string> ("port"));
+	ASSERT_TRUE (!!response.first.get_optional <std::string> ("send_queue"));
+	rpc.stop();
+	thread1.join();
+}
+
 TEST (rpc_config, serialization)
 {
 	rai::rpc_config config1;
@@ -159,6 +159,333 @@ std::unique_ptr <rai::block> rai::push_synchronization::retrieve (rai::transacti
     return store.block_get (transaction_a, hash_a);
 }
 
+rai::block_export::block_export (rai::block_store & store_a, std::ostream & stream_a) :
+store (store_a),
+stream (stream_a)
+{
+}
+
+size_t rai::block_export::export_all ()
+{
+	size_t result (0);
+	rai::transaction transaction (store.environment, nullptr, false);
+	for (auto i (store.latest_begin (transaction)), n (store.latest_end ()); i != n; ++i)
+	{
+		rai::account_info info (i->second);
+		auto hash (info.open_block);
+		while (!hash.is_zero ())
+		{
+			auto block (store.block_get (transaction, hash));
+			assert (block != nullptr);
+			write (*block);
+			++result;
+			hash = store.block_successor (transaction, hash);
+		}
+	}
+	stream.flush ();
+	return result;
+}
+
+void rai::block_export::write (rai::block const & block_a)
+{
+	std::vector <uint8_t> bytes;
+	{
+		rai::vectorstream stream_l (bytes);
+		rai::serialize_block (stream_l, block_a);
+	}
+	std::vector <uint8_t> prefix;
+	{
+		rai::vectorstream stream_l (prefix);
+		rai::write (stream_l, static_cast <uint32_t> (bytes.size ()));
+	}
+	stream.write (reinterpret_cast <char const *> (prefix.data ()), prefix.size ());
+	stream.write (reinterpret_cast <char const *> (bytes.data ()), bytes.size ());
+}
+
+namespace
+{
+class signature_visitor : public rai::block_visitor
+{
+public:
+	void send_block (rai::send_block const & block_a) override
+	{
+		signature = block_a.signature;
+	}
+	void receive_block (rai::receive_block const & block_a) override
+	{
+		signature = block_a.signature;
+	}
+	void open_block (rai::open_block const & block_a) override
+	{
+		signature = block_a.signature;
+	}
+	void change_block (rai::change_block const & block_a) override
+	{
+		signature = block_a.signature;
+	}
+	rai::signature signature;
+};
+}
+
+rai::block_import::block_import (rai::node & node_a, std::istream & stream_a) :
+node (node_a),
+stream (stream_a),
+reading (true),
+validating (std::max (1u, std::thread::hardware_concurrency ())),
+error (false),
+read_count (0),
+invalid_count (0),
+progress_count (0),
+old_count (0),
+rejected_count (0),
+unresolved_count (0)
+{
+}
+
+bool rai::block_import::run ()
+{
+	std::thread reader ([this] () { read (); });
+	std::vector <std::thread> validators;
+	for (auto i (0u), n (validating); i < n; ++i)
+	{
+		validators.push_back (std::thread ([this] () { validate (); }));
+	}
+	write ();
+	reader.join ();
+	for (auto & i: validators)
+	{
+		i.join ();
+	}
+	return error;
+}
+
+bool rai::block_import::read_record (std::istream & stream_a, std::unique_ptr <rai::block> & block_a, bool & error_a)
+{
+	auto result (false);
+	std::array <uint8_t, sizeof (uint32_t)> prefix;
+	stream_a.read (reinterpret_cast <char *> (prefix.data ()), prefix.size ());
+	if (stream_a.gcount () == prefix.size ())
+	{
+		uint32_t size;
+		rai::bufferstream prefix_stream (prefix.data (), prefix.size ());
+		error_a = rai::read (prefix_stream, size);
+		if (!error_a)
+		{
+			error_a = size > record_max;
+			if (!error_a)
+			{
+				std::vector <uint8_t> bytes (size);
+				stream_a.read (reinterpret_cast <char *> (bytes.data ()), bytes.size ());
+				error_a = stream_a.gcount () != size;
+				if (!error_a)
+				{
+					rai::bufferstream block_stream (bytes.data (), bytes.size ());
+					block_a = rai::deserialize_block (block_stream);
+					error_a = block_a == nullptr;
+				}
+			}
+		}
+	}
+	else
+	{
+		// A partial length prefix means the stream was truncated
+		error_a = stream_a.gcount () != 0;
+		result = true;
+	}
+	return result;
+}
+
+void rai::block_import::read ()
+{
+	// Exports write each chain contiguously so tracking the latest block per chain is enough to know who signed the next one
+	std::unordered_map <rai::block_hash, rai::account> chains;
+	auto done (false);
+	while (!done)
+	{
+		std::unique_ptr <rai::block> block;
+		auto error_l (false);
+		done = read_record (stream, block, error_l);
+		if (!done && !error_l)
+		{
+			auto hash (block->hash ());
+			rai::account account (0);
+			auto open (dynamic_cast <rai::open_block *> (block.get ()));
+			if (open != nullptr)
+			{
+				account = open->hashables.account;
+			}
+			else
+			{
+				auto existing (chains.find (block->previous ()));
+				if (existing != chains.end ())
+				{
+					account = existing->second;
+					chains.erase (existing);
+				}
+			}
+			if (!account.is_zero ())
+			{
+				chains [hash] = account;
+			}
+			std::unique_lock <std::mutex> lock (mutex);
+			while (unvalidated.size () >= queue_max)
+			{
+				condition.wait (lock);
+			}
+			unvalidated.push_back (std::make_pair (std::move (block), account));
+			++read_count;
+			condition.notify_all ();
+		}
+		else if (error_l)
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Malformed block record after %1% blocks") % read_count);
+			std::lock_guard <std::mutex> lock (mutex);
+			error = true;
+			done = true;
+		}
+	}
+	std::lock_guard <std::mutex> lock (mutex);
+	reading = false;
+	condition.notify_all ();
+}
+
+void rai::block_import::validate ()
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!unvalidated.empty () || reading)
+	{
+		if (!unvalidated.empty ())
+		{
+			auto entry (std::move (unvalidated.front ()));
+			unvalidated.pop_front ();
+			condition.notify_all ();
+			lock.unlock ();
+			auto & block (entry.first);
+			auto invalid (node.work.work_validate (*block));
+			if (!invalid && !entry.second.is_zero ())
+			{
+				// Blocks whose signer isn't known from the stream are checked by the ledger
+				signature_visitor signature;
+				block->visit (signature);
+				invalid = rai::validate_message (entry.second, block->hash (), signature.signature);
+			}
+			if (invalid)
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("Invalid work or signature in imported block %1%") % block->hash ().to_string ());
+			}
+			lock.lock ();
+			if (!invalid)
+			{
+				validated.push_back (std::move (block));
+				condition.notify_all ();
+			}
+			else
+			{
+				++invalid_count;
+			}
+		}
+		else
+		{
+			condition.wait (lock);
+		}
+	}
+	--validating;
+	condition.notify_all ();
+}
+
+void rai::block_import::write ()
+{
+	rai::pull_synchronization synchronization (node.log, [this] (rai::transaction & transaction_a, rai::block const & block_a)
+	{
+		node.process_receive_many (transaction_a, block_a, [this] (rai::process_return result_a, rai::block const & block_a)
+		{
+			switch (result_a.code)
+			{
+				case rai::process_result::progress:
+					++progress_count;
+					break;
+				case rai::process_result::old:
+					++old_count;
+					break;
+				default:
+					BOOST_LOG (node.log) << boost::str (boost::format ("Error inserting imported block: %1%") % block_a.hash ().to_string ());
+					++rejected_count;
+					break;
+			}
+		});
+		node.store.unchecked_del (transaction_a, block_a.hash ());
+	}, node.store);
+	std::vector <std::unique_ptr <rai::block>> batch;
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!validated.empty () || validating > 0)
+	{
+		if (validated.size () >= batch_size || (!validated.empty () && validating == 0))
+		{
+			while (!validated.empty () && batch.size () < batch_size)
+			{
+				batch.push_back (std::move (validated.front ()));
+				validated.pop_front ();
+			}
+			lock.unlock ();
+			flush (synchronization, batch);
+			lock.lock ();
+		}
+		else
+		{
+			condition.wait (lock);
+		}
+	}
+	lock.unlock ();
+	resolve (synchronization);
+}
+
+void rai::block_import::flush (rai::pull_synchronization & synchronization_a, std::vector <std::unique_ptr <rai::block>> & blocks_a)
+{
+	rai::transaction transaction (node.store.environment, nullptr, true);
+	for (auto & i: blocks_a)
+	{
+		node.store.unchecked_put (transaction, i->hash (), *i);
+	}
+	for (auto & i: blocks_a)
+	{
+		auto hash (i->hash ());
+		// Blocks may already have been committed as a dependency of an earlier one in this batch
+		if (node.store.unchecked_get (transaction, hash) != nullptr)
+		{
+			if (synchronization_a.synchronize (transaction, hash))
+			{
+				// Dependency hasn't been read yet, retry once the whole stream is in
+				while (!synchronization_a.blocks.empty ())
+				{
+					synchronization_a.blocks.pop ();
+				}
+				deferred.push_back (hash);
+			}
+		}
+	}
+	blocks_a.clear ();
+}
+
+void rai::block_import::resolve (rai::pull_synchronization & synchronization_a)
+{
+	rai::transaction transaction (node.store.environment, nullptr, true);
+	for (auto & i: deferred)
+	{
+		if (node.store.unchecked_get (transaction, i) != nullptr)
+		{
+			if (synchronization_a.synchronize (transaction, i))
+			{
+				while (!synchronization_a.blocks.empty ())
+				{
+					synchronization_a.blocks.pop ();
+				}
+				++unresolved_count;
+			}
+		}
+	}
+	deferred.clear ();
+}
+
 rai::bootstrap_client::bootstrap_client (std::shared_ptr <rai::node> node_a, std::shared_ptr <rai::bootstrap_attempt> attempt_a) :
 node (node_a),
 attempt (attempt_a),
@@ -857,11 +1184,11 @@ void rai::bootstrap_initiator::bootstrap_any ()
 {
 	auto peers (node.peers.bootstrap_candidates ());
 	std::vector <rai::endpoint> endpoints;
-	for (auto &i: peers)
+	// Attempts connect from the back, best candidates last
+	for (auto i (peers.rbegin ()), n (peers.rend ()); i != n; ++i)
 	{
-		endpoints.push_back (i.endpoint);
+		endpoints.push_back (i->endpoint);
 	}
-	std::random_shuffle (endpoints.begin (), endpoints.end ());
 	begin_attempt (std::make_shared <bootstrap_attempt> (node.shared (), endpoints));
 }
 
@@ -1017,6 +1344,18 @@ void rai::bootstrap_server::receive_header_action (boost::system::error_code con
                     add_request (std::unique_ptr <rai::message> (new rai::bulk_push));
                     break;
                 }
+				case rai::message_type::realtime:
+				{
+					if (node->config.realtime_tcp)
+					{
+						auto this_l (shared_from_this ());
+						boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data () + 8, sizeof (uint16_t)), [this_l] (boost::system::error_code const & ec, size_t size_a)
+						{
+							this_l->receive_realtime_action (ec, size_a);
+						});
+					}
+					break;
+				}
 				default:
 				{
 					if (node->config.logging.network_logging ())
@@ -1082,6 +1421,41 @@ void rai::bootstrap_server::receive_frontier_req_action (boost::system::error_co
     }
 }
 
+void rai::bootstrap_server::receive_realtime_action (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		rai::realtime request;
+		rai::bufferstream stream (receive_buffer.data (), 8 + sizeof (uint16_t));
+		auto error (request.deserialize (stream));
+		if (!error)
+		{
+			// The connection now belongs to the channel, this server stops reading requests
+			boost::system::error_code error_l;
+			auto remote (socket->remote_endpoint (error_l));
+			if (!error_l)
+			{
+				auto channel (std::make_shared <rai::realtime_channel> (node, socket, rai::endpoint (remote.address (), request.port)));
+				if (!node->network.realtime.add (channel))
+				{
+					channel->receive ();
+				}
+				else
+				{
+					channel->close ();
+				}
+			}
+		}
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error receiving realtime handshake %1%") % ec.message ());
+		}
+	}
+}
+
 void rai::bootstrap_server::add_request (std::unique_ptr <rai::message> message_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
@@ -1143,6 +1517,10 @@ public:
         auto response (std::make_shared <rai::frontier_req_server> (connection, std::unique_ptr <rai::frontier_req> (static_cast <rai::frontier_req *> (connection->requests.front ().release ()))));
         response->send_next ();
     }
+    void realtime (rai::realtime const &) override
+    {
+        assert (false);
+    }
     std::shared_ptr <rai::bootstrap_server> connection;
 };
 }
@@ -1194,6 +1572,26 @@ void rai::bulk_pull_server::set_current_end ()
 		{
 			current = info.head;
 		}
+		rai::block_hash boundary;
+		if (current != request->end && !connection->node->store.pruned_get (transaction, request->start, boundary))
+		{
+			// Only serve the range if it ends within the history we still hold
+			auto hash (current);
+			while (hash != request->end && hash != boundary)
+			{
+				auto block (connection->node->store.block_get (transaction, hash));
+				assert (block != nullptr);
+				hash = block->previous ();
+			}
+			if (hash != request->end)
+			{
+				if (connection->node->config.logging.bulk_pull_logging ())
+				{
+					BOOST_LOG (connection->node->log) << boost::str (boost::format ("Refusing bulk pull for pruned range of account: %1%") % request->start.to_account ());
+				}
+				current = request->end;
+			}
+		}
 	}
 }
 
@@ -1384,7 +1782,7 @@ void rai::bulk_push_server::received_block (boost::system::error_code const & ec
 rai::frontier_req_server::frontier_req_server (std::shared_ptr <rai::bootstrap_server> const & connection_a, std::unique_ptr <rai::frontier_req> request_a) :
 connection (connection_a),
 current (request_a->start.number () - 1),
-info (0, 0, 0, 0, 0),
+info (0, 0, 0, 0, 0, 0, 0),
 request (std::move (request_a))
 {
 	next ();
@@ -1494,3 +1892,329 @@ void rai::frontier_req_server::next ()
 		current.clear ();
 	}
 }
+
+size_t constexpr rai::realtime_channel::queue_max;
+std::chrono::minutes constexpr rai::realtime_channels::idle_timeout;
+
+rai::realtime_channel::realtime_channel (std::shared_ptr <rai::node> node_a, std::shared_ptr <boost::asio::ip::tcp::socket> socket_a, rai::endpoint const & endpoint_a) :
+node (node_a),
+socket (socket_a),
+endpoint (endpoint_a),
+last_activity (std::chrono::steady_clock::now ())
+{
+}
+
+void rai::realtime_channel::handshake ()
+{
+	rai::realtime message;
+	message.port = node->network.endpoint ().port ();
+	auto bytes (message.to_bytes ());
+	auto this_l (shared_from_this ());
+	boost::asio::async_write (*socket, boost::asio::buffer (bytes->data (), bytes->size ()), [this_l, bytes] (boost::system::error_code const & ec, size_t size_a)
+	{
+		if (!ec && !this_l->node->network.realtime.add (this_l))
+		{
+			this_l->receive ();
+		}
+		else
+		{
+			this_l->node->network.realtime.connect_failed (this_l->endpoint);
+			this_l->close ();
+		}
+	});
+}
+
+void rai::realtime_channel::receive ()
+{
+	auto this_l (shared_from_this ());
+	boost::asio::async_read (*socket, boost::asio::buffer (length_buffer.data (), length_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+	{
+		this_l->receive_length_action (ec, size_a);
+	});
+}
+
+void rai::realtime_channel::receive_length_action (boost::system::error_code const & ec, size_t size_a)
+{
+	size_t length ((length_buffer [0] << 8) | length_buffer [1]);
+	if (!ec && length != 0)
+	{
+		receive_buffer.resize (length);
+		auto this_l (shared_from_this ());
+		boost::asio::async_read (*socket, boost::asio::buffer (receive_buffer.data (), receive_buffer.size ()), [this_l] (boost::system::error_code const & ec, size_t size_a)
+		{
+			this_l->receive_message_action (ec, size_a);
+		});
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Realtime channel to %1% closed: %2%") % endpoint % (ec ? ec.message () : std::string ("empty frame")));
+		}
+		close ();
+	}
+}
+
+void rai::realtime_channel::receive_message_action (boost::system::error_code const & ec, size_t size_a)
+{
+	if (!ec)
+	{
+		auto & realtime (node->network.realtime);
+		++realtime.received_count;
+		realtime.received_bytes += size_a + length_buffer.size ();
+		{
+			std::lock_guard <std::mutex> lock (mutex);
+			last_activity = std::chrono::steady_clock::now ();
+		}
+		node->network.process (receive_buffer.data (), size_a, endpoint);
+		receive ();
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error receiving from realtime channel to %1%: %2%") % endpoint % ec.message ());
+		}
+		close ();
+	}
+}
+
+bool rai::realtime_channel::send (std::shared_ptr <std::vector <uint8_t> const> const & buffer_a, std::function <void (boost::system::error_code const &, size_t)> const & callback_a)
+{
+	assert (buffer_a->size () <= std::numeric_limits <uint16_t>::max ());
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (queue.size () >= queue_max);
+	if (!result)
+	{
+		auto start (queue.empty ());
+		queue.push_back ({buffer_a, callback_a, std::chrono::steady_clock::now (), {static_cast <uint8_t> (buffer_a->size () >> 8), static_cast <uint8_t> (buffer_a->size ())}});
+		if (start)
+		{
+			write_next ();
+		}
+	}
+	return result;
+}
+
+void rai::realtime_channel::write_next ()
+{
+	assert (!queue.empty ());
+	auto & front (queue.front ());
+	std::array <boost::asio::const_buffer, 2> buffers {{boost::asio::buffer (front.length), boost::asio::buffer (*front.buffer)}};
+	auto this_l (shared_from_this ());
+	boost::asio::async_write (*socket, buffers, [this_l] (boost::system::error_code const & ec, size_t size_a)
+	{
+		this_l->write_action (ec, size_a);
+	});
+}
+
+void rai::realtime_channel::write_action (boost::system::error_code const & ec, size_t size_a)
+{
+	std::deque <rai::realtime_write> writes;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		assert (!queue.empty ());
+		if (!ec)
+		{
+			last_activity = std::chrono::steady_clock::now ();
+			writes.push_back (std::move (queue.front ()));
+			queue.pop_front ();
+			if (!queue.empty ())
+			{
+				write_next ();
+			}
+		}
+		else
+		{
+			// Nothing queued behind a failed write will go out, every sender is told
+			writes.swap (queue);
+		}
+	}
+	auto & realtime (node->network.realtime);
+	if (!ec)
+	{
+		++realtime.sent_count;
+		realtime.sent_bytes += size_a;
+		uint64_t latency (std::chrono::duration_cast <std::chrono::microseconds> (std::chrono::steady_clock::now () - writes.front ().queued).count ());
+		// Exponential moving average weighted 1/8 towards the newest sample, racing updates only lose a sample
+		auto average (realtime.latency_microseconds.load ());
+		realtime.latency_microseconds = average - average / 8 + latency / 8;
+	}
+	else
+	{
+		if (node->config.logging.network_logging ())
+		{
+			BOOST_LOG (node->log) << boost::str (boost::format ("Error sending on realtime channel to %1%: %2%") % endpoint % ec.message ());
+		}
+		close ();
+	}
+	for (auto i (writes.begin ()), n (writes.end ()); i != n; ++i)
+	{
+		if (i->callback)
+		{
+			i->callback (ec, i == writes.begin () ? size_a : 0);
+		}
+	}
+}
+
+void rai::realtime_channel::close ()
+{
+	node->network.realtime.remove (*this);
+	boost::system::error_code ignored;
+	socket->close (ignored);
+}
+
+rai::realtime_channels::realtime_channels (rai::node & node_a) :
+node (node_a),
+on (true),
+sent_count (0),
+sent_bytes (0),
+received_count (0),
+received_bytes (0),
+latency_microseconds (0)
+{
+}
+
+std::shared_ptr <rai::realtime_channel> rai::realtime_channels::find (rai::endpoint const & endpoint_a)
+{
+	std::shared_ptr <rai::realtime_channel> result;
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (channels.find (endpoint_a));
+	if (existing != channels.end ())
+	{
+		result = existing->second;
+	}
+	return result;
+}
+
+bool rai::realtime_channels::add (std::shared_ptr <rai::realtime_channel> const & channel_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	connecting.erase (channel_a->endpoint);
+	auto result (!on);
+	if (!result)
+	{
+		receive_only.erase (std::remove_if (receive_only.begin (), receive_only.end (), [] (std::weak_ptr <rai::realtime_channel> const & channel_a) { return channel_a.expired (); }), receive_only.end ());
+		// Channels peers open to us count against the same limit as the ones we open
+		if (channels.size () + receive_only.size () >= node.config.realtime_channels_max)
+		{
+			result = true;
+		}
+		else if (!channels.insert (std::make_pair (channel_a->endpoint, channel_a)).second)
+		{
+			// Both sides connected at once, the first channel carries sends and this one only receives
+			receive_only.push_back (channel_a);
+		}
+	}
+	return result;
+}
+
+void rai::realtime_channels::remove (rai::realtime_channel const & channel_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (channels.find (channel_a.endpoint));
+	if (existing != channels.end () && existing->second.get () == &channel_a)
+	{
+		channels.erase (existing);
+	}
+}
+
+void rai::realtime_channels::connect (rai::endpoint const & endpoint_a)
+{
+	std::unique_lock <std::mutex> lock (mutex);
+	if (on && channels.find (endpoint_a) == channels.end () && connecting.find (endpoint_a) == connecting.end () && channels.size () + connecting.size () < node.config.realtime_channels_max)
+	{
+		connecting.insert (endpoint_a);
+		lock.unlock ();
+		auto node_l (node.shared ());
+		auto socket (std::make_shared <boost::asio::ip::tcp::socket> (node.network.service));
+		socket->async_connect (rai::tcp_endpoint (endpoint_a.address (), endpoint_a.port ()), [node_l, socket, endpoint_a] (boost::system::error_code const & ec)
+		{
+			if (!ec)
+			{
+				auto channel (std::make_shared <rai::realtime_channel> (node_l, socket, endpoint_a));
+				channel->handshake ();
+			}
+			else
+			{
+				if (node_l->config.logging.network_logging ())
+				{
+					BOOST_LOG (node_l->log) << boost::str (boost::format ("Error connecting realtime channel to %1%: %2%") % endpoint_a % ec.message ());
+				}
+				node_l->network.realtime.connect_failed (endpoint_a);
+			}
+		});
+	}
+}
+
+void rai::realtime_channels::connect_failed (rai::endpoint const & endpoint_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	connecting.erase (endpoint_a);
+}
+
+void rai::realtime_channels::close_idle (std::chrono::steady_clock::time_point const & cutoff_a)
+{
+	std::vector <std::shared_ptr <rai::realtime_channel>> channels_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto & i: channels)
+		{
+			channels_l.push_back (i.second);
+		}
+		for (auto & i: receive_only)
+		{
+			auto channel (i.lock ());
+			if (channel != nullptr)
+			{
+				channels_l.push_back (channel);
+			}
+		}
+	}
+	for (auto & i: channels_l)
+	{
+		auto idle (false);
+		{
+			std::lock_guard <std::mutex> lock (i->mutex);
+			idle = i->last_activity < cutoff_a;
+		}
+		if (idle)
+		{
+			if (node.config.logging.network_logging ())
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("Closing idle realtime channel to %1%") % i->endpoint);
+			}
+			i->close ();
+		}
+	}
+}
+
+void rai::realtime_channels::stop ()
+{
+	std::unordered_map <rai::endpoint, std::shared_ptr <rai::realtime_channel>> channels_l;
+	std::vector <std::weak_ptr <rai::realtime_channel>> receive_only_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		on = false;
+		channels_l.swap (channels);
+		receive_only_l.swap (receive_only);
+	}
+	for (auto & i: channels_l)
+	{
+		i.second->close ();
+	}
+	for (auto & i: receive_only_l)
+	{
+		auto channel (i.lock ());
+		if (channel != nullptr)
+		{
+			channel->close ();
+		}
+	}
+}
+
+size_t rai::realtime_channels::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return channels.size ();
+}
@@ -4,7 +4,10 @@
 #include <rai/node/common.hpp>
 
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <queue>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <boost/log/sources/logger.hpp>
@@ -45,6 +48,50 @@ public:
     std::unique_ptr <rai::block> retrieve (rai::transaction &, rai::block_hash const &) override;
 };
 class node;
+// Writes account chains, open block first, as a stream of length prefixed serialize_block records
+class block_export
+{
+public:
+    block_export (rai::block_store &, std::ostream &);
+    size_t export_all ();
+    void write (rai::block const &);
+    rai::block_store & store;
+    std::ostream & stream;
+};
+// Imports a block_export stream, checking work and signatures in parallel and writing to the ledger in batches through the unchecked table
+class block_import
+{
+public:
+    block_import (rai::node &, std::istream &);
+    // Return true if the stream was malformed
+    bool run ();
+    void read ();
+    void validate ();
+    void write ();
+    void flush (rai::pull_synchronization &, std::vector <std::unique_ptr <rai::block>> &);
+    void resolve (rai::pull_synchronization &);
+    // Return true if there are no more records
+    static bool read_record (std::istream &, std::unique_ptr <rai::block> &, bool &);
+    rai::node & node;
+    std::istream & stream;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque <std::pair <std::unique_ptr <rai::block>, rai::account>> unvalidated;
+    std::deque <std::unique_ptr <rai::block>> validated;
+    std::vector <rai::block_hash> deferred;
+    bool reading;
+    unsigned validating;
+    bool error;
+    size_t read_count;
+    size_t invalid_count;
+    size_t progress_count;
+    size_t old_count;
+    size_t rejected_count;
+    size_t unresolved_count;
+    static size_t constexpr batch_size = 4096;
+    static size_t constexpr queue_max = 65536;
+    static uint32_t constexpr record_max = 1024;
+};
 class bootstrap_client;
 class bootstrap_attempt : public std::enable_shared_from_this <bootstrap_attempt>
 {
@@ -165,6 +212,7 @@ public:
     void receive_bulk_pull_action (boost::system::error_code const &, size_t);
     void receive_frontier_req_action (boost::system::error_code const &, size_t);
     void receive_bulk_push_action ();
+    void receive_realtime_action (boost::system::error_code const &, size_t);
     void add_request (std::unique_ptr <rai::message>);
     void finish_request ();
     void run_next ();
@@ -219,4 +267,72 @@ public:
     std::vector <uint8_t> send_buffer;
     size_t count;
 };
+class realtime_write
+{
+public:
+	std::shared_ptr <std::vector <uint8_t> const> buffer;
+	std::function <void (boost::system::error_code const &, size_t)> callback;
+	std::chrono::steady_clock::time_point queued;
+	// Big endian length prefix, kept here so it outlives the asynchronous write
+	std::array <uint8_t, 2> length;
+};
+// Realtime messages framed with a 2 byte length prefix over a persistent TCP connection to a peer's bootstrap port
+class realtime_channel : public std::enable_shared_from_this <rai::realtime_channel>
+{
+public:
+	realtime_channel (std::shared_ptr <rai::node>, std::shared_ptr <boost::asio::ip::tcp::socket>, rai::endpoint const &);
+	// Send the realtime handshake then start receiving
+	void handshake ();
+	void receive ();
+	void receive_length_action (boost::system::error_code const &, size_t);
+	void receive_message_action (boost::system::error_code const &, size_t);
+	// Returns true if the queue is full and the message should go over UDP instead
+	bool send (std::shared_ptr <std::vector <uint8_t> const> const &, std::function <void (boost::system::error_code const &, size_t)> const &);
+	// Write the front of the queue, requires mutex
+	void write_next ();
+	void write_action (boost::system::error_code const &, size_t);
+	void close ();
+	std::shared_ptr <rai::node> node;
+	std::shared_ptr <boost::asio::ip::tcp::socket> socket;
+	// UDP endpoint of the peer
+	rai::endpoint endpoint;
+	std::mutex mutex;
+	std::deque <rai::realtime_write> queue;
+	// Last completed read or write, requires mutex
+	std::chrono::steady_clock::time_point last_activity;
+	std::array <uint8_t, 2> length_buffer;
+	std::vector <uint8_t> receive_buffer;
+	static size_t constexpr queue_max = 4096;
+};
+// Open realtime channels by peer endpoint, sends prefer a channel when one exists
+class realtime_channels
+{
+public:
+	realtime_channels (rai::node &);
+	std::shared_ptr <rai::realtime_channel> find (rai::endpoint const &);
+	// Returns true if channels are stopped or at realtime_channels_max and the new channel should be closed
+	bool add (std::shared_ptr <rai::realtime_channel> const &);
+	void remove (rai::realtime_channel const &);
+	// Connect to the peer's bootstrap port unless a channel exists, one is pending or the limit is reached
+	void connect (rai::endpoint const &);
+	void connect_failed (rai::endpoint const &);
+	// Close channels with no reads or writes since the cutoff
+	void close_idle (std::chrono::steady_clock::time_point const &);
+	void stop ();
+	size_t size ();
+	rai::node & node;
+	std::mutex mutex;
+	std::unordered_map <rai::endpoint, std::shared_ptr <rai::realtime_channel>> channels;
+	// Second channels to a peer that already has one, closed on stop
+	std::vector <std::weak_ptr <rai::realtime_channel>> receive_only;
+	std::unordered_set <rai::endpoint> connecting;
+	bool on;
+	std::atomic <uint64_t> sent_count;
+	std::atomic <uint64_t> sent_bytes;
+	std::atomic <uint64_t> received_count;
+	std::atomic <uint64_t> received_bytes;
+	// Moving average of the time from queueing a message to the kernel accepting it
+	std::atomic <uint64_t> latency_microseconds;
+	static std::chrono::minutes constexpr idle_timeout = std::chrono::minutes (5);
+};
 }
\ No newline at end of file
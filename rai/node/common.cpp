@@ -5,7 +5,10 @@
 std::array <uint8_t, 2> constexpr rai::message::magic_number;
 size_t constexpr rai::message::ipv4_only_position;
 size_t constexpr rai::message::bootstrap_server_position;
+size_t constexpr rai::keepalive::probe_position;
+size_t constexpr rai::keepalive::echo_position;
 std::bitset <16> constexpr rai::message::block_type_mask;
+size_t constexpr rai::confirm_req::roots_hashes_max;
 
 rai::message::message (rai::message_type type_a) :
 version_max (0x01),
@@ -51,6 +54,18 @@ void rai::message::write_header (rai::stream & stream_a)
     rai::write (stream_a, static_cast <uint16_t> (extensions.to_ullong ()));
 }
 
+std::shared_ptr <std::vector <uint8_t> const> rai::message::to_bytes ()
+{
+	auto result (std::make_shared <std::vector <uint8_t>> ());
+	// Every message fits in a datagram buffer so the vector is allocated once
+	result->reserve (512);
+	{
+		rai::vectorstream stream (*result);
+		serialize (stream);
+	}
+	return result;
+}
+
 bool rai::message::read_header (rai::stream & stream_a, uint8_t & version_max_a, uint8_t & version_using_a, uint8_t & version_min_a, rai::message_type & type_a, std::bitset <16> & extensions_a)
 {
     std::array <uint8_t, 2> magic_number_l;
@@ -185,7 +200,7 @@ void rai::message_parser::deserialize_confirm_req (uint8_t const * buffer_a, siz
     auto error_l (incoming.deserialize (stream));
     if (!error_l && at_end (stream))
     {
-        if (!pool.work_validate (*incoming.block))
+        if (incoming.block == nullptr || !pool.work_validate (*incoming.block))
         {
             visitor.confirm_req (incoming);
         }
@@ -207,7 +222,7 @@ void rai::message_parser::deserialize_confirm_ack (uint8_t const * buffer_a, siz
     rai::confirm_ack incoming (error_l, stream);
     if (!error_l && at_end (stream))
     {
-        if (!pool.work_validate (*incoming.vote.block))
+        if (incoming.vote.block == nullptr || !pool.work_validate (*incoming.vote.block))
         {
             visitor.confirm_ack (incoming);
         }
@@ -230,7 +245,8 @@ bool rai::message_parser::at_end (rai::bufferstream & stream_a)
 }
 
 rai::keepalive::keepalive () :
-message (rai::message_type::keepalive)
+message (rai::message_type::keepalive),
+nonce (0)
 {
     boost::asio::ip::udp::endpoint endpoint (boost::asio::ip::address_v6 {}, 0);
     for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i)
@@ -254,6 +270,10 @@ void rai::keepalive::serialize (rai::stream & stream_a)
         write (stream_a, bytes);
         write (stream_a, i->port ());
     }
+	if (probe () || echo ())
+	{
+		write (stream_a, nonce);
+	}
 }
 
 bool rai::keepalive::deserialize (rai::stream & stream_a)
@@ -269,12 +289,38 @@ bool rai::keepalive::deserialize (rai::stream & stream_a)
         read (stream_a, port);
         *i = rai::endpoint (boost::asio::ip::address_v6 (address), port);
     }
+	if (probe () || echo ())
+	{
+		result = read (stream_a, nonce);
+	}
     return result;
 }
 
 bool rai::keepalive::operator == (rai::keepalive const & other_a) const
 {
-	return peers == other_a.peers;
+	return peers == other_a.peers && extensions == other_a.extensions && nonce == other_a.nonce;
+}
+
+void rai::keepalive::probe_set (uint64_t nonce_a)
+{
+	extensions.set (probe_position);
+	nonce = nonce_a;
+}
+
+void rai::keepalive::echo_set (uint64_t nonce_a)
+{
+	extensions.set (echo_position);
+	nonce = nonce_a;
+}
+
+bool rai::keepalive::probe () const
+{
+	return extensions.test (probe_position);
+}
+
+bool rai::keepalive::echo () const
+{
+	return extensions.test (echo_position);
 }
 
 rai::publish::publish () :
@@ -331,6 +377,14 @@ block (std::move (block_a))
     block_type_set (block->type ());
 }
 
+rai::confirm_req::confirm_req (std::vector <std::pair <rai::block_hash, rai::block_hash>> const & roots_hashes_a) :
+message (rai::message_type::confirm_req),
+roots_hashes (roots_hashes_a)
+{
+    assert (!roots_hashes.empty () && roots_hashes.size () <= roots_hashes_max);
+    block_type_set (rai::block_type::not_a_block);
+}
+
 bool rai::confirm_req::deserialize (rai::stream & stream_a)
 {
 	auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
@@ -338,8 +392,24 @@ bool rai::confirm_req::deserialize (rai::stream & stream_a)
     assert (type == rai::message_type::confirm_req);
     if (!result)
 	{
-        block = rai::deserialize_block (stream_a, block_type ());
-        result = block == nullptr;
+        if (block_type () == rai::block_type::not_a_block)
+        {
+            uint8_t count;
+            result = read (stream_a, count) || count == 0 || count > roots_hashes_max;
+            roots_hashes.clear ();
+            for (size_t i (0); !result && i < count; ++i)
+            {
+                rai::block_hash root;
+                rai::block_hash hash;
+                result = read (stream_a, root) || read (stream_a, hash);
+                roots_hashes.push_back (std::make_pair (root, hash));
+            }
+        }
+        else
+        {
+            block = rai::deserialize_block (stream_a, block_type ());
+            result = block == nullptr;
+        }
     }
     return result;
 }
@@ -351,14 +421,25 @@ void rai::confirm_req::visit (rai::message_visitor & visitor_a) const
 
 void rai::confirm_req::serialize (rai::stream & stream_a)
 {
-    assert (block != nullptr);
 	write_header (stream_a);
-    block->serialize (stream_a);
+    if (block != nullptr)
+    {
+        block->serialize (stream_a);
+    }
+    else
+    {
+        write (stream_a, static_cast <uint8_t> (roots_hashes.size ()));
+        for (auto & i: roots_hashes)
+        {
+            write (stream_a, i.first);
+            write (stream_a, i.second);
+        }
+    }
 }
 
 bool rai::confirm_req::operator == (rai::confirm_req const & other_a) const
 {
-    return *block == *other_a.block;
+    return block != nullptr && other_a.block != nullptr ? *block == *other_a.block : block == other_a.block && roots_hashes == other_a.roots_hashes;
 }
 
 rai::confirm_ack::confirm_ack (bool & error_a, rai::stream & stream_a) :
@@ -374,6 +455,13 @@ vote (account_a, prv_a, sequence_a, std::move (block_a))
     block_type_set (vote.block->type ());
 }
 
+rai::confirm_ack::confirm_ack (rai::account const & account_a, rai::raw_key const & prv_a, uint64_t sequence_a, std::vector <rai::block_hash> const & hashes_a) :
+message (rai::message_type::confirm_ack),
+vote (account_a, prv_a, sequence_a, hashes_a)
+{
+    block_type_set (rai::block_type::not_a_block);
+}
+
 bool rai::confirm_ack::deserialize (rai::stream & stream_a)
 {
 	auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
@@ -390,8 +478,23 @@ bool rai::confirm_ack::deserialize (rai::stream & stream_a)
                 result = read (stream_a, vote.sequence);
                 if (!result)
                 {
-                    vote.block = rai::deserialize_block (stream_a, block_type ());
-                    result = vote.block == nullptr;
+                    if (block_type () == rai::block_type::not_a_block)
+                    {
+                        uint8_t count;
+                        result = read (stream_a, count) || count == 0 || count > rai::vote::hashes_max;
+                        vote.hashes.clear ();
+                        for (size_t i (0); !result && i < count; ++i)
+                        {
+                            rai::block_hash hash;
+                            result = read (stream_a, hash);
+                            vote.hashes.push_back (hash);
+                        }
+                    }
+                    else
+                    {
+                        vote.block = rai::deserialize_block (stream_a, block_type ());
+                        result = vote.block == nullptr;
+                    }
                 }
             }
         }
@@ -401,17 +504,29 @@ bool rai::confirm_ack::deserialize (rai::stream & stream_a)
 
 void rai::confirm_ack::serialize (rai::stream & stream_a)
 {
-    assert (block_type () == rai::block_type::send || block_type () == rai::block_type::receive || block_type () == rai::block_type::open || block_type () == rai::block_type::change);
+    assert (block_type () == rai::block_type::send || block_type () == rai::block_type::receive || block_type () == rai::block_type::open || block_type () == rai::block_type::change || block_type () == rai::block_type::not_a_block);
 	write_header (stream_a);
     write (stream_a, vote.account);
     write (stream_a, vote.signature);
     write (stream_a, vote.sequence);
-    vote.block->serialize (stream_a);
+    if (vote.block != nullptr)
+    {
+        vote.block->serialize (stream_a);
+    }
+    else
+    {
+        write (stream_a, static_cast <uint8_t> (vote.hashes.size ()));
+        for (auto & i: vote.hashes)
+        {
+            write (stream_a, i);
+        }
+    }
 }
 
 bool rai::confirm_ack::operator == (rai::confirm_ack const & other_a) const
 {
-    auto result (vote.account == other_a.vote.account && *vote.block == *other_a.vote.block && vote.signature == other_a.vote.signature && vote.sequence == other_a.vote.sequence);
+    auto blocks_equal (vote.block != nullptr && other_a.vote.block != nullptr ? *vote.block == *other_a.vote.block : vote.block == other_a.vote.block && vote.hashes == other_a.vote.hashes);
+    auto result (vote.account == other_a.vote.account && blocks_equal && vote.signature == other_a.vote.signature && vote.sequence == other_a.vote.sequence);
     return result;
 }
 
@@ -520,3 +635,37 @@ void rai::bulk_push::visit (rai::message_visitor & visitor_a) const
 {
     visitor_a.bulk_push (*this);
 }
+
+rai::realtime::realtime () :
+message (rai::message_type::realtime),
+port (0)
+{
+}
+
+bool rai::realtime::deserialize (rai::stream & stream_a)
+{
+    auto result (read_header (stream_a, version_max, version_using, version_min, type, extensions));
+    assert (!result);
+    assert (rai::message_type::realtime == type);
+    if (!result)
+    {
+        result = read (stream_a, port);
+    }
+    return result;
+}
+
+void rai::realtime::serialize (rai::stream & stream_a)
+{
+    write_header (stream_a);
+    write (stream_a, port);
+}
+
+void rai::realtime::visit (rai::message_visitor & visitor_a) const
+{
+    visitor_a.realtime (*this);
+}
+
+bool rai::realtime::operator == (rai::realtime const & other_a) const
+{
+    return port == other_a.port;
+}
@@ -7,6 +7,7 @@
 #include <xxhash/xxhash.h>
 
 #include <bitset>
+#include <memory>
 
 namespace rai
 {
@@ -18,20 +19,51 @@ bool parse_endpoint (std::string const &, rai::endpoint &);
 bool parse_tcp_endpoint (std::string const &, rai::tcp_endpoint &);
 bool reserved_address (rai::endpoint const &);
 }
+namespace rai
+{
+// IPv6 address followed by the port in network byte order, an 18 byte table key that hashes in one pass
+class endpoint_key
+{
+public:
+	endpoint_key () :
+	bytes ()
+	{
+	}
+	endpoint_key (rai::endpoint const & endpoint_a)
+	{
+		// IPv4 endpoints, such as the unset sender of a local block, are stored v4-mapped
+		auto address ((endpoint_a.address ().is_v6 () ? endpoint_a.address ().to_v6 () : boost::asio::ip::address_v6::v4_mapped (endpoint_a.address ().to_v4 ())).to_bytes ());
+		std::copy (address.begin (), address.end (), bytes.begin ());
+		auto port (endpoint_a.port ());
+		bytes [16] = static_cast <uint8_t> (port >> 8);
+		bytes [17] = static_cast <uint8_t> (port);
+	}
+	rai::endpoint endpoint () const
+	{
+		boost::asio::ip::address_v6::bytes_type address;
+		std::copy (bytes.begin (), bytes.begin () + address.size (), address.begin ());
+		return rai::endpoint (boost::asio::ip::address_v6 (address), (static_cast <uint16_t> (bytes [16]) << 8) | bytes [17]);
+	}
+	uint64_t hash () const
+	{
+		return XXH64 (bytes.data (), bytes.size (), 0);
+	}
+	bool operator == (rai::endpoint_key const & other_a) const
+	{
+		return bytes == other_a.bytes;
+	}
+	bool operator != (rai::endpoint_key const & other_a) const
+	{
+		return !(*this == other_a);
+	}
+	std::array <uint8_t, 18> bytes;
+};
+}
 static uint64_t endpoint_hash_raw (rai::endpoint const & endpoint_a)
 {
 	assert (endpoint_a.address ().is_v6 ());
-	rai::uint128_union address;
-	address.bytes = endpoint_a.address ().to_v6 ().to_bytes ();
-	XXH64_state_t hash;
-	XXH64_reset (&hash, 0);
-	XXH64_update (&hash, address.bytes.data (), address.bytes.size ());
-	auto port (endpoint_a.port ());
-	XXH64_update (&hash, &port, sizeof (port));
-	auto result (XXH64_digest (&hash));
-	return result;
+	return rai::endpoint_key (endpoint_a).hash ();
 }
-
 namespace std
 {
 template <size_t size>
@@ -65,6 +97,14 @@ struct hash <rai::endpoint>
         return ehash (endpoint_a);
     }
 };
+template <>
+struct hash <rai::endpoint_key>
+{
+	size_t operator () (rai::endpoint_key const & key_a) const
+	{
+		return static_cast <size_t> (key_a.hash ());
+	}
+};
 }
 namespace boost
 {
@@ -77,6 +117,15 @@ struct hash <rai::endpoint>
         return hash (endpoint_a);
     }
 };
+template <>
+struct hash <rai::endpoint_key>
+{
+	size_t operator () (rai::endpoint_key const & key_a) const
+	{
+		std::hash <rai::endpoint_key> hash;
+		return hash (key_a);
+	}
+};
 }
 
 namespace rai
@@ -91,7 +140,8 @@ enum class message_type : uint8_t
     confirm_ack,
     bulk_pull,
     bulk_push,
-    frontier_req
+    frontier_req,
+    realtime
 };
 class message_visitor;
 class message
@@ -101,6 +151,8 @@ public:
 	message (bool &, rai::stream &);
     virtual ~message () = default;
     void write_header (rai::stream &);
+	// Serialize in to an immutable buffer that can be shared by every destination
+	std::shared_ptr <std::vector <uint8_t> const> to_bytes ();
     static bool read_header (rai::stream &, uint8_t &, uint8_t &, uint8_t &, rai::message_type &, std::bitset <16> &);
     virtual void serialize (rai::stream &) = 0;
     virtual bool deserialize (rai::stream &) = 0;
@@ -143,7 +195,17 @@ public:
     bool deserialize (rai::stream &) override;
     void serialize (rai::stream &) override;
     bool operator == (rai::keepalive const &) const;
+	// Ask the receiver to echo nonce back
+	void probe_set (uint64_t);
+	// Answer a probe with its nonce
+	void echo_set (uint64_t);
+	bool probe () const;
+	bool echo () const;
     std::array <rai::endpoint, 8> peers;
+	// Follows the peers when either extension bit is set
+	uint64_t nonce;
+	static size_t constexpr probe_position = 3;
+	static size_t constexpr echo_position = 4;
 };
 class publish : public message
 {
@@ -154,24 +216,33 @@ public:
     bool deserialize (rai::stream &) override;
     void serialize (rai::stream &) override;
     bool operator == (rai::publish const &) const;
-    std::unique_ptr <rai::block> block;
+    // Shared by everything processing the message so the parsed block is never copied
+    std::shared_ptr <rai::block const> block;
 };
 class confirm_req : public message
 {
 public:
     confirm_req ();
     confirm_req (std::unique_ptr <rai::block>);
+    // Request votes by hash, sent with block type not_a_block and a count followed by the pairs
+    confirm_req (std::vector <std::pair <rai::block_hash, rai::block_hash>> const &);
     bool deserialize (rai::stream &) override;
     void serialize (rai::stream &) override;
     void visit (rai::message_visitor &) const override;
     bool operator == (rai::confirm_req const &) const;
-    std::unique_ptr <rai::block> block;
+    // Null for a request by hash
+    std::shared_ptr <rai::block const> block;
+    // Root and hash of each block to vote on
+    std::vector <std::pair <rai::block_hash, rai::block_hash>> roots_hashes;
+    static size_t constexpr roots_hashes_max = 7;
 };
 class confirm_ack : public message
 {
 public:
 	confirm_ack (bool &, rai::stream &);
     confirm_ack (rai::account const &, rai::raw_key const &, uint64_t, std::unique_ptr <rai::block>);
+    // Vote by hash, sent with block type not_a_block and a count followed by the hashes
+    confirm_ack (rai::account const &, rai::raw_key const &, uint64_t, std::vector <rai::block_hash> const &);
     bool deserialize (rai::stream &) override;
     void serialize (rai::stream &) override;
     void visit (rai::message_visitor &) const override;
@@ -209,6 +280,18 @@ public:
     void serialize (rai::stream &) override;
     void visit (rai::message_visitor &) const override;
 };
+// Opens a persistent channel for realtime messages on a bootstrap connection
+class realtime : public message
+{
+public:
+    realtime ();
+    bool deserialize (rai::stream &) override;
+    void serialize (rai::stream &) override;
+    void visit (rai::message_visitor &) const override;
+    bool operator == (rai::realtime const &) const;
+    // Port the sender receives UDP on, messages from the channel are attributed to this endpoint
+    uint16_t port;
+};
 class message_visitor
 {
 public:
@@ -219,5 +302,6 @@ public:
     virtual void bulk_pull (rai::bulk_pull const &) = 0;
     virtual void bulk_push (rai::bulk_push const &) = 0;
     virtual void frontier_req (rai::frontier_req const &) = 0;
+    virtual void realtime (rai::realtime const &) = 0;
 };
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <rai/node/common.hpp>
 #include <rai/node/rpc.hpp>
 
+#include <cmath>
 #include <future>
 #include <memory>
 #include <sstream>
@@ -25,42 +26,152 @@ double constexpr rai::node::free_cutoff;
 std::chrono::seconds constexpr rai::node::period;
 std::chrono::seconds constexpr rai::node::cutoff;
 std::chrono::minutes constexpr rai::node::backup_interval;
+std::chrono::minutes constexpr rai::node::prune_interval;
+std::chrono::seconds constexpr rai::node::peer_publish_interval;
+std::chrono::milliseconds constexpr rai::alarm::tick;
+size_t constexpr rai::alarm::slots;
+size_t constexpr rai::node::prune_batch;
+size_t constexpr rai::block_processor::max_size;
+size_t constexpr rai::block_processor::batch_size;
+uint16_t constexpr rai::packet_replay::sender_port;
+std::chrono::seconds constexpr rai::recent_blocks::max_age;
+std::chrono::seconds constexpr rai::peer_container::permutation_period;
+double constexpr rai::peer_container::probe_weight;
+std::chrono::seconds constexpr rai::peer_container::probe_timeout;
+std::chrono::seconds constexpr rai::peer_container::contact_interval;
+std::chrono::milliseconds constexpr rai::peer_container::publish_interval;
+uint64_t constexpr rai::recent_blocks::time_mask;
+size_t constexpr rai::udp_receiver::batch_size;
+size_t constexpr rai::send_scheduler::peers_max;
+size_t constexpr rai::rolling_bloom::hashes;
+size_t constexpr rai::rolling_bloom::capacity;
+size_t constexpr rai::vote_filter::max_entries;
+size_t constexpr rai::vote_filter::root_votes;
+size_t constexpr rai::vote_filter::representative_votes;
+std::chrono::milliseconds const rai::vote_bundler::delay = rai::rai_network == rai::rai_networks::rai_test_network ? std::chrono::milliseconds (1) : std::chrono::milliseconds (20);
+std::chrono::milliseconds const rai::confirm_req_batcher::delay = rai::rai_network == rai::rai_networks::rai_test_network ? std::chrono::milliseconds (1) : std::chrono::milliseconds (20);
+std::chrono::milliseconds const rai::vote_filter::window = rai::rai_network == rai::rai_networks::rai_test_network ? std::chrono::milliseconds (10) : std::chrono::milliseconds (1000);
 
 rai::network::network (boost::asio::io_service & service_a, uint16_t port, rai::node & node_a) :
-socket (service_a, boost::asio::ip::udp::endpoint (boost::asio::ip::address_v6::any (), port)),
+socket (service_a),
 service (service_a),
 resolver (service_a),
 node (node_a),
+realtime (node_a),
 bad_sender_count (0),
+scheduler (node_a.config.send_rate, node_a.config.send_burst, node_a.config.send_peer_rate, node_a.config.send_peer_burst),
+in_flight (0),
+wakeup (std::chrono::steady_clock::time_point::max ()),
 on (true),
 keepalive_count (0),
 publish_count (0),
 confirm_req_count (0),
 confirm_ack_count (0),
 insufficient_work_count (0),
+insufficient_weight_count (0),
 error_count (0)
 {
+	auto receivers_l (std::max <unsigned> (node_a.config.network_receivers, 1));
+	socket.open (boost::asio::ip::udp::v6 ());
+	configure (socket);
+	auto reuse_port (receivers_l > 1 && !rai::udp_reuse_port (socket));
+	socket.bind (boost::asio::ip::udp::endpoint (boost::asio::ip::address_v6::any (), port));
+	receivers.push_back (std::unique_ptr <rai::udp_receiver> (new rai::udp_receiver (*this, socket)));
+	for (auto i (1u); i < receivers_l; ++i)
+	{
+		if (reuse_port)
+		{
+			// Bind to the port actually assigned in case `port' was 0
+			std::unique_ptr <boost::asio::ip::udp::socket> socket_l (new boost::asio::ip::udp::socket (service_a));
+			socket_l->open (boost::asio::ip::udp::v6 ());
+			configure (*socket_l);
+			auto error (rai::udp_reuse_port (*socket_l));
+			assert (!error);
+			socket_l->bind (boost::asio::ip::udp::endpoint (boost::asio::ip::address_v6::any (), socket.local_endpoint ().port ()));
+			receivers.push_back (std::unique_ptr <rai::udp_receiver> (new rai::udp_receiver (*this, *socket_l)));
+			sockets.push_back (std::move (socket_l));
+		}
+		else
+		{
+			// Fall back to several outstanding receives on the one socket
+			receivers.push_back (std::unique_ptr <rai::udp_receiver> (new rai::udp_receiver (*this, socket)));
+		}
+	}
+}
+
+void rai::network::configure (boost::asio::ip::udp::socket & socket_a)
+{
+	boost::system::error_code ec;
+	if (node.config.socket_receive_buffer != 0)
+	{
+		socket_a.set_option (boost::asio::socket_base::receive_buffer_size (node.config.socket_receive_buffer), ec);
+	}
+	if (!ec && node.config.socket_send_buffer != 0)
+	{
+		socket_a.set_option (boost::asio::socket_base::send_buffer_size (node.config.socket_send_buffer), ec);
+	}
+	if (ec)
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Unable to set socket buffer sizes: %1%") % ec.message ());
+	}
+	rai::udp_drop_counter (socket_a);
+}
+
+uint64_t rai::network::drop_count ()
+{
+	uint64_t result (0);
+	for (auto i (receivers.begin ()), n (receivers.end ()); i != n; ++i)
+	{
+		// Receivers sharing a socket see the same counter
+		auto first (std::find_if (receivers.begin (), i, [i] (std::unique_ptr <rai::udp_receiver> const & receiver_a) { return &receiver_a->socket == &(*i)->socket; }) == i);
+		if (first)
+		{
+			uint64_t drops (0);
+			if (!(*i)->batch_buffers.empty ())
+			{
+				for (auto j (i); j != n; ++j)
+				{
+					if (&(*j)->socket == &(*i)->socket)
+					{
+						drops = std::max <uint64_t> (drops, (*j)->drop_count);
+					}
+				}
+			}
+			else
+			{
+				// Ancillary data is only read by batched receives
+				drops = rai::udp_drop_count ((*i)->socket);
+			}
+			result += drops;
+		}
+	}
+	return result;
 }
 
 void rai::network::receive ()
 {
-    if (node.config.logging.network_packet_logging ())
-    {
-        BOOST_LOG (node.log) << "Receiving packet";
-    }
-    std::unique_lock <std::mutex> lock (socket_mutex);
-    socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote,
-        [this] (boost::system::error_code const & error, size_t size_a)
-        {
-            receive_action (error, size_a);
-        });
+	for (auto & i: receivers)
+	{
+		i->receive ();
+	}
 }
 
 void rai::network::stop ()
 {
     on = false;
     socket.close ();
+	for (auto & i: sockets)
+	{
+		i->close ();
+	}
     resolver.cancel ();
+	realtime.stop ();
+	std::lock_guard <std::mutex> lock (socket_mutex);
+	if (wakeup_operation != nullptr)
+	{
+		node.alarm.cancel (wakeup_operation);
+		wakeup_operation.reset ();
+	}
 }
 
 void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
@@ -68,26 +179,32 @@ void rai::network::send_keepalive (rai::endpoint const & endpoint_a)
     assert (endpoint_a.address ().is_v6 ());
     rai::keepalive message;
     node.peers.random_fill (message.peers);
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+	if (node.config.latency_probing)
+	{
+		auto nonce (node.peers.probe (endpoint_a));
+		if (nonce != 0)
+		{
+			message.probe_set (nonce);
+		}
+	}
+    auto bytes (message.to_bytes ());
+    if (node.config.logging.network_keepalive_logging ())
     {
-        rai::vectorstream stream (*bytes);
-        message.serialize (stream);
+        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive req sent from %1% to %2%") % endpoint () % endpoint_a);
     }
+    send_buffer (bytes, endpoint_a, 0, rai::send_priority::keepalive);
+}
+
+void rai::network::echo_keepalive (rai::endpoint const & endpoint_a, uint64_t nonce_a)
+{
+    rai::keepalive message;
+    node.peers.random_fill (message.peers);
+	message.echo_set (nonce_a);
     if (node.config.logging.network_keepalive_logging ())
     {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive req sent from %1% to %2%") % endpoint () % endpoint_a);
+        BOOST_LOG (node.log) << boost::str (boost::format ("Keepalive echo sent from %1% to %2%") % endpoint () % endpoint_a);
     }
-    auto node_l (node.shared ());
-    send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_l, endpoint_a] (boost::system::error_code const & ec, size_t)
-        {
-            if (node_l->config.logging.network_logging ())
-            {
-                if (ec)
-                {
-                    BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending keepalive from %1% to %2% %3%") % node_l->network.endpoint () % endpoint_a % ec.message ());
-                }
-            }
-        });
+    send_buffer (message.to_bytes (), endpoint_a, 0, rai::send_priority::keepalive);
 }
 
 void rai::node::keepalive (std::string const & address_a, uint16_t port_a)
@@ -114,38 +231,35 @@ void rai::node::keepalive (std::string const & address_a, uint16_t port_a)
 	});
 }
 
-void rai::network::republish_block (rai::block & block, size_t rebroadcast_a)
+void rai::network::republish_block (rai::block const & block, size_t rebroadcast_a)
 {
 	auto hash (block.hash ());
-    auto list (node.peers.list ());
 	// If we're a representative, broadcast a signed confirm, otherwise an unsigned publish
-    if (!confirm_broadcast (list, block.clone (), rebroadcast_a))
+    if (!confirm_broadcast (node.peers.fanout (std::numeric_limits <size_t>::max ()), block.clone (), rebroadcast_a))
     {
         rai::publish message (block.clone ());
-        std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
+        // One buffer is shared by every peer and rebroadcast round
+        auto bytes (message.to_bytes ());
+        auto count (fanout (node.peers.size ()));
+        // Half the first wave goes to the fastest reliable peers, the rest rotates through every peer so none are left out
+        auto list (node.peers.preferred (count / 2));
+        for (auto & i: node.peers.fanout (count))
         {
-            rai::vectorstream stream (*bytes);
-            message.serialize (stream);
+			if (list.size () < count && std::find (list.begin (), list.end (), i) == list.end ())
+			{
+				list.push_back (i);
+			}
         }
-        auto node_l (node.shared ());
         for (auto i (list.begin ()), n (list.end ()); i != n; ++i)
         {
-			if (!node.peers.knows_about (i->endpoint, hash))
+			if (!node.peers.knows_about (*i, hash))
 			{
 				if (node.config.logging.network_publish_logging ())
 				{
-					BOOST_LOG (node.log) << boost::str (boost::format ("Publish %1% to %2%") % hash.to_string () % i->endpoint);
+					BOOST_LOG (node.log) << boost::str (boost::format ("Publish %1% to %2%") % hash.to_string () % *i);
 				}
-				send_buffer (bytes->data (), bytes->size (), i->endpoint, rebroadcast_a, [bytes, node_l] (boost::system::error_code const & ec, size_t size)
-				{
-					if (node_l->config.logging.network_logging ())
-					{
-						if (ec)
-						{
-							BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending publish: %1% from %2%") % ec.message () % node_l->network.endpoint ());
-						}
-					}
-				});
+				send_buffer (bytes, *i, rebroadcast_a, rai::send_priority::publish);
+				node.peers.sent (*i, hash);
 			}
         }
 		if (node.config.logging.network_logging ())
@@ -164,36 +278,38 @@ void rai::network::republish_block (rai::block & block, size_t rebroadcast_a)
 
 void rai::network::broadcast_confirm_req (rai::block const & block_a)
 {
+	rai::confirm_req message (block_a.clone ());
+	auto bytes (message.to_bytes ());
 	auto list (node.peers.list ());
 	for (auto i (list.begin ()), j (list.end ()); i != j; ++i)
 	{
-		node.network.send_confirm_req (i->endpoint, block_a);
+		if (node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req to %1%") % i->endpoint);
+		}
+		send_buffer (bytes, i->endpoint, 0, rai::send_priority::confirm_req);
+	}
+}
+
+// Peers a publish is sent to, every node relays blocks new to it so a fanout around sqrt (peers) still reaches the whole network
+size_t rai::network::fanout (size_t peers_a)
+{
+	auto result (peers_a);
+	if (node.config.broadcast_fanout != 0)
+	{
+		result = std::min (peers_a, std::max <size_t> (node.config.broadcast_fanout, std::ceil (std::sqrt (peers_a))));
 	}
+	return result;
 }
 
 void rai::network::send_confirm_req (boost::asio::ip::udp::endpoint const & endpoint_a, rai::block const & block)
 {
     rai::confirm_req message (block.clone ());
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-    {
-        rai::vectorstream stream (*bytes);
-        message.serialize (stream);
-    }
     if (node.config.logging.network_logging ())
     {
         BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req to %1%") % endpoint_a);
     }
-    auto node_l (node.shared ());
-    send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_l] (boost::system::error_code const & ec, size_t size)
-        {
-            if (node_l->config.logging.network_logging ())
-            {
-                if (ec)
-                {
-                    BOOST_LOG (node_l->log) << boost::str (boost::format ("Error sending confirm request: %1%") % ec.message ());
-                }
-            }
-        });
+    send_buffer (message.to_bytes (), endpoint_a, 0, rai::send_priority::confirm_req);
 }
 
 namespace
@@ -213,7 +329,21 @@ public:
             BOOST_LOG (node.log) << boost::str (boost::format ("Received keepalive message from %1%") % sender);
         }
         ++node.network.keepalive_count;
+		// Checked before contacting since that makes any sender a peer
+		auto known (node.peers.known_peer (sender));
         node.peers.contacted (sender);
+		if (message_a.probe ())
+		{
+			// Echoes only go to peers we already talk to so a spoofed sender can't use us as a reflector
+			if (known)
+			{
+				node.network.echo_keepalive (sender, message_a.nonce);
+			}
+		}
+		else if (message_a.echo ())
+		{
+			node.peers.probe_reply (sender, message_a.nonce);
+		}
         node.network.merge_peers (message_a.peers);
     }
     void publish (rai::publish const & message_a) override
@@ -224,8 +354,9 @@ public:
         }
         ++node.network.publish_count;
         node.peers.contacted (sender);
-        node.peers.insert (sender, message_a.block->hash ());
-        node.process_receive_republish (message_a.block->clone (), 0);
+        auto hash (message_a.block->hash ());
+        node.peers.insert (sender, hash);
+        process (message_a.block, hash, rai::block_origin::publish, node.work.work_value (message_a.block->root (), message_a.block->block_work ()), nullptr);
     }
     void confirm_req (rai::confirm_req const & message_a) override
     {
@@ -234,17 +365,37 @@ public:
             BOOST_LOG (node.log) << boost::str (boost::format ("Received confirm_req message from %1%") % sender);
         }
         ++node.network.confirm_req_count;
+		// Checked before contacting since that makes any sender a peer
+		auto known (node.peers.known_peer (sender));
         node.peers.contacted (sender);
-        node.peers.insert (sender, message_a.block->hash ());
-        node.process_receive_republish (message_a.block->clone (), 0);
-		bool exists;
-		{
-			rai::transaction transaction (node.store.environment, nullptr, false);
-			exists = node.store.block_exists (transaction, message_a.block->hash ());
-		}
-        if (exists)
+        auto node_l (node.shared ());
+        auto sender_l (sender);
+        if (message_a.block != nullptr)
+        {
+			auto hash (message_a.block->hash ());
+			node.peers.insert (sender, hash);
+			auto block_l (message_a.block);
+			process (message_a.block, hash, rai::block_origin::confirm_req, node.work.work_value (message_a.block->root (), message_a.block->block_work ()), [node_l, sender_l, block_l] ()
+			{
+				bool exists;
+				{
+					rai::transaction transaction (node_l->store.environment, nullptr, false);
+					exists = node_l->store.block_exists (transaction, block_l->hash ());
+				}
+				if (exists)
+				{
+					node_l->process_confirmation (*block_l, sender_l);
+				}
+			});
+        }
+        else if (node.config.vote_bundling && known)
         {
-            node.process_confirmation (*message_a.block, sender);
+			// Each request by hash can cost a ledger read per root, only peers we already talk to get answers
+			auto roots_hashes (message_a.roots_hashes);
+			node.block_processor.add (rai::block_processor_item {nullptr, 0, std::chrono::steady_clock::now (), [node_l, sender_l, roots_hashes] ()
+			{
+				node_l->process_confirmation (roots_hashes, sender_l);
+			}, rai::block_origin::confirm_req, sender, 0});
         }
     }
     void confirm_ack (rai::confirm_ack const & message_a) override
@@ -255,9 +406,56 @@ public:
         }
         ++node.network.confirm_ack_count;
         node.peers.contacted (sender);
-        node.peers.insert (sender, message_a.vote.block->hash ());
-        node.process_receive_republish (message_a.vote.block->clone (), 0);
-        node.vote (message_a.vote);
+        for (auto & i: message_a.vote.blocks ())
+        {
+			node.peers.insert (sender, i);
+        }
+        rai::uint128_t weight;
+        {
+			rai::transaction transaction (node.store.environment, nullptr, false);
+			weight = node.ledger.weight (transaction, message_a.vote.account);
+        }
+        if (message_a.vote.block == nullptr && (weight == 0 || weight < node.config.vote_minimum.number ()))
+        {
+			// Votes by hash carry no block or work, the representative's weight is what makes them worth checking
+			++node.network.insufficient_weight_count;
+        }
+        else if (!node.vote_filter.filter (message_a.vote, weight))
+        {
+			// The filter checked the signature so the weight really is the voter's and can order the queue
+			auto priority ((weight >> 64).convert_to <uint64_t> ());
+			auto node_l (node.shared ());
+			auto vote_l (std::make_shared <rai::vote> (message_a.vote));
+			auto processed ([node_l, vote_l] ()
+			{
+				node_l->observers.call_vote (*vote_l);
+			});
+			if (message_a.vote.block != nullptr)
+			{
+				process (message_a.vote.block, message_a.vote.block->hash (), rai::block_origin::confirm_ack, priority, processed);
+			}
+			else
+			{
+				node.block_processor.add (rai::block_processor_item {nullptr, 0, std::chrono::steady_clock::now (), processed, rai::block_origin::confirm_ack, sender, priority});
+			}
+        }
+    }
+    // Queue the block for the ledger unless this copy was recently seen, in which case only the callback is queued
+    void process (std::shared_ptr <rai::block const> const & block_a, rai::block_hash const & hash_a, rai::block_origin origin_a, uint64_t priority_a, std::function <void ()> const & processed_a)
+    {
+		auto work (block_a->block_work ());
+		auto now (std::chrono::steady_clock::now ());
+		if (node.recent_blocks.check (hash_a, work))
+		{
+			if (processed_a)
+			{
+				node.block_processor.add (rai::block_processor_item {nullptr, 0, now, processed_a, origin_a, sender, priority_a});
+			}
+		}
+		else if (!node.block_processor.add (rai::block_processor_item {block_a, 0, now, processed_a, origin_a, sender, priority_a}))
+		{
+			node.recent_blocks.insert (hash_a, work);
+		}
     }
     void bulk_pull (rai::bulk_pull const &) override
     {
@@ -271,121 +469,498 @@ public:
     {
         assert (false);
     }
+    void realtime (rai::realtime const &) override
+    {
+        assert (false);
+    }
     rai::node & node;
     rai::endpoint sender;
 };
 }
 
-void rai::network::receive_action (boost::system::error_code const & error, size_t size_a)
+rai::udp_receiver::udp_receiver (rai::network & network_a, boost::asio::ip::udp::socket & socket_a) :
+network (network_a),
+socket (socket_a),
+receive_count (0),
+drop_count (0),
+drops_last (0)
+{
+	if (network.node.config.udp_batching && rai::udp_batch_supported ())
+	{
+		batch_buffers.resize (batch_size);
+	}
+}
+
+void rai::udp_receiver::receive ()
 {
-    if (!error && on)
+    if (network.node.config.logging.network_packet_logging ())
     {
-        if (!rai::reserved_address (remote) && remote != endpoint ())
-        {
-            network_message_visitor visitor (node, remote);
-            rai::message_parser parser (visitor, node.work);
-            parser.deserialize_buffer (buffer.data (), size_a);
-            if (parser.error)
-            {
-                ++error_count;
-            }
-            else if (parser.insufficient_work)
-            {
-                if (node.config.logging.insufficient_work_logging ())
-                {
-                    BOOST_LOG (node.log) << "Insufficient work in message";
-                }
-                ++insufficient_work_count;
-            }
-        }
-        else
-        {
-            if (node.config.logging.network_logging ())
-            {
-                BOOST_LOG (node.log) << boost::str (boost::format ("Reserved sender %1%") % remote.address ().to_string ());
-            }
-            ++bad_sender_count;
-        }
+        BOOST_LOG (network.node.log) << "Receiving packet";
+    }
+    std::unique_lock <std::mutex> lock (network.socket_mutex);
+	if (!batch_buffers.empty ())
+	{
+		// Wait for the socket to become readable then drain it with udp_receive_batch
+		socket.async_receive (boost::asio::null_buffers (),
+			[this] (boost::system::error_code const & error, size_t)
+			{
+				receive_batch (error);
+			});
+	}
+	else
+	{
+		socket.async_receive_from (boost::asio::buffer (buffer.data (), buffer.size ()), remote,
+			[this] (boost::system::error_code const & error, size_t size_a)
+			{
+				receive_action (error, size_a);
+			});
+	}
+}
+
+void rai::udp_receiver::receive_action (boost::system::error_code const & error, size_t size_a)
+{
+    if (!error && network.on)
+    {
+		++receive_count;
+		process (buffer.data (), size_a, remote);
         receive ();
     }
     else
     {
-        if (node.config.logging.network_logging ())
-        {
-            BOOST_LOG (node.log) << boost::str (boost::format ("Receive error: %1%") % error.message ());
-        }
-        node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [this] () { receive (); });
+		receive_error (error);
     }
 }
 
-// Send keepalives to all the peers we've been notified of
-void rai::network::merge_peers (std::array <rai::endpoint, 8> const & peers_a)
+void rai::udp_receiver::receive_batch (boost::system::error_code const & error)
 {
-    for (auto i (peers_a.begin ()), j (peers_a.end ()); i != j; ++i)
+    if (!error && network.on)
     {
-        if (!node.peers.not_a_peer (*i) && !node.peers.known_peer (*i))
-        {
-            send_keepalive (*i);
-        }
+		std::array <rai::udp_datagram, batch_size> datagrams;
+		for (auto i (0u); i < batch_buffers.size (); ++i)
+		{
+			datagrams [i].data = batch_buffers [i].data ();
+			datagrams [i].size = batch_buffers [i].size ();
+		}
+		boost::system::error_code ec;
+		auto count (rai::udp_receive_batch (socket, datagrams.data (), batch_buffers.size (), ec));
+		if (!ec)
+		{
+			receive_count += count;
+			for (auto i (0u); i < count; ++i)
+			{
+				// The kernel counter is 32 bits and wraps, unsigned differences stay correct across the wrap
+				drop_count += static_cast <uint32_t> (datagrams [i].drops - drops_last);
+				drops_last = datagrams [i].drops;
+				process (datagrams [i].data, datagrams [i].size, datagrams [i].endpoint);
+			}
+			receive ();
+		}
+		else
+		{
+			receive_error (ec);
+		}
+    }
+    else
+    {
+		receive_error (error);
     }
 }
 
-bool rai::operation::operator > (rai::operation const & other_a) const
+void rai::udp_receiver::receive_error (boost::system::error_code const & error)
 {
-    return wakeup > other_a.wakeup;
+	auto & node (network.node);
+	if (node.config.logging.network_logging ())
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Receive error: %1%") % error.message ());
+	}
+	node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (5), [this] () { receive (); });
 }
 
-rai::alarm::alarm (boost::asio::io_service & service_a) :
-service (service_a),
-thread ([this] () { run (); })
+void rai::udp_receiver::process (uint8_t const * data_a, size_t size_a, rai::endpoint const & remote_a)
 {
+	network.process (data_a, size_a, remote_a);
 }
 
-rai::alarm::~alarm ()
+void rai::network::process (uint8_t const * data_a, size_t size_a, rai::endpoint const & remote_a)
 {
-	add (std::chrono::system_clock::now (), nullptr);
-	thread.join ();
+	if (capture != nullptr)
+	{
+		capture->record (data_a, size_a, remote_a);
+	}
+	if (!rai::reserved_address (remote_a) && remote_a != endpoint ())
+	{
+		network_message_visitor visitor (node, remote_a);
+		rai::message_parser parser (visitor, node.work);
+		parser.deserialize_buffer (data_a, size_a);
+		if (parser.error)
+		{
+			++error_count;
+		}
+		else if (parser.insufficient_work)
+		{
+			if (node.config.logging.insufficient_work_logging ())
+			{
+				BOOST_LOG (node.log) << "Insufficient work in message";
+			}
+			++insufficient_work_count;
+		}
+	}
+	else
+	{
+		if (node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Reserved sender %1%") % remote_a.address ().to_string ());
+		}
+		++bad_sender_count;
+	}
 }
 
-void rai::alarm::run ()
+rai::packet_capture::packet_capture (std::ostream & stream_a) :
+stream (stream_a),
+start (std::chrono::steady_clock::now ()),
+flushed (start),
+count (0)
 {
-    std::unique_lock <std::mutex> lock (mutex);
-	auto done (false);
-    while (!done)
-    {
-        if (!operations.empty ())
-        {
-            auto & operation (operations.top ());
-			if (operation.function)
+}
+
+void rai::packet_capture::record (uint8_t const * data_a, size_t size_a, rai::endpoint const & remote_a)
+{
+	auto now (std::chrono::steady_clock::now ());
+	std::vector <uint8_t> bytes;
+	bytes.reserve (sizeof (uint64_t) + sizeof (rai::endpoint_key) + sizeof (uint16_t) + size_a);
+	{
+		rai::vectorstream stream_l (bytes);
+		rai::write (stream_l, static_cast <uint64_t> (std::chrono::duration_cast <std::chrono::microseconds> (now - start).count ()));
+		rai::write (stream_l, rai::endpoint_key (remote_a).bytes);
+		rai::write (stream_l, static_cast <uint16_t> (size_a));
+	}
+	bytes.insert (bytes.end (), data_a, data_a + size_a);
+	std::lock_guard <std::mutex> lock (mutex);
+	stream.write (reinterpret_cast <char const *> (bytes.data ()), bytes.size ());
+	++count;
+	if (now - flushed >= std::chrono::seconds (1))
+	{
+		stream.flush ();
+		flushed = now;
+	}
+}
+
+bool rai::packet_capture::read_record (std::istream & stream_a, uint64_t & time_a, rai::endpoint & remote_a, std::vector <uint8_t> & bytes_a, bool & error_a)
+{
+	auto result (false);
+	std::array <uint8_t, sizeof (uint64_t) + sizeof (rai::endpoint_key::bytes) + sizeof (uint16_t)> header;
+	stream_a.read (reinterpret_cast <char *> (header.data ()), header.size ());
+	if (stream_a.gcount () == header.size ())
+	{
+		rai::bufferstream header_stream (header.data (), header.size ());
+		rai::endpoint_key key;
+		uint16_t size;
+		error_a = rai::read (header_stream, time_a);
+		error_a = error_a || rai::read (header_stream, key.bytes);
+		error_a = error_a || rai::read (header_stream, size);
+		if (!error_a)
+		{
+			remote_a = key.endpoint ();
+			bytes_a.resize (size);
+			stream_a.read (reinterpret_cast <char *> (bytes_a.data ()), bytes_a.size ());
+			error_a = stream_a.gcount () != size;
+		}
+	}
+	else
+	{
+		// A partial header means the capture was truncated
+		error_a = stream_a.gcount () != 0;
+		result = true;
+	}
+	return result;
+}
+
+rai::packet_replay::packet_replay (rai::node & node_a, std::istream & stream_a) :
+node (node_a),
+stream (stream_a),
+read_count (0),
+queue_max (0),
+queue_mean (0.0),
+committed_count (0),
+receive_time (0),
+process_time (0)
+{
+}
+
+bool rai::packet_replay::run (double speed_a)
+{
+	auto error (false);
+	size_t blocks_before;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		blocks_before = node.store.block_count (transaction);
+	}
+	auto & receiver (*node.network.receivers [0]);
+	std::unordered_map <rai::endpoint_key, rai::endpoint> senders;
+	uint32_t next_port (sender_port);
+	auto own_port (node.network.endpoint ().port ());
+	uint64_t time;
+	rai::endpoint remote;
+	std::vector <uint8_t> bytes;
+	size_t queue_total (0);
+	auto begin (std::chrono::steady_clock::now ());
+	while (!error && !rai::packet_capture::read_record (stream, time, remote, bytes, error))
+	{
+		if (!error)
+		{
+			if (speed_a > 0.0)
+			{
+				std::this_thread::sleep_until (begin + std::chrono::microseconds (static_cast <uint64_t> (time / speed_a)));
+			}
+			auto existing (senders.find (rai::endpoint_key (remote)));
+			if (existing == senders.end ())
 			{
-				if (operation.wakeup <= std::chrono::system_clock::now ())
+				if (next_port == own_port)
 				{
-					service.post (operation.function);
-					operations.pop ();
+					// Datagrams from our own port would look like they came from ourselves
+					++next_port;
+				}
+				if (next_port <= std::numeric_limits <uint16_t>::max ())
+				{
+					existing = senders.insert (std::make_pair (rai::endpoint_key (remote), rai::endpoint (boost::asio::ip::address_v6::loopback (), static_cast <uint16_t> (next_port)))).first;
+					++next_port;
 				}
 				else
 				{
-					auto wakeup (operation.wakeup);
-					condition.wait_until (lock, wakeup);
+					// More senders than ports, reusing one would merge distinct peers
+					error = true;
 				}
 			}
-			else
+			if (!error)
 			{
-				done = true;
+				// The same path receive_action takes for a datagram read from the socket
+				++receiver.receive_count;
+				receiver.process (bytes.data (), bytes.size (), existing->second);
+				++read_count;
+				auto depth (node.block_processor.size ());
+				queue_max = std::max (queue_max, depth);
+				queue_total += depth;
 			}
-        }
-        else
+		}
+	}
+	auto received (std::chrono::steady_clock::now ());
+	node.block_processor.flush ();
+	auto processed (std::chrono::steady_clock::now ());
+	receive_time = received - begin;
+	process_time = processed - begin;
+	queue_mean = read_count != 0 ? static_cast <double> (queue_total) / read_count : 0.0;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, false);
+		committed_count = node.store.block_count (transaction) - blocks_before;
+	}
+	return error;
+}
+
+// Send keepalives to all the peers we've been notified of
+void rai::network::merge_peers (std::array <rai::endpoint, 8> const & peers_a)
+{
+    for (auto i (peers_a.begin ()), j (peers_a.end ()); i != j; ++i)
+    {
+        if (!node.peers.not_a_peer (*i) && !node.peers.known_peer (*i))
         {
-            condition.wait (lock);
+            send_keepalive (*i);
         }
     }
 }
 
-void rai::alarm::add (std::chrono::system_clock::time_point const & wakeup_a, std::function <void ()> const & operation)
+rai::alarm::alarm (boost::asio::io_service & service_a) :
+service (service_a),
+function_mutex (std::make_shared <std::mutex> ()),
+start (std::chrono::steady_clock::now ()),
+wheel (slots),
+due_slots (),
+current (0),
+next (std::numeric_limits <uint64_t>::max ()),
+count (0),
+stopped (false),
+thread ([this] () { run (); })
+{
+}
+
+rai::alarm::~alarm ()
+{
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		stopped = true;
+	}
+	condition.notify_one ();
+	thread.join ();
+}
+
+void rai::alarm::run ()
 {
+    std::unique_lock <std::mutex> lock (mutex);
+    while (!stopped)
+    {
+		auto now (ticks (std::chrono::steady_clock::now ()));
+		std::vector <std::shared_ptr <rai::operation>> expired;
+		for (; current <= now; ++current)
+		{
+			auto & slot (wheel [current % slots]);
+			size_t kept (0);
+			auto due_l (false);
+			for (size_t i (0), n (slot.size ()); i < n; ++i)
+			{
+				auto & operation (slot [i]);
+				if (operation->cancelled)
+				{
+					--count;
+				}
+				else if (operation->rounds == 0)
+				{
+					expired.push_back (std::move (operation));
+					--count;
+				}
+				else
+				{
+					--operation->rounds;
+					due_l = due_l || operation->rounds == 0;
+					if (kept != i)
+					{
+						slot [kept] = std::move (operation);
+					}
+					++kept;
+				}
+			}
+			slot.resize (kept);
+			set_due (current % slots, due_l);
+		}
+		if (!expired.empty ())
+		{
+			lock.unlock ();
+			auto batch (std::make_shared <std::vector <std::shared_ptr <rai::operation>>> (std::move (expired)));
+			auto function_mutex_l (function_mutex);
+			service.post ([function_mutex_l, batch] ()
+			{
+				for (auto & i: *batch)
+				{
+					// Taken out under the mutex so a racing cancel can't release it while it runs, and the operation stops holding its captures once it has fired
+					std::function <void ()> function;
+					{
+						std::lock_guard <std::mutex> lock (*function_mutex_l);
+						if (!i->cancelled)
+						{
+							function.swap (i->function);
+						}
+					}
+					if (function)
+					{
+						function ();
+					}
+				}
+			});
+			lock.lock ();
+		}
+		else
+		{
+			next = next_due ();
+			if (next == std::numeric_limits <uint64_t>::max ())
+			{
+				condition.wait (lock);
+			}
+			else
+			{
+				condition.wait_until (lock, start + tick * static_cast <std::chrono::milliseconds::rep> (next));
+			}
+		}
+    }
+}
+
+uint64_t rai::alarm::next_due ()
+{
+	auto result (std::numeric_limits <uint64_t>::max ());
+	if (count > 0)
+	{
+		result = current + slots;
+		// Cancelled operations can leave a bit set, waking for them early only sweeps the slot
+		for (uint64_t i (0); i < slots && result == current + slots;)
+		{
+			auto slot ((current + i) % slots);
+			auto word (due_slots [slot / 64] >> (slot % 64));
+			if (word == 0)
+			{
+				i += 64 - slot % 64;
+			}
+			else
+			{
+				while ((word & 1) == 0)
+				{
+					word >>= 1;
+					++i;
+				}
+				result = current + i;
+			}
+		}
+	}
+	return result;
+}
+
+void rai::alarm::set_due (size_t slot_a, bool due_a)
+{
+	auto bit (uint64_t (1) << (slot_a % 64));
+	if (due_a)
+	{
+		due_slots [slot_a / 64] |= bit;
+	}
+	else
+	{
+		due_slots [slot_a / 64] &= ~bit;
+	}
+}
+
+uint64_t rai::alarm::ticks (std::chrono::steady_clock::time_point const & time_a)
+{
+	uint64_t result (0);
+	if (time_a > start)
+	{
+		result = (time_a - start) / tick;
+	}
+	return result;
+}
+
+std::shared_ptr <rai::operation> rai::alarm::add (std::chrono::system_clock::time_point const & wakeup_a, std::function <void ()> const & operation)
+{
+	auto result (std::make_shared <rai::operation> ());
+	result->function = operation;
+	result->cancelled = false;
+	// Round up so the operation never runs before wakeup_a
+	auto due_time (std::chrono::steady_clock::now () + std::chrono::duration_cast <std::chrono::steady_clock::duration> (wakeup_a - std::chrono::system_clock::now ()) + tick - std::chrono::steady_clock::duration (1));
     std::lock_guard <std::mutex> lock (mutex);
-	operations.push (rai::operation ({wakeup_a, operation}));
-	condition.notify_all ();
+	if (count == 0)
+	{
+		// Nothing to count down, skip the ticks an idle thread didn't walk
+		current = std::max (current, ticks (std::chrono::steady_clock::now ()));
+	}
+	auto due (std::max (current, ticks (due_time)));
+	result->rounds = (due - current) / slots;
+	wheel [due % slots].push_back (result);
+	if (result->rounds == 0)
+	{
+		set_due (due % slots, true);
+	}
+	++count;
+	if (due < next)
+	{
+		next = due;
+		condition.notify_one ();
+	}
+	return result;
+}
+
+void rai::alarm::cancel (std::shared_ptr <rai::operation> const & operation_a)
+{
+	std::function <void ()> function;
+	{
+		std::lock_guard <std::mutex> lock (*function_mutex);
+		// Swept when the wheel reaches its slot, the function is released now so whatever it captured doesn't wait for the sweep
+		operation_a->cancelled = true;
+		function.swap (operation_a->function);
+	}
 }
 
 rai::logging::logging (boost::filesystem::path const & application_path_a) :
@@ -589,7 +1164,14 @@ node_config (rai::network::node_port, rai::logging (application_path_a))
 rai::node_config::node_config (uint16_t peering_port_a, rai::logging const & logging_a) :
 peering_port (peering_port_a),
 logging (logging_a),
-packet_delay_microseconds (5000),
+send_rate (4096),
+send_burst (512),
+send_peer_rate (256),
+send_peer_burst (64),
+send_max_in_flight (64),
+broadcast_fanout (8),
+realtime_tcp (false),
+realtime_channels_max (32),
 bootstrap_fraction_numerator (1),
 creation_rebroadcast (2),
 rebroadcast_delay (15),
@@ -597,7 +1179,15 @@ receive_minimum (rai::rai_ratio),
 inactive_supply (0),
 password_fanout (1024),
 io_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
-work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ()))
+work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ())),
+network_receivers (1),
+udp_batching (false),
+socket_receive_buffer (0),
+socket_send_buffer (0),
+vote_bundling (false),
+latency_probing (false),
+vote_minimum (rai::Grai_ratio),
+prune_depth (0)
 {
 	switch (rai::rai_network)
 	{
@@ -630,9 +1220,8 @@ work_threads (std::max <unsigned> (4, std::thread::hardware_concurrency ()))
 
 void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) const
 {
-	tree_a.put ("version", "5");
+	tree_a.put ("version", "15");
 	tree_a.put ("peering_port", std::to_string (peering_port));
-	tree_a.put ("packet_delay_microseconds", std::to_string (packet_delay_microseconds));
 	tree_a.put ("bootstrap_fraction_numerator", std::to_string (bootstrap_fraction_numerator));
 	tree_a.put ("creation_rebroadcast", std::to_string (creation_rebroadcast));
 	tree_a.put ("rebroadcast_delay", std::to_string (rebroadcast_delay));
@@ -668,6 +1257,22 @@ void rai::node_config::serialize_json (boost::property_tree::ptree & tree_a) con
 	tree_a.put ("password_fanout", std::to_string (password_fanout));
 	tree_a.put ("io_threads", std::to_string (io_threads));
 	tree_a.put ("work_threads", std::to_string (work_threads));
+	tree_a.put ("prune_depth", std::to_string (prune_depth));
+	tree_a.put ("network_receivers", std::to_string (network_receivers));
+	tree_a.put ("udp_batching", udp_batching);
+	tree_a.put ("send_rate", std::to_string (send_rate));
+	tree_a.put ("send_burst", std::to_string (send_burst));
+	tree_a.put ("send_peer_rate", std::to_string (send_peer_rate));
+	tree_a.put ("send_peer_burst", std::to_string (send_peer_burst));
+	tree_a.put ("send_max_in_flight", std::to_string (send_max_in_flight));
+	tree_a.put ("broadcast_fanout", std::to_string (broadcast_fanout));
+	tree_a.put ("realtime_tcp", realtime_tcp);
+	tree_a.put ("realtime_channels_max", std::to_string (realtime_channels_max));
+	tree_a.put ("socket_receive_buffer", std::to_string (socket_receive_buffer));
+	tree_a.put ("socket_send_buffer", std::to_string (socket_send_buffer));
+	tree_a.put ("vote_bundling", vote_bundling);
+	tree_a.put ("latency_probing", latency_probing);
+	tree_a.put ("vote_minimum", vote_minimum.to_string_dec ());
 }
 
 bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptree & tree_a)
@@ -709,15 +1314,70 @@ bool rai::node_config::upgrade_json (unsigned version, boost::property_tree::ptr
 		tree_a.erase ("version");
 		tree_a.put ("version", "4");
 		result = true;
-		break;
 	case 4:
 		tree_a.erase ("receive_minimum");
 		tree_a.put ("receive_minimum", rai::rai_ratio.convert_to <std::string> ());
 		tree_a.erase ("version");
 		tree_a.put ("version", "5");
 		result = true;
-		break;
 	case 5:
+		tree_a.put ("prune_depth", "0");
+		tree_a.erase ("version");
+		tree_a.put ("version", "6");
+		result = true;
+	case 6:
+		tree_a.put ("network_receivers", std::to_string (network_receivers));
+		tree_a.erase ("version");
+		tree_a.put ("version", "7");
+		result = true;
+	case 7:
+		tree_a.put ("udp_batching", udp_batching);
+		tree_a.erase ("version");
+		tree_a.put ("version", "8");
+		result = true;
+	case 8:
+		tree_a.erase ("packet_delay_microseconds");
+		tree_a.put ("send_rate", std::to_string (send_rate));
+		tree_a.put ("send_burst", std::to_string (send_burst));
+		tree_a.put ("send_peer_rate", std::to_string (send_peer_rate));
+		tree_a.put ("send_peer_burst", std::to_string (send_peer_burst));
+		tree_a.put ("send_max_in_flight", std::to_string (send_max_in_flight));
+		tree_a.erase ("version");
+		tree_a.put ("version", "9");
+		result = true;
+	case 9:
+		tree_a.put ("broadcast_fanout", std::to_string (broadcast_fanout));
+		tree_a.erase ("version");
+		tree_a.put ("version", "10");
+		result = true;
+	case 10:
+		tree_a.put ("realtime_tcp", realtime_tcp);
+		tree_a.put ("realtime_channels_max", std::to_string (realtime_channels_max));
+		tree_a.erase ("version");
+		tree_a.put ("version", "11");
+		result = true;
+	case 11:
+		tree_a.put ("socket_receive_buffer", std::to_string (socket_receive_buffer));
+		tree_a.put ("socket_send_buffer", std::to_string (socket_send_buffer));
+		tree_a.erase ("version");
+		tree_a.put ("version", "12");
+		result = true;
+	case 12:
+		tree_a.put ("vote_bundling", vote_bundling);
+		tree_a.erase ("version");
+		tree_a.put ("version", "13");
+		result = true;
+	case 13:
+		tree_a.put ("latency_probing", latency_probing);
+		tree_a.erase ("version");
+		tree_a.put ("version", "14");
+		result = true;
+	case 14:
+		tree_a.put ("vote_minimum", vote_minimum.to_string_dec ());
+		tree_a.erase ("version");
+		tree_a.put ("version", "15");
+		result = true;
+	case 15:
 		break;
 	default:
 		throw std::runtime_error ("Unknown node_config version");
@@ -744,11 +1404,11 @@ bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree
 		}
 		upgraded_a |= upgrade_json (std::stoull (version_l.get ()), tree_a);
 		auto peering_port_l (tree_a.get <std::string> ("peering_port"));
-		auto packet_delay_microseconds_l (tree_a.get <std::string> ("packet_delay_microseconds"));
 		auto bootstrap_fraction_numerator_l (tree_a.get <std::string> ("bootstrap_fraction_numerator"));
 		auto creation_rebroadcast_l (tree_a.get <std::string> ("creation_rebroadcast"));
 		auto rebroadcast_delay_l (tree_a.get <std::string> ("rebroadcast_delay"));
 		auto receive_minimum_l (tree_a.get <std::string> ("receive_minimum"));
+		auto vote_minimum_l (tree_a.get <std::string> ("vote_minimum"));
 		auto logging_l (tree_a.get_child ("logging"));
 		work_peers.clear ();
 		auto work_peers_l (tree_a.get_child ("work_peers"));
@@ -786,26 +1446,56 @@ bool rai::node_config::deserialize_json (bool & upgraded_a, boost::property_tree
 		auto password_fanout_l (tree_a.get <std::string> ("password_fanout"));
 		auto io_threads_l (tree_a.get <std::string> ("io_threads"));
 		auto work_threads_l (tree_a.get <std::string> ("work_threads"));
+		auto prune_depth_l (tree_a.get <std::string> ("prune_depth"));
+		auto network_receivers_l (tree_a.get <std::string> ("network_receivers"));
+		auto send_rate_l (tree_a.get <std::string> ("send_rate"));
+		auto send_burst_l (tree_a.get <std::string> ("send_burst"));
+		auto send_peer_rate_l (tree_a.get <std::string> ("send_peer_rate"));
+		auto send_peer_burst_l (tree_a.get <std::string> ("send_peer_burst"));
+		auto send_max_in_flight_l (tree_a.get <std::string> ("send_max_in_flight"));
+		auto broadcast_fanout_l (tree_a.get <std::string> ("broadcast_fanout"));
+		auto realtime_channels_max_l (tree_a.get <std::string> ("realtime_channels_max"));
+		auto socket_receive_buffer_l (tree_a.get <std::string> ("socket_receive_buffer"));
+		auto socket_send_buffer_l (tree_a.get <std::string> ("socket_send_buffer"));
 		try
 		{
 			peering_port = std::stoul (peering_port_l);
-			packet_delay_microseconds = std::stoul (packet_delay_microseconds_l);
 			bootstrap_fraction_numerator = std::stoul (bootstrap_fraction_numerator_l);
 			creation_rebroadcast = std::stoul (creation_rebroadcast_l);
 			rebroadcast_delay = std::stoul (rebroadcast_delay_l);
 			password_fanout = std::stoul (password_fanout_l);
 			io_threads = std::stoul (io_threads_l);
 			work_threads = std::stoul (work_threads_l);
+			prune_depth = std::stoul (prune_depth_l);
+			network_receivers = std::stoul (network_receivers_l);
+			send_rate = std::stoul (send_rate_l);
+			send_burst = std::stoul (send_burst_l);
+			send_peer_rate = std::stoul (send_peer_rate_l);
+			send_peer_burst = std::stoul (send_peer_burst_l);
+			send_max_in_flight = std::stoul (send_max_in_flight_l);
+			broadcast_fanout = std::stoul (broadcast_fanout_l);
+			realtime_channels_max = std::stoul (realtime_channels_max_l);
+			socket_receive_buffer = std::stoul (socket_receive_buffer_l);
+			socket_send_buffer = std::stoul (socket_send_buffer_l);
+			udp_batching = tree_a.get <bool> ("udp_batching");
+			realtime_tcp = tree_a.get <bool> ("realtime_tcp");
+			vote_bundling = tree_a.get <bool> ("vote_bundling");
+			latency_probing = tree_a.get <bool> ("latency_probing");
 			result |= creation_rebroadcast > 10;
 			result |= rebroadcast_delay > 300;
 			result |= peering_port > std::numeric_limits <uint16_t>::max ();
 			result |= logging.deserialize_json (logging_l);
 			result |= receive_minimum.decode_dec (receive_minimum_l);
+			result |= vote_minimum.decode_dec (vote_minimum_l);
 			result |= inactive_supply.decode_dec (inactive_supply_l);
 			result |= password_fanout < 16;
 			result |= password_fanout > 1024 * 1024;
 			result |= io_threads == 0;
 			result |= work_threads == 0;
+			result |= network_receivers == 0;
+			result |= send_rate != 0 && send_burst == 0;
+			result |= send_peer_rate != 0 && send_peer_burst == 0;
+			result |= send_max_in_flight == 0;
 		}
 		catch (std::logic_error const &)
 		{
@@ -920,7 +1610,10 @@ network (service_a, config.peering_port, *this),
 bootstrap_initiator (*this),
 bootstrap (service_a, config.peering_port, *this),
 peers (network.endpoint ()),
-application_path (application_path_a)
+application_path (application_path_a),
+vote_bundler (*this),
+confirm_req_batcher (*this),
+block_processor (*this)
 {
 	wallets.observer = [this] (rai::account const & account_a, bool active)
 	{
@@ -938,10 +1631,14 @@ application_path (application_path_a)
 	{
 		this->network.send_keepalive (endpoint_a);
 		this->bootstrap_initiator.warmup (endpoint_a);
+		if (this->config.realtime_tcp)
+		{
+			this->network.realtime.connect (endpoint_a);
+		}
 	});
     observers.add_vote ([this] (rai::vote const & vote_a)
     {
-        active.vote (vote_a);
+        active.vote (vote_a, true);
     });
     observers.add_vote ([this] (rai::vote const & vote_a)
     {
@@ -998,7 +1695,10 @@ void rai::node::send_keepalive (rai::endpoint const & endpoint_a)
 
 void rai::node::vote (rai::vote const & vote_a)
 {
-	observers.call_vote (vote_a);
+	if (!vote_filter.filter (vote_a, weight (vote_a.account)))
+	{
+		observers.call_vote (vote_a);
+	}
 }
 
 rai::gap_cache::gap_cache (rai::node & node_a) :
@@ -1046,138 +1746,767 @@ std::vector <std::unique_ptr <rai::block>> rai::gap_cache::get (rai::block_hash
 void rai::gap_cache::vote (MDB_txn * transaction_a, rai::vote const & vote_a)
 {
     std::lock_guard <std::mutex> lock (mutex);
-    auto hash (vote_a.block->hash ());
-    auto existing (blocks.get <2> ().find (hash));
-    if (existing != blocks.get <2> ().end ())
+	for (auto & hash: vote_a.blocks ())
+	{
+		auto existing (blocks.get <2> ().find (hash));
+		if (existing != blocks.get <2> ().end ())
+		{
+			auto changed (existing->votes->vote (transaction_a, node.store, vote_a, true));
+			if (changed)
+			{
+				auto winner (node.ledger.winner (transaction_a, *existing->votes));
+				if (winner.first > bootstrap_threshold (transaction_a))
+				{
+					auto node_l (node.shared ());
+					auto now (std::chrono::system_clock::now ());
+					node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (10) : now + std::chrono::seconds (5), [node_l, hash] ()
+					{
+						rai::transaction transaction (node_l->store.environment, nullptr, false);
+						if (!node_l->store.block_exists (transaction, hash))
+						{
+							BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%") % hash.to_string ());
+							node_l->bootstrap_initiator.bootstrap_any ();
+						}
+						else
+						{
+							BOOST_LOG (node_l->log) << boost::str (boost::format ("Block: %1% was inserted while voting") % hash.to_string ());
+						}
+					});
+				}
+			}
+		}
+	}
+}
+
+rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
+{
+    auto result ((node.ledger.supply (transaction_a) / 256) * node.config.bootstrap_fraction_numerator);
+	return result;
+}
+
+bool rai::network::confirm_broadcast (std::vector <rai::endpoint> const & list_a, std::unique_ptr <rai::block> block_a, size_t rebroadcast_a)
+{
+    bool result (false);
+	node.wallets.foreach_representative ([&result, &block_a, &list_a, this] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+	{
+		uint64_t sequence;
+		{
+			rai::transaction transaction (this->node.store.environment, nullptr, true);
+			sequence = node.store.sequence_atomic_inc (transaction, pub_a);
+		}
+		auto hash (block_a->hash ());
+		std::shared_ptr <std::vector <uint8_t> const> bytes;
+		for (auto j (list_a.begin ()), m (list_a.end ()); j != m; ++j)
+		{
+			if (!node.peers.knows_about (*j, hash))
+			{
+				if (bytes == nullptr)
+				{
+					// Sign and serialize the vote once for all peers
+					rai::confirm_ack confirm (pub_a, prv_a, sequence, block_a->clone ());
+					bytes = confirm.to_bytes ();
+				}
+				if (node.config.logging.network_publish_logging ())
+				{
+					BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % hash.to_string () % *j);
+				}
+				send_buffer (bytes, *j, 0, rai::send_priority::vote);
+				node.peers.sent (*j, hash);
+				result = true;
+			}
+		}
+	});
+    return result;
+}
+
+void rai::network::confirm_block (rai::raw_key const & prv, rai::public_key const & pub, std::unique_ptr <rai::block> block_a, uint64_t sequence_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a)
+{
+    rai::confirm_ack confirm (pub, prv, sequence_a, std::move (block_a));
+    if (node.config.logging.network_publish_logging ())
     {
-        auto changed (existing->votes->vote (transaction_a, node.store, vote_a));
-        if (changed)
-        {
-            auto winner (node.ledger.winner (transaction_a, *existing->votes));
-            if (winner.first > bootstrap_threshold (transaction_a))
-            {
-				auto node_l (node.shared ());
-				auto now (std::chrono::system_clock::now ());
-				node.alarm.add (rai::rai_network == rai::rai_networks::rai_test_network ? now + std::chrono::milliseconds (10) : now + std::chrono::seconds (5), [node_l, hash] ()
+        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % confirm.vote.block->hash ().to_string () % endpoint_a);
+    }
+    send_buffer (confirm.to_bytes (), endpoint_a, 0, rai::send_priority::vote);
+}
+
+void rai::node::process_receive_republish (std::unique_ptr <rai::block> incoming, size_t rebroadcast_a)
+{
+	std::vector <std::tuple <rai::process_return, std::shared_ptr <rai::block const>>> completed;
+	{
+		rai::transaction transaction (store.environment, nullptr, true);
+		assert (incoming != nullptr);
+		process_receive_republish (transaction, std::move (incoming), rebroadcast_a, completed);
+	}
+	for (auto & i: completed)
+	{
+		observers.call_blocks (*std::get <1> (i), std::get <0> (i).account, std::get <0>(i).amount);
+	}
+}
+
+// Process `block_a' and its dependents, republishing new blocks and collecting them in `completed_a' for the observers once the transaction commits
+void rai::node::process_receive_republish (rai::transaction & transaction_a, std::shared_ptr <rai::block const> block_a, size_t rebroadcast_a, std::vector <std::tuple <rai::process_return, std::shared_ptr <rai::block const>>> & completed_a)
+{
+	process_receive_many (transaction_a, std::move (block_a), [this, rebroadcast_a, &completed_a] (rai::process_return result_a, std::shared_ptr <rai::block const> const & block_a)
+	{
+		switch (result_a.code)
+		{
+			case rai::process_result::progress:
+			{
+				completed_a.push_back (std::make_tuple (result_a, block_a));
+				auto block_l (block_a);
+				auto this_l (this->shared ());
+				this->background ([block_l, this_l, rebroadcast_a] ()
 				{
-					rai::transaction transaction (node_l->store.environment, nullptr, false);
-					if (!node_l->store.block_exists (transaction, hash))
+					this_l->network.republish_block (*block_l, rebroadcast_a);
+				});
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+	});
+}
+
+rai::block_processor_queue::block_processor_queue (size_t capacity_a, size_t peer_max_a) :
+capacity (capacity_a),
+peer_max (peer_max_a),
+drop_count (0)
+{
+}
+
+bool rai::block_processor_queue::push (rai::block_processor_item item_a, std::vector <rai::block_processor_item> & evicted_a)
+{
+	auto result (false);
+	rai::endpoint_key sender (item_a.sender);
+	auto existing (senders.find (sender));
+	if (existing != senders.end () && existing->second >= peer_max && items.size () * 2 >= capacity)
+	{
+		result = true;
+	}
+	else if (items.size () >= capacity)
+	{
+		auto lowest (std::prev (items.end ()));
+		if (lowest->first < item_a.priority)
+		{
+			evicted_a.push_back (std::move (lowest->second));
+			remove (lowest);
+			++drop_count;
+		}
+		else
+		{
+			result = true;
+		}
+	}
+	if (!result)
+	{
+		++senders [sender];
+		auto priority (item_a.priority);
+		items.insert (std::make_pair (priority, std::move (item_a)));
+	}
+	else
+	{
+		++drop_count;
+	}
+	return result;
+}
+
+rai::block_processor_item rai::block_processor_queue::pop ()
+{
+	assert (!items.empty ());
+	auto first (items.begin ());
+	auto result (std::move (first->second));
+	remove (first);
+	return result;
+}
+
+void rai::block_processor_queue::remove (std::multimap <uint64_t, rai::block_processor_item, std::greater <uint64_t>>::iterator item_a)
+{
+	auto sender (senders.find (rai::endpoint_key (item_a->second.sender)));
+	assert (sender != senders.end ());
+	if (--sender->second == 0)
+	{
+		senders.erase (sender);
+	}
+	items.erase (item_a);
+}
+
+bool rai::block_processor_queue::empty () const
+{
+	return items.empty ();
+}
+
+size_t rai::block_processor_queue::size () const
+{
+	return items.size ();
+}
+
+void rai::block_processor_queue::clear ()
+{
+	items.clear ();
+	senders.clear ();
+}
+
+rai::block_processor::block_processor (rai::node & node_a) :
+node (node_a),
+queues ({{
+	{max_size / 4, max_size / 4},
+	{max_size / 4, max_size / 32},
+	{max_size / 4, max_size / 32},
+	{max_size / 4, max_size / 32}
+}}),
+stopped (false),
+active (false),
+processed_count (0),
+drop_count (0),
+latency_total (0),
+latency_max (0),
+thread ([this] () { run (); })
+{
+}
+
+rai::block_processor::~block_processor ()
+{
+	stop ();
+	if (thread.get_id () == std::this_thread::get_id ())
+	{
+		// The processor thread released the last reference to the node as it exited
+		thread.detach ();
+	}
+	else
+	{
+		thread.join ();
+	}
+}
+
+void rai::block_processor::stop ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	stopped = true;
+	for (auto & i: queues)
+	{
+		i.clear ();
+	}
+	condition.notify_all ();
+}
+
+bool rai::block_processor::add (std::unique_ptr <rai::block> block_a, size_t rebroadcast_a, std::function <void ()> const & processed_a)
+{
+	return add (rai::block_processor_item {std::move (block_a), rebroadcast_a, std::chrono::steady_clock::now (), processed_a, rai::block_origin::local, rai::endpoint (), 0});
+}
+
+bool rai::block_processor::add (rai::block_processor_item item_a)
+{
+	auto result (false);
+	std::vector <rai::block_processor_item> evicted;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		if (!stopped)
+		{
+			result = queues [static_cast <size_t> (item_a.origin)].push (std::move (item_a), evicted);
+			if (!result)
+			{
+				condition.notify_all ();
+			}
+		}
+		else
+		{
+			result = true;
+		}
+	}
+	if (result)
+	{
+		++drop_count;
+		if (node.config.logging.network_logging ())
+		{
+			BOOST_LOG (node.log) << "Block processor queue full, dropping block";
+		}
+	}
+	drop_count += evicted.size ();
+	for (auto & i: evicted)
+	{
+		if (i.block != nullptr)
+		{
+			// Let a later copy of the evicted block through the duplicate filter
+			node.recent_blocks.erase (i.block->hash (), i.block->block_work ());
+		}
+	}
+	return result;
+}
+
+rai::recent_blocks::recent_blocks () :
+start (std::chrono::steady_clock::now ()),
+duplicate_count (0)
+{
+	for (auto & i: slots)
+	{
+		i.store (0);
+	}
+}
+
+uint64_t rai::recent_blocks::now ()
+{
+	return std::chrono::duration_cast <std::chrono::seconds> (std::chrono::steady_clock::now () - start).count ();
+}
+
+uint64_t rai::recent_blocks::entry (rai::block_hash const & hash_a, uint64_t work_a, uint64_t now_a)
+{
+	// Copies with different work are distinct so a higher work copy still reaches the ledger
+	auto fingerprint ((hash_a.qwords [1] ^ (work_a * 0x9e3779b97f4a7c15ull)) | (time_mask + 1));
+	return (fingerprint & ~time_mask) | (now_a & time_mask);
+}
+
+bool rai::recent_blocks::check (rai::block_hash const & hash_a, uint64_t work_a)
+{
+	auto now_l (now ());
+	auto expected (entry (hash_a, work_a, now_l));
+	auto existing (slots [hash_a.qwords [0] % slots.size ()].load (std::memory_order_relaxed));
+	auto result ((existing & ~time_mask) == (expected & ~time_mask) && ((now_l - existing) & time_mask) < static_cast <uint64_t> (max_age.count ()));
+	if (result)
+	{
+		++duplicate_count;
+	}
+	return result;
+}
+
+void rai::recent_blocks::insert (rai::block_hash const & hash_a, uint64_t work_a)
+{
+	slots [hash_a.qwords [0] % slots.size ()].store (entry (hash_a, work_a, now ()), std::memory_order_relaxed);
+}
+
+void rai::recent_blocks::erase (rai::block_hash const & hash_a, uint64_t work_a)
+{
+	auto & slot (slots [hash_a.qwords [0] % slots.size ()]);
+	auto existing (slot.load (std::memory_order_relaxed));
+	if ((existing & ~time_mask) == (entry (hash_a, work_a, 0) & ~time_mask))
+	{
+		// Fails harmlessly if another block took the slot meanwhile
+		slot.compare_exchange_strong (existing, 0, std::memory_order_relaxed);
+	}
+}
+
+rai::vote_filter::vote_filter () :
+duplicate_count (0),
+limited_count (0),
+invalid_count (0),
+unweighted_count (0)
+{
+}
+
+rai::uint256_union rai::vote_filter::digest (rai::vote const & vote_a)
+{
+	rai::uint256_union result;
+	auto hash (vote_a.hash ());
+	blake2b_state state;
+	blake2b_init (&state, sizeof (result.bytes));
+	blake2b_update (&state, hash.bytes.data (), sizeof (hash.bytes));
+	blake2b_update (&state, vote_a.signature.bytes.data (), sizeof (vote_a.signature.bytes));
+	blake2b_final (&state, result.bytes.data (), sizeof (result.bytes));
+	return result;
+}
+
+bool rai::vote_filter::limited (rai::vote_filter_entry const & entry_a, rai::uint256_union const & digest_a, std::vector <rai::block_hash> const & roots_a, std::chrono::steady_clock::time_point const & now_a)
+{
+	auto result (false);
+	if (std::find (entry_a.recent.begin (), entry_a.recent.end (), digest_a) != entry_a.recent.end ())
+	{
+		++duplicate_count;
+		result = true;
+	}
+	else if (now_a - entry_a.window_start < window)
+	{
+		result = entry_a.window_votes >= representative_votes;
+		for (auto i (roots_a.begin ()), n (roots_a.end ()); !result && i != n; ++i)
+		{
+			auto votes (entry_a.roots.find (*i));
+			result = votes != entry_a.roots.end () && votes->second >= root_votes;
+		}
+		if (result)
+		{
+			++limited_count;
+		}
+	}
+	return result;
+}
+
+bool rai::vote_filter::filter (rai::vote const & vote_a, rai::uint128_t const & weight_a)
+{
+	auto result (weight_a == 0);
+	if (result)
+	{
+		++unweighted_count;
+	}
+	else
+	{
+		auto digest_l (digest (vote_a));
+		// Votes by hash are limited per block since their roots aren't known
+		auto roots (vote_a.block != nullptr ? std::vector <rai::block_hash> (1, vote_a.block->root ()) : vote_a.hashes);
+		auto now (std::chrono::steady_clock::now ());
+		{
+			std::lock_guard <std::mutex> lock (mutex);
+			auto existing (entries.find (vote_a.account));
+			result = existing != entries.end () && limited (*existing, digest_l, roots, now);
+		}
+		if (!result)
+		{
+			// Only votes with a valid signature count against a representative's limits so forged votes can't exhaust them
+			result = rai::validate_message (vote_a.account, vote_a.hash (), vote_a.signature);
+			if (result)
+			{
+				++invalid_count;
+			}
+			else
+			{
+				// Check again under the lock that updates the entry since other votes may have been accepted while validating
+				std::lock_guard <std::mutex> lock (mutex);
+				auto existing (entries.find (vote_a.account));
+				if (existing == entries.end ())
+				{
+					existing = entries.insert (rai::vote_filter_entry {vote_a.account, now, {}, 0, now, 0, {}, 0.0}).first;
+					if (entries.size () > max_entries)
 					{
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Missing confirmed block %1%") % hash.to_string ());
-						node_l->bootstrap_initiator.bootstrap_any ();
+						entries.get <1> ().erase (entries.get <1> ().begin ());
 					}
-					else
+				}
+				else
+				{
+					result = limited (*existing, digest_l, roots, now);
+				}
+				if (!result)
+				{
+					entries.modify (existing, [&digest_l, &roots, &now] (rai::vote_filter_entry & entry_a)
 					{
-						BOOST_LOG (node_l->log) << boost::str (boost::format ("Block: %1% was inserted while voting") % hash.to_string ());
-					}
-				});
-            }
-        }
-    }
+						auto elapsed (now - entry_a.window_start);
+						if (elapsed >= window)
+						{
+							// Windows without any votes count as zero
+							auto windows (std::chrono::duration_cast <std::chrono::duration <double>> (elapsed) / window);
+							auto current (entry_a.window_votes / std::chrono::duration_cast <std::chrono::duration <double>> (window).count ());
+							entry_a.rate = (entry_a.rate * 7 + current) / 8 * std::pow (7.0 / 8, windows - 1);
+							entry_a.window_start = now;
+							entry_a.window_votes = 0;
+							entry_a.roots.clear ();
+						}
+						entry_a.last = now;
+						entry_a.recent [entry_a.recent_next] = digest_l;
+						entry_a.recent_next = (entry_a.recent_next + 1) % entry_a.recent.size ();
+						++entry_a.window_votes;
+						for (auto & i: roots)
+						{
+							++entry_a.roots [i];
+						}
+					});
+				}
+			}
+		}
+	}
+	return result;
 }
 
-rai::uint128_t rai::gap_cache::bootstrap_threshold (MDB_txn * transaction_a)
+std::vector <std::pair <rai::account, double>> rai::vote_filter::rates (size_t count_a)
 {
-    auto result ((node.ledger.supply (transaction_a) / 256) * node.config.bootstrap_fraction_numerator);
+	std::vector <std::pair <rai::account, double>> result;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		for (auto & i: entries)
+		{
+			result.push_back (std::make_pair (i.account, i.rate));
+		}
+	}
+	std::sort (result.begin (), result.end (), [] (std::pair <rai::account, double> const & lhs, std::pair <rai::account, double> const & rhs)
+	{
+		return lhs.second > rhs.second;
+	});
+	result.resize (std::min (result.size (), count_a));
 	return result;
 }
 
-bool rai::network::confirm_broadcast (std::vector <rai::peer_information> & list_a, std::unique_ptr <rai::block> block_a, size_t rebroadcast_a)
+size_t rai::vote_filter::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return entries.size ();
+}
+
+rai::vote_bundler::vote_bundler (rai::node & node_a) :
+node (node_a),
+scheduled (false),
+signature_count (0),
+hash_count (0)
+{
+}
+
+void rai::vote_bundler::add (rai::block_hash const & hash_a, rai::endpoint const & endpoint_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (remote [rai::endpoint_key (endpoint_a)].insert (hash_a).second)
+	{
+		schedule ();
+	}
+}
+
+void rai::vote_bundler::schedule ()
+{
+	if (!scheduled)
+	{
+		scheduled = true;
+		auto node_l (node.shared ());
+		node.alarm.add (std::chrono::system_clock::now () + delay, [node_l] ()
+		{
+			node_l->vote_bundler.flush ();
+		});
+	}
+}
+
+void rai::vote_bundler::flush ()
+{
+	std::unordered_map <rai::endpoint_key, std::unordered_set <rai::block_hash>> remote_l;
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		remote_l.swap (remote);
+		scheduled = false;
+	}
+	std::vector <std::pair <rai::public_key, rai::raw_key>> representatives;
+	node.wallets.foreach_representative ([&representatives] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+	{
+		representatives.push_back (std::make_pair (pub_a, prv_a));
+	});
+	size_t chunks (0);
+	for (auto & i: remote_l)
+	{
+		chunks += (i.second.size () + rai::vote::hashes_max - 1) / rai::vote::hashes_max;
+	}
+	// Every representative signs one vote per chunk, their sequence numbers are all taken in one write transaction
+	std::vector <uint64_t> sequences;
+	if (chunks > 0 && !representatives.empty ())
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		for (auto & i: representatives)
+		{
+			for (size_t j (0); j < chunks; ++j)
+			{
+				sequences.push_back (node.store.sequence_atomic_inc (transaction, i.first));
+			}
+		}
+	}
+	auto sequence (sequences.begin ());
+	for (auto & i: representatives)
+	{
+		for (auto & j: remote_l)
+		{
+			auto endpoint (j.first.endpoint ());
+			std::vector <rai::block_hash> hashes (j.second.begin (), j.second.end ());
+			for (auto k (hashes.begin ()), n (hashes.end ()); k != n;)
+			{
+				auto end (k + std::min <size_t> (n - k, rai::vote::hashes_max));
+				assert (sequence != sequences.end ());
+				rai::confirm_ack confirm (i.first, i.second, *sequence, std::vector <rai::block_hash> (k, end));
+				++sequence;
+				++signature_count;
+				hash_count += end - k;
+				if (node.config.logging.network_message_logging ())
+				{
+					BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for %1% blocks to %2%") % confirm.vote.hashes.size () % endpoint);
+				}
+				node.network.send_buffer (confirm.to_bytes (), endpoint, 0, rai::send_priority::vote);
+				k = end;
+			}
+		}
+	}
+}
+
+rai::confirm_req_batcher::confirm_req_batcher (rai::node & node_a) :
+node (node_a),
+scheduled (false),
+request_count (0)
+{
+}
+
+void rai::confirm_req_batcher::add (rai::block const & block_a)
+{
+	if (node.config.vote_bundling)
+	{
+		std::lock_guard <std::mutex> lock (mutex);
+		pending.push_back (std::make_pair (block_a.root (), block_a.hash ()));
+		schedule ();
+	}
+	else
+	{
+		node.network.broadcast_confirm_req (block_a);
+	}
+}
+
+void rai::confirm_req_batcher::schedule ()
+{
+	if (!scheduled)
+	{
+		scheduled = true;
+		auto node_l (node.shared ());
+		node.alarm.add (std::chrono::system_clock::now () + delay, [node_l] ()
+		{
+			node_l->confirm_req_batcher.flush ();
+		});
+	}
+}
+
+void rai::confirm_req_batcher::flush ()
 {
-    bool result (false);
-	node.wallets.foreach_representative ([&result, &block_a, &list_a, this, rebroadcast_a] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
+	std::vector <std::pair <rai::block_hash, rai::block_hash>> pending_l;
 	{
-		uint64_t sequence;
-		{
-			rai::transaction transaction (this->node.store.environment, nullptr, true);
-			sequence = node.store.sequence_atomic_inc (transaction, pub_a);
-		}
-		auto hash (block_a->hash ());
-		for (auto j (list_a.begin ()), m (list_a.end ()); j != m; ++j)
+		std::lock_guard <std::mutex> lock (mutex);
+		pending_l.swap (pending);
+		scheduled = false;
+	}
+	// Only representatives that receive a request answer it, so like broadcast_confirm_req every peer is asked
+	auto list (node.peers.fanout (std::numeric_limits <size_t>::max ()));
+	for (auto i (pending_l.begin ()), n (pending_l.end ()); i != n;)
+	{
+		auto end (i + std::min <size_t> (n - i, rai::confirm_req::roots_hashes_max));
+		rai::confirm_req message (std::vector <std::pair <rai::block_hash, rai::block_hash>> (i, end));
+		auto bytes (message.to_bytes ());
+		++request_count;
+		for (auto & j: list)
 		{
-			if (!node.peers.knows_about (j->endpoint, hash))
+			if (node.config.logging.network_logging ())
 			{
-				confirm_block (prv_a, pub_a, block_a->clone (), sequence, j->endpoint, rebroadcast_a);
-				result = true;
+				BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm req for %1% blocks to %2%") % message.roots_hashes.size () % j);
 			}
+			node.network.send_buffer (bytes, j, 0, rai::send_priority::confirm_req);
 		}
-	});
-    return result;
+		i = end;
+	}
 }
 
-void rai::network::confirm_block (rai::raw_key const & prv, rai::public_key const & pub, std::unique_ptr <rai::block> block_a, uint64_t sequence_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a)
+void rai::block_processor::flush ()
 {
-    rai::confirm_ack confirm (pub, prv, sequence_a, std::move (block_a));
-    std::shared_ptr <std::vector <uint8_t>> bytes (new std::vector <uint8_t>);
-    {
-        rai::vectorstream stream (*bytes);
-        confirm.serialize (stream);
-    }
-    if (node.config.logging.network_publish_logging ())
-    {
-        BOOST_LOG (node.log) << boost::str (boost::format ("Sending confirm_ack for block %1% to %2%") % confirm.vote.block->hash ().to_string () % endpoint_a);
-    }
-    auto node_l (node.shared ());
-    node.network.send_buffer (bytes->data (), bytes->size (), endpoint_a, 0, [bytes, node_l, endpoint_a] (boost::system::error_code const & ec, size_t size_a)
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped && (size_locked () != 0 || active))
 	{
-		if (node_l->config.logging.network_logging ())
-		{
-			if (ec)
-			{
-				BOOST_LOG (node_l->log) << boost::str (boost::format ("Error broadcasting confirm_ack to %1%: %2%") % endpoint_a % ec.message ());
-			}
-		}
-	});
+		condition.wait (lock);
+	}
 }
 
-void rai::node::process_receive_republish (std::unique_ptr <rai::block> incoming, size_t rebroadcast_a)
+size_t rai::block_processor::size ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	return size_locked ();
+}
+
+size_t rai::block_processor::size_locked ()
 {
-	std::vector <std::tuple <rai::process_return, std::unique_ptr <rai::block>>> completed;
+	size_t result (0);
+	for (auto & i: queues)
 	{
-		rai::transaction transaction (store.environment, nullptr, true);
-		assert (incoming != nullptr);
-		process_receive_many (transaction, *incoming, [this, rebroadcast_a, &completed] (rai::process_return result_a, rai::block const & block_a)
+		result += i.size ();
+	}
+	return result;
+}
+
+void rai::block_processor::run ()
+{
+	// Callbacks can hold the last reference to the node, this one keeps releasing a batch from running ~node until the thread is done
+	std::shared_ptr <rai::node> node_l;
+	std::deque <rai::block_processor_item> batch;
+	std::unique_lock <std::mutex> lock (mutex);
+	while (!stopped)
+	{
+		if (size_locked () != 0)
 		{
-			switch (result_a.code)
+			if (node_l == nullptr)
+			{
+				node_l = node.shared ();
+			}
+			// Every queue gets an equal share of the batch before the remainder is filled in drain order
+			for (auto & i: queues)
 			{
-				case rai::process_result::progress:
+				for (size_t j (0); j < batch_size / queues.size () && !i.empty (); ++j)
 				{
-					completed.push_back (std::make_tuple (result_a, block_a.clone ()));
-					std::shared_ptr <rai::block> block_l (block_a.clone ().release ());
-					auto this_l (this->shared ());
-					this->background ([block_l, this_l, rebroadcast_a] ()
-					{
-						this_l->network.republish_block (*block_l, rebroadcast_a);
-					});
-					break;
+					batch.push_back (i.pop ());
 				}
-				default:
+			}
+			for (auto & i: queues)
+			{
+				while (batch.size () < batch_size && !i.empty ())
 				{
-					break;
+					batch.push_back (i.pop ());
 				}
 			}
-		});
+			active = true;
+			lock.unlock ();
+			process_batch (batch);
+			batch.clear ();
+			lock.lock ();
+			active = false;
+			condition.notify_all ();
+		}
+		else
+		{
+			condition.wait (lock);
+		}
+	}
+	lock.unlock ();
+	// Nothing is touched after this, it may run ~node on this thread
+	node_l.reset ();
+}
+
+void rai::block_processor::process_batch (std::deque <rai::block_processor_item> & batch_a)
+{
+	std::vector <std::tuple <rai::process_return, std::shared_ptr <rai::block const>>> completed;
+	{
+		rai::transaction transaction (node.store.environment, nullptr, true);
+		auto now (std::chrono::steady_clock::now ());
+		for (auto & i: batch_a)
+		{
+			uint64_t latency (std::chrono::duration_cast <std::chrono::microseconds> (now - i.arrival).count ());
+			latency_total += latency;
+			auto max (latency_max.load ());
+			while (latency > max && !latency_max.compare_exchange_weak (max, latency))
+			{
+			}
+			if (i.block != nullptr)
+			{
+				node.process_receive_republish (transaction, i.block, i.rebroadcast, completed);
+				++processed_count;
+			}
+		}
 	}
 	for (auto & i: completed)
 	{
-		observers.call_blocks (*std::get <1> (i), std::get <0> (i).account, std::get <0>(i).amount);
+		node.observers.call_blocks (*std::get <1> (i), std::get <0> (i).account, std::get <0>(i).amount);
+	}
+	for (auto & i: batch_a)
+	{
+		if (i.processed)
+		{
+			i.processed ();
+		}
 	}
 }
 
 void rai::node::process_receive_many (rai::transaction & transaction_a, rai::block const & block_a, std::function <void (rai::process_return, rai::block const &)> completed_a)
 {
-	std::vector <std::unique_ptr <rai::block>> blocks;
-	blocks.push_back (block_a.clone ());
+	process_receive_many (transaction_a, std::shared_ptr <rai::block const> (block_a.clone ()), [&completed_a] (rai::process_return result_a, std::shared_ptr <rai::block const> const & block_a)
+	{
+		completed_a (result_a, *block_a);
+	});
+}
+
+// Blocks are shared with the caller and the gap cache entries they release instead of being copied
+void rai::node::process_receive_many (rai::transaction & transaction_a, std::shared_ptr <rai::block const> block_a, std::function <void (rai::process_return, std::shared_ptr <rai::block const> const &)> const & completed_a)
+{
+	std::vector <std::shared_ptr <rai::block const>> blocks;
+	blocks.push_back (std::move (block_a));
     while (!blocks.empty ())
     {
 		auto block (std::move (blocks.back ()));
 		blocks.pop_back ();
         auto hash (block->hash ());
         auto process_result (process_receive_one (transaction_a, *block));
-		completed_a (process_result, *block);
-		auto cached (gap_cache.get (hash));
-		blocks.resize (blocks.size () + cached.size ());
-		std::move (cached.begin (), cached.end (), blocks.end () - cached.size ());
+		completed_a (process_result, block);
+		for (auto & i: gap_cache.get (hash))
+		{
+			blocks.push_back (std::move (i));
+		}
     }
 }
 
@@ -1307,31 +2636,121 @@ rai::process_return rai::node::process (rai::block const & block_a)
 std::vector <rai::peer_information> rai::peer_container::list ()
 {
     std::vector <rai::peer_information> result;
-    std::lock_guard <std::mutex> lock (mutex);
-    result.reserve (peers.size ());
-    for (auto i (peers.begin ()), j (peers.end ()); i != j; ++i)
+    auto snapshot_l (snapshot ());
+    result.reserve (snapshot_l->peers.size ());
+    for (auto & i: snapshot_l->peers)
     {
-        result.push_back (*i);
+        result.push_back (i.second);
     }
 	std::random_shuffle (result.begin (), result.end ());
     return result;
 }
 
+std::vector <rai::endpoint> rai::peer_container::fanout (size_t count_a)
+{
+    std::lock_guard <std::mutex> lock (mutex);
+	auto now (std::chrono::steady_clock::now ());
+	if (permutation.size () != peers.size () || now >= permutation_refresh)
+	{
+		permutation.clear ();
+		permutation.reserve (peers.size ());
+		for (auto & i: peers)
+		{
+			permutation.push_back (i.endpoint);
+		}
+		std::random_shuffle (permutation.begin (), permutation.end ());
+		permutation_position = 0;
+		permutation_refresh = now + permutation_period;
+	}
+	std::vector <rai::endpoint> result;
+	auto count (std::min (count_a, permutation.size ()));
+	result.reserve (count);
+	for (size_t i (0); i < count; ++i)
+	{
+		result.push_back (permutation [(permutation_position + i) % permutation.size ()]);
+	}
+	if (!permutation.empty ())
+	{
+		// Rotate so successive broadcasts spread over every peer
+		permutation_position = (permutation_position + count) % permutation.size ();
+	}
+	return result;
+}
+
 std::vector <rai::peer_information> rai::peer_container::bootstrap_candidates ()
 {
     std::vector <rai::peer_information> result;
-    std::lock_guard <std::mutex> lock (mutex);
+    auto snapshot_l (snapshot ());
 	auto now (std::chrono::system_clock::now ());
-    for (auto i (peers.begin ()), j (peers.end ()); i != j; ++i)
+    for (auto & i: snapshot_l->peers)
     {
-		if (now - i->last_bootstrap_failure > std::chrono::minutes (15))
+		if (now - i.second.last_bootstrap_failure > std::chrono::minutes (15))
 		{
-			result.push_back (*i);
+			result.push_back (i.second);
 		}
     }
+	// Unmeasured peers go last in random order
+	std::random_shuffle (result.begin (), result.end ());
+	std::stable_sort (result.begin (), result.end (), [] (rai::peer_information const & lhs, rai::peer_information const & rhs)
+	{
+		return score (lhs) < score (rhs);
+	});
     return result;
 }
 void rai::node::process_confirmation (rai::block const & block_a, rai::endpoint const & sender)
+{
+	if (config.vote_bundling)
+	{
+		vote_bundler.add (block_a.hash (), sender);
+	}
+	else
+	{
+		send_votes (block_a, sender);
+	}
+}
+
+// Answer a request by hash, blocks we have are voted for by hash and a different block we have for the root is sent in full since the requester lacks it
+void rai::node::process_confirmation (std::vector <std::pair <rai::block_hash, rai::block_hash>> const & roots_hashes_a, rai::endpoint const & sender)
+{
+	std::vector <std::shared_ptr <rai::block const>> forks;
+	{
+		rai::transaction transaction (store.environment, nullptr, false);
+		for (auto & i: roots_hashes_a)
+		{
+			if (store.block_exists (transaction, i.second))
+			{
+				vote_bundler.add (i.second, sender);
+			}
+			else
+			{
+				rai::block_hash successor;
+				rai::account_info info;
+				if (!store.account_get (transaction, i.first, info))
+				{
+					successor = info.open_block;
+				}
+				else
+				{
+					successor = store.block_successor (transaction, i.first);
+				}
+				if (!successor.is_zero ())
+				{
+					auto block (store.block_get_shared (transaction, successor));
+					if (block != nullptr)
+					{
+						forks.push_back (block);
+					}
+				}
+			}
+		}
+	}
+	for (auto & i: forks)
+	{
+		send_votes (*i, sender);
+	}
+}
+
+void rai::node::send_votes (rai::block const & block_a, rai::endpoint const & sender)
 {
 	wallets.foreach_representative ([this, &block_a, &sender] (rai::public_key const & pub_a, rai::raw_key const & prv_a)
 	{
@@ -1426,18 +2845,28 @@ void rai::node::start ()
 {
     network.receive ();
     ongoing_keepalive ();
+	ongoing_peer_publish ();
     bootstrap.start ();
 	backup_wallet ();
 	active.announce_votes ();
+	if (config.prune_depth != 0)
+	{
+		ongoing_prune ();
+	}
 }
 
 void rai::node::stop ()
 {
     BOOST_LOG (log) << "Node stopping";
-	active.roots.clear ();
+	{
+		std::lock_guard <std::mutex> lock (active.mutex);
+		active.roots.clear ();
+		active.blocks.clear ();
+	}
     network.stop ();
 	bootstrap_initiator.stop ();
     bootstrap.stop ();
+	block_processor.stop ();
 }
 
 void rai::node::keepalive_preconfigured (std::vector <std::string> const & peers_a)
@@ -1486,6 +2915,15 @@ void rai::node::ongoing_keepalive ()
     {
         network.send_keepalive (i->endpoint);
     }
+	if (config.realtime_tcp)
+	{
+		// Reconnect channels that closed since the last period
+		for (auto & i: peers_l)
+		{
+			network.realtime.connect (i.endpoint);
+		}
+		network.realtime.close_idle (std::chrono::steady_clock::now () - rai::realtime_channels::idle_timeout);
+	}
 	auto node_l (shared_from_this ());
     alarm.add (std::chrono::system_clock::now () + period, [node_l] () { node_l->ongoing_keepalive ();});
 }
@@ -1506,6 +2944,48 @@ void rai::node::backup_wallet ()
 	});
 }
 
+void rai::node::ongoing_prune ()
+{
+	size_t pruned (0);
+	rai::account start (0);
+	auto done (false);
+	while (!done)
+	{
+		// Prune in batches of accounts so block processing isn't held off by one long write transaction
+		rai::transaction transaction (store.environment, nullptr, true);
+		auto i (store.latest_begin (transaction, start));
+		auto n (store.latest_end ());
+		rai::account last (0);
+		for (size_t j (0); j < prune_batch && i != n; ++j, ++i)
+		{
+			last = rai::account (i->first);
+			pruned += ledger.prune (transaction, last, config.prune_depth);
+		}
+		done = i == n;
+		// latest_begin is inclusive, resume after the last account pruned
+		start = last.number () + 1;
+	}
+	if (config.logging.ledger_logging ())
+	{
+		BOOST_LOG (log) << boost::str (boost::format ("Pruned %1% blocks") % pruned);
+	}
+	auto this_l (shared ());
+	alarm.add (std::chrono::system_clock::now () + prune_interval, [this_l] ()
+	{
+		this_l->ongoing_prune ();
+	});
+}
+
+void rai::node::ongoing_peer_publish ()
+{
+	peers.publish_dirty ();
+	auto this_l (shared ());
+	alarm.add (std::chrono::system_clock::now () + peer_publish_interval, [this_l] ()
+	{
+		this_l->ongoing_peer_publish ();
+	});
+}
+
 int rai::node::price (rai::uint128_t const & balance_a, int amount_a)
 {
 	assert (balance_a >= amount_a * rai::Grai_ratio);
@@ -1794,40 +3274,39 @@ rai::endpoint rai::network::endpoint ()
 void rai::peer_container::bootstrap_failed (rai::endpoint const & endpoint_a)
 {
 	std::lock_guard <std::mutex> lock (mutex);
-	auto existing (peers.find (endpoint_a));
+	auto existing (peers.find (rai::endpoint_key (endpoint_a)));
 	if (existing != peers.end ())
 	{
 		peers.modify (existing, [] (rai::peer_information & info_a)
 		{
 			info_a.last_bootstrap_failure = std::chrono::system_clock::now ();
 		});
+		publish ();
 	}
 }
 
 void rai::peer_container::random_fill (std::array <rai::endpoint, 8> & target_a)
 {
-    auto peers (list ());
-    while (peers.size () > target_a.size ())
-    {
-        auto index (random_pool.GenerateWord32 (0, peers.size () - 1));
-        assert (index < peers.size ());
-		assert (index >= 0);
-		if (index != peers.size () - 1)
-		{
-				peers [index] = peers [peers.size () - 1];
-		}
-        peers.pop_back ();
-    }
-    assert (peers.size () <= target_a.size ());
+    auto snapshot_l (snapshot ());
+    auto & endpoints (snapshot_l->endpoints);
     auto endpoint (rai::endpoint (boost::asio::ip::address_v6 {}, 0));
     assert (endpoint.address ().is_v6 ());
     std::fill (target_a.begin (), target_a.end (), endpoint);
-    auto j (target_a.begin ());
-    for (auto i (peers.begin ()), n (peers.end ()); i != n; ++i, ++j)
+    // Floyd's sampling picks distinct indices with one random draw each instead of copying and shuffling every peer
+    std::array <size_t, 8> chosen;
+    size_t count (0);
+    auto n (endpoints.size ());
+    for (auto j (n - std::min (n, target_a.size ())); j < n; ++j)
     {
-        assert (i->endpoint.address ().is_v6 ());
-        assert (j < target_a.end ());
-        *j = i->endpoint;
+        size_t index (random_pool.GenerateWord32 (0, j));
+        if (std::find (chosen.begin (), chosen.begin () + count, index) != chosen.begin () + count)
+        {
+            index = j;
+        }
+        chosen [count] = index;
+        assert (endpoints [index].address ().is_v6 ());
+        target_a [count] = endpoints [index];
+        ++count;
     }
 }
 
@@ -1843,6 +3322,7 @@ std::vector <rai::peer_information> rai::peer_container::purge_list (std::chrono
 		{
 			peers.modify (i, [] (rai::peer_information & info) {info.last_attempt = std::chrono::system_clock::now ();});
 		}
+		publish ();
 	}
 	if (result.empty ())
 	{
@@ -1853,8 +3333,57 @@ std::vector <rai::peer_information> rai::peer_container::purge_list (std::chrono
 
 size_t rai::peer_container::size ()
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    return peers.size ();
+    return snapshot ()->peers.size ();
+}
+
+std::shared_ptr <rai::peer_snapshot const> rai::peer_container::snapshot ()
+{
+	return std::atomic_load (&current);
+}
+
+void rai::peer_container::publish ()
+{
+	auto snapshot_l (std::make_shared <rai::peer_snapshot> ());
+	snapshot_l->peers.reserve (peers.size ());
+	snapshot_l->endpoints.reserve (peers.size ());
+	std::vector <std::pair <double, rai::endpoint>> measured;
+	for (auto & i: peers)
+	{
+		snapshot_l->peers.insert (std::make_pair (i.key, i));
+		snapshot_l->endpoints.push_back (i.endpoint);
+		if (i.rtt >= 0.0)
+		{
+			measured.push_back (std::make_pair (score (i), i.endpoint));
+		}
+	}
+	// Ranked once here instead of on every republish
+	std::sort (measured.begin (), measured.end (), [] (std::pair <double, rai::endpoint> const & lhs, std::pair <double, rai::endpoint> const & rhs)
+	{
+		return lhs.first < rhs.first;
+	});
+	snapshot_l->preferred.reserve (measured.size ());
+	for (auto & i: measured)
+	{
+		snapshot_l->preferred.push_back (i.second);
+	}
+	std::atomic_store (&current, std::shared_ptr <rai::peer_snapshot const> (snapshot_l));
+	dirty = false;
+	published = std::chrono::steady_clock::now ();
+}
+
+void rai::peer_container::refresh ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	publish ();
+}
+
+void rai::peer_container::publish_dirty ()
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (dirty)
+	{
+		publish ();
+	}
 }
 
 bool rai::peer_container::empty ()
@@ -1887,38 +3416,183 @@ bool rai::peer_container::insert (rai::endpoint const & endpoint_a)
 
 bool rai::peer_container::knows_about (rai::endpoint const & endpoint_a, rai::block_hash const & hash_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
     bool result (false);
-    auto existing (peers.find (endpoint_a));
-    if (existing != peers.end ())
+    auto snapshot_l (snapshot ());
+    auto existing (snapshot_l->peers.find (rai::endpoint_key (endpoint_a)));
+    if (existing != snapshot_l->peers.end ())
     {
-        result = existing->most_recent == hash_a;
+		// Only peers we track are counted, the send stats shouldn't include endpoints with no filter
+		if (existing->second.known != nullptr)
+		{
+			result = existing->second.known->contains (hash_a);
+		}
+		if (result)
+		{
+			++known_suppressed_count;
+		}
+		else
+		{
+			++known_sent_count;
+		}
     }
     return result;
 }
 
+void rai::peer_container::sent (rai::endpoint const & endpoint_a, rai::block_hash const & hash_a)
+{
+    auto snapshot_l (snapshot ());
+    auto existing (snapshot_l->peers.find (rai::endpoint_key (endpoint_a)));
+    if (existing != snapshot_l->peers.end () && existing->second.known != nullptr)
+    {
+        existing->second.known->insert (hash_a);
+    }
+}
+
+double rai::peer_container::known_false_positive_rate ()
+{
+	double result (0.0);
+	auto snapshot_l (snapshot ());
+	for (auto & i: snapshot_l->peers)
+	{
+		if (i.second.known != nullptr)
+		{
+			result += i.second.known->false_positive_rate ();
+		}
+	}
+	if (!snapshot_l->peers.empty ())
+	{
+		result /= snapshot_l->peers.size ();
+	}
+	return result;
+}
+
+uint64_t rai::peer_container::probe (rai::endpoint const & endpoint_a)
+{
+	uint64_t result (0);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (peers.find (rai::endpoint_key (endpoint_a)));
+	if (existing != peers.end ())
+	{
+		auto now (std::chrono::steady_clock::now ());
+		if (existing->probe_nonce != 0 && now - existing->probe_sent < probe_timeout)
+		{
+			// Still waiting on the last one
+			result = existing->probe_nonce;
+		}
+		else
+		{
+			while (result == 0)
+			{
+				result = (static_cast <uint64_t> (random_pool.GenerateWord32 ()) << 32) | random_pool.GenerateWord32 ();
+			}
+			peers.modify (existing, [result, now] (rai::peer_information & info_a)
+			{
+				if (info_a.probe_nonce != 0)
+				{
+					info_a.loss += probe_weight * (1.0 - info_a.loss);
+				}
+				info_a.probe_nonce = result;
+				info_a.probe_sent = now;
+			});
+			dirty = true;
+		}
+	}
+	return result;
+}
+
+bool rai::peer_container::probe_reply (rai::endpoint const & endpoint_a, uint64_t nonce_a)
+{
+	auto result (true);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto existing (peers.find (rai::endpoint_key (endpoint_a)));
+	if (existing != peers.end () && nonce_a != 0 && existing->probe_nonce == nonce_a)
+	{
+		result = false;
+		auto sample (std::chrono::duration <double, std::milli> (std::chrono::steady_clock::now () - existing->probe_sent).count ());
+		peers.modify (existing, [sample] (rai::peer_information & info_a)
+		{
+			info_a.rtt = info_a.rtt < 0.0 ? sample : info_a.rtt + probe_weight * (sample - info_a.rtt);
+			info_a.loss -= probe_weight * info_a.loss;
+			info_a.probe_nonce = 0;
+		});
+		// Answers arrive about once per keepalive period per peer, cheap enough to show at once
+		publish ();
+	}
+	return result;
+}
+
+std::vector <rai::endpoint> rai::peer_container::preferred (size_t count_a)
+{
+	auto snapshot_l (snapshot ());
+	auto count (std::min (count_a, snapshot_l->preferred.size ()));
+	return std::vector <rai::endpoint> (snapshot_l->preferred.begin (), snapshot_l->preferred.begin () + count);
+}
+
+double rai::peer_container::score (rai::peer_information const & peer_a)
+{
+	auto result (std::numeric_limits <double>::infinity ());
+	if (peer_a.rtt >= 0.0)
+	{
+		// A lost message costs roughly another round trip
+		result = peer_a.rtt / std::max (0.05, 1.0 - peer_a.loss);
+	}
+	return result;
+}
+
 bool rai::peer_container::insert (rai::endpoint const & endpoint_a, rai::block_hash const & hash_a)
 {
 	auto unknown (false);
     auto result (not_a_peer (endpoint_a));
     if (!result)
     {
-        std::lock_guard <std::mutex> lock (mutex);
-        auto existing (peers.find (endpoint_a));
-        if (existing != peers.end ())
-        {
-            peers.modify (existing, [&hash_a] (rai::peer_information & info)
-            {
-                info.last_contact = std::chrono::system_clock::now ();
-                info.most_recent = hash_a;
-            });
-            result = true;
-        }
-        else
-        {
-            peers.insert ({endpoint_a, std::chrono::system_clock::now (), std::chrono::system_clock::now (), std::chrono::system_clock::time_point (), hash_a});
-			unknown = true;
-        }
+		auto now (std::chrono::system_clock::now ());
+		std::shared_ptr <rai::rolling_bloom> known;
+		auto snapshot_l (snapshot ());
+		auto existing (snapshot_l->peers.find (rai::endpoint_key (endpoint_a)));
+		if (existing != snapshot_l->peers.end () && existing->second.known != nullptr && now - existing->second.last_contact < contact_interval)
+		{
+			// Heard from recently, nothing to write
+			known = existing->second.known;
+			result = true;
+		}
+		else
+		{
+			++locked_count;
+			std::lock_guard <std::mutex> lock (mutex);
+			auto visible (false);
+			auto existing_l (peers.find (rai::endpoint_key (endpoint_a)));
+			if (existing_l != peers.end ())
+			{
+				// Coming back from past the cutoff changes what known_peer reports
+				visible = existing_l->last_contact <= now - rai::node::cutoff;
+				peers.modify (existing_l, [&now] (rai::peer_information & info)
+				{
+					info.last_contact = now;
+					if (info.known == nullptr)
+					{
+						info.known = std::make_shared <rai::rolling_bloom> ();
+					}
+				});
+				result = true;
+			}
+			else
+			{
+				existing_l = peers.insert ({endpoint_a, now, now, std::chrono::system_clock::time_point (), std::make_shared <rai::rolling_bloom> ()}).first;
+				unknown = true;
+				visible = true;
+			}
+			known = existing_l->known;
+			dirty = true;
+			// New or expired peers are visible at once, contact refreshes are batched into the next publish
+			if (visible || std::chrono::steady_clock::now () - published >= publish_interval)
+			{
+				publish ();
+			}
+		}
+		if (!hash_a.is_zero ())
+		{
+			known->insert (hash_a);
+		}
     }
 	if (unknown && !result)
 	{
@@ -1966,11 +3640,82 @@ bool rai::reserved_address (rai::endpoint const & endpoint_a)
 	return result;
 }
 
+rai::peer_information::peer_information (rai::endpoint const & endpoint_a, std::chrono::system_clock::time_point const & last_contact_a, std::chrono::system_clock::time_point const & last_attempt_a, std::chrono::system_clock::time_point const & last_bootstrap_failure_a, std::shared_ptr <rai::rolling_bloom> known_a) :
+endpoint (endpoint_a),
+key (endpoint_a),
+last_contact (last_contact_a),
+last_attempt (last_attempt_a),
+last_bootstrap_failure (last_bootstrap_failure_a),
+known (known_a),
+rtt (-1.0),
+loss (0.0),
+probe_nonce (0)
+{
+}
+
 rai::peer_container::peer_container (rai::endpoint const & self_a) :
 self (self_a),
 peer_observer ([] (rai::endpoint const &) {}),
-disconnect_observer ([] () {})
+disconnect_observer ([] () {}),
+current (std::make_shared <rai::peer_snapshot> ()),
+dirty (false),
+locked_count (0),
+permutation_position (0),
+known_suppressed_count (0),
+known_sent_count (0)
+{
+}
+
+rai::rolling_bloom::rolling_bloom () :
+current (0),
+count (0)
+{
+}
+
+void rai::rolling_bloom::insert (rai::block_hash const & hash_a)
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	if (count >= capacity)
+	{
+		// Drop the older generation, it becomes the one we fill
+		current = 1 - current;
+		generations [current].reset ();
+		count = 0;
+	}
+	auto & bits (generations [current]);
+	// Block hashes are uniformly distributed so each word indexes the filter directly
+	for (size_t i (0); i < hashes; ++i)
+	{
+		bits.set (hash_a.qwords [i] % bits.size ());
+	}
+	++count;
+}
+
+bool rai::rolling_bloom::contains (rai::block_hash const & hash_a) const
+{
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (false);
+	for (auto i (generations.begin ()), n (generations.end ()); i != n && !result; ++i)
+	{
+		result = true;
+		for (size_t j (0); j < hashes && result; ++j)
+		{
+			result = i->test (hash_a.qwords [j] % i->size ());
+		}
+	}
+	return result;
+}
+
+double rai::rolling_bloom::false_positive_rate () const
 {
+	std::lock_guard <std::mutex> lock (mutex);
+	auto result (1.0);
+	for (auto & i: generations)
+	{
+		auto fill (static_cast <double> (i.count ()) / i.size ());
+		result *= 1.0 - std::pow (fill, hashes);
+	}
+	return 1.0 - result;
 }
 
 void rai::peer_container::contacted (rai::endpoint const & endpoint_a)
@@ -1993,70 +3738,354 @@ std::ostream & operator << (std::ostream & stream_a, std::chrono::system_clock::
     return stream_a;
 }
 
-void rai::network::initiate_send ()
+rai::token_bucket::token_bucket (size_t rate_a, size_t burst_a) :
+rate (rate_a),
+burst (burst_a),
+tokens (burst_a),
+last (std::chrono::steady_clock::now ())
 {
-	assert (!socket_mutex.try_lock ());
-	assert (!sends.empty ());
-	auto & front (sends.front ());
-	if (node.config.logging.network_packet_logging ())
+}
+
+void rai::token_bucket::refill (std::chrono::steady_clock::time_point const & now_a)
+{
+	if (now_a > last)
+	{
+		auto elapsed (std::chrono::duration_cast <std::chrono::duration <double>> (now_a - last).count ());
+		tokens = std::min <double> (burst, tokens + elapsed * rate);
+		last = now_a;
+	}
+}
+
+bool rai::token_bucket::consume (std::chrono::steady_clock::time_point const & now_a)
+{
+	auto result (false);
+	if (rate != 0)
+	{
+		refill (now_a);
+		result = tokens < 1.0;
+		if (!result)
+		{
+			tokens -= 1.0;
+		}
+	}
+	return result;
+}
+
+std::chrono::steady_clock::duration rai::token_bucket::delay (std::chrono::steady_clock::time_point const & now_a)
+{
+	std::chrono::steady_clock::duration result (0);
+	if (rate != 0)
+	{
+		refill (now_a);
+		if (tokens < 1.0)
+		{
+			result = std::chrono::duration_cast <std::chrono::steady_clock::duration> (std::chrono::duration <double> ((1.0 - tokens) / rate)) + std::chrono::steady_clock::duration (1);
+		}
+	}
+	return result;
+}
+
+std::chrono::steady_clock::duration rai::token_bucket::reserve (std::chrono::steady_clock::time_point const & now_a)
+{
+	std::chrono::steady_clock::duration result (0);
+	if (rate != 0)
+	{
+		refill (now_a);
+		tokens -= 1.0;
+		if (tokens < 0.0)
+		{
+			result = std::chrono::duration_cast <std::chrono::steady_clock::duration> (std::chrono::duration <double> (-tokens / rate)) + std::chrono::steady_clock::duration (1);
+		}
+	}
+	return result;
+}
+
+bool rai::token_bucket::full (std::chrono::steady_clock::time_point const & now_a)
+{
+	auto result (true);
+	if (rate != 0)
+	{
+		refill (now_a);
+		result = tokens >= burst;
+	}
+	return result;
+}
+
+rai::send_scheduler::send_scheduler (size_t rate_a, size_t burst_a, size_t peer_rate_a, size_t peer_burst_a) :
+global (rate_a, burst_a),
+peer_rate (peer_rate_a),
+peer_burst (peer_burst_a)
+{
+}
+
+void rai::send_scheduler::push (rai::send_info const & send_a)
+{
+	queues [static_cast <size_t> (send_a.priority)].push_back (send_a);
+}
+
+void rai::send_scheduler::retry (rai::send_info const & send_a, std::chrono::steady_clock::time_point const & due_a)
+{
+	retries.insert (std::make_pair (due_a, send_a));
+}
+
+void rai::send_scheduler::pop (std::vector <rai::send_info> & sends_a, size_t count_a, std::chrono::steady_clock::time_point const & now_a, std::chrono::steady_clock::time_point & next_a)
+{
+	next_a = std::chrono::steady_clock::time_point::max ();
+	while (!retries.empty () && retries.begin ()->first <= now_a)
+	{
+		push (retries.begin ()->second);
+		retries.erase (retries.begin ());
+	}
+	if (!retries.empty ())
+	{
+		next_a = retries.begin ()->first;
+	}
+	auto global_delay (global.delay (now_a));
+	// Throttled sends already hold their peer's token, only the due ones are looked at and they go ahead of newer sends
+	while (global_delay.count () == 0 && sends_a.size () < count_a && !throttled.empty () && throttled.begin ()->first <= now_a)
+	{
+		global.consume (now_a);
+		sends_a.push_back (throttled.begin ()->second);
+		throttled.erase (throttled.begin ());
+		global_delay = global.delay (now_a);
+	}
+	auto queued (false);
+	for (auto i (queues.begin ()), n (queues.end ()); i != n; ++i)
+	{
+		while (global_delay.count () == 0 && sends_a.size () < count_a && !i->empty ())
+		{
+			release (i->front (), now_a, sends_a);
+			i->pop_front ();
+			global_delay = global.delay (now_a);
+		}
+		queued = queued || !i->empty ();
+	}
+	if (global_delay.count () > 0 && (queued || !throttled.empty ()))
+	{
+		next_a = std::min (next_a, now_a + global_delay);
+	}
+	if (!throttled.empty ())
+	{
+		next_a = std::min (next_a, throttled.begin ()->first);
+	}
+	if (peers.size () > peers_max)
+	{
+		// Buckets that have refilled carry no state worth keeping
+		for (auto i (peers.begin ()), n (peers.end ()); i != n;)
+		{
+			if (i->second.full (now_a))
+			{
+				i = peers.erase (i);
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+}
+
+void rai::send_scheduler::release (rai::send_info const & send_a, std::chrono::steady_clock::time_point const & now_a, std::vector <rai::send_info> & sends_a)
+{
+	rai::endpoint_key key (send_a.endpoint);
+	auto existing (peers.find (key));
+	if (existing == peers.end ())
+	{
+		existing = peers.insert (std::make_pair (key, rai::token_bucket (peer_rate, peer_burst))).first;
+	}
+	auto delay (existing->second.reserve (now_a));
+	if (delay.count () == 0)
+	{
+		global.consume (now_a);
+		sends_a.push_back (send_a);
+	}
+	else
 	{
-		BOOST_LOG (node.log) << "Sending packet";
+		throttled.insert (std::make_pair (now_a + delay, send_a));
 	}
-	socket.async_send_to (boost::asio::buffer (front.data, front.size), front.endpoint, [this, front] (boost::system::error_code const & ec, size_t size_a)
+}
+
+size_t rai::send_scheduler::size () const
+{
+	size_t result (retries.size () + throttled.size ());
+	for (auto & i: queues)
+	{
+		result += i.size ();
+	}
+	return result;
+}
+
+// Hand whatever the scheduler releases to the socket and arrange to be woken when more can go
+void rai::network::initiate_send ()
+{
+	assert (!socket_mutex.try_lock ());
+	if (in_flight < node.config.send_max_in_flight)
 	{
-		if (front.rebroadcast > 0)
+		auto now (std::chrono::steady_clock::now ());
+		std::vector <rai::send_info> ready;
+		std::chrono::steady_clock::time_point next;
+		scheduler.pop (ready, node.config.send_max_in_flight - in_flight, now, next);
+		// Channel sends are released by the scheduler too so they're held to the same rate limits
+		ready.erase (std::remove_if (ready.begin (), ready.end (), [this] (rai::send_info const & send_a) { return !send_realtime (send_a); }), ready.end ());
+		size_t sent (0);
+		if (node.config.udp_batching && rai::udp_batch_supported () && !ready.empty ())
+		{
+			sent = send_batch (ready);
+		}
+		for (auto i (ready.begin () + sent), n (ready.end ()); i != n; ++i)
 		{
-			this->node.alarm.add (std::chrono::system_clock::now () + std::chrono::seconds (this->node.config.rebroadcast_delay), [this, front]
+			if (node.config.logging.network_packet_logging ())
+			{
+				BOOST_LOG (node.log) << "Sending packet";
+			}
+			++in_flight;
+			auto send (*i);
+			socket.async_send_to (boost::asio::buffer (*send.buffer), send.endpoint, [this, send] (boost::system::error_code const & ec, size_t size_a)
 			{
-				send_buffer (front.data, front.size, front.endpoint, front.rebroadcast - 1, front.callback);
+				send_complete (send, ec, size_a);
 			});
 		}
-		else
+		if (!scheduler.retries.empty ())
 		{
-			rai::send_info self;
+			// Batched sends may have queued rebroadcasts
+			next = std::min (next, scheduler.retries.begin ()->first);
+		}
+		if (next < wakeup)
+		{
+			if (wakeup_operation != nullptr)
 			{
-				std::unique_lock <std::mutex> lock (socket_mutex);
-				assert (!sends.empty ());
-				self = sends.front ();
+				// Superseded by the earlier wakeup
+				node.alarm.cancel (wakeup_operation);
 			}
-			self.callback (ec, size_a);
+			wakeup = next;
+			auto node_l (node.shared ());
+			wakeup_operation = node.alarm.add (std::chrono::system_clock::now () + std::chrono::duration_cast <std::chrono::system_clock::duration> (next - now), [node_l] ()
+			{
+				auto & network (node_l->network);
+				std::unique_lock <std::mutex> lock (network.socket_mutex);
+				// Superseded wakeups are cancelled so this is the current one, the handle would otherwise keep the node alive
+				network.wakeup_operation.reset ();
+				if (network.wakeup <= std::chrono::steady_clock::now ())
+				{
+					network.wakeup = std::chrono::steady_clock::time_point::max ();
+				}
+				network.initiate_send ();
+			});
 		}
-		send_complete (ec, size_a);
-	});
+	}
+}
+
+// Send as many of the released packets as possible with one system call per batch, returns how many were sent
+size_t rai::network::send_batch (std::vector <rai::send_info> const & sends_a)
+{
+	assert (!socket_mutex.try_lock ());
+	std::array <rai::udp_datagram, rai::udp_receiver::batch_size> datagrams;
+	size_t result (0);
+	auto done (false);
+	while (!done && result < sends_a.size ())
+	{
+		auto count (std::min (sends_a.size () - result, datagrams.size ()));
+		for (size_t i (0); i < count; ++i)
+		{
+			auto & send (sends_a [result + i]);
+			datagrams [i] = rai::udp_datagram {const_cast <uint8_t *> (send.buffer->data ()), send.buffer->size (), send.endpoint};
+		}
+		boost::system::error_code ec;
+		auto sent (rai::udp_send_batch (socket, datagrams.data (), count, ec));
+		if (node.config.logging.network_packet_logging ())
+		{
+			BOOST_LOG (node.log) << boost::str (boost::format ("Sent %1% packets in one batch") % sent);
+		}
+		for (size_t i (0); i < sent; ++i)
+		{
+			auto & send (sends_a [result + i]);
+			if (send.rebroadcast > 0)
+			{
+				auto retry (send);
+				--retry.rebroadcast;
+				scheduler.retry (retry, std::chrono::steady_clock::now () + std::chrono::seconds (node.config.rebroadcast_delay));
+			}
+			else if (send.callback)
+			{
+				// Callbacks may queue more sends so they can't run under socket_mutex
+				node.background ([send] ()
+				{
+					send.callback (boost::system::error_code (), send.buffer->size ());
+				});
+			}
+		}
+		result += sent;
+		done = sent < count;
+	}
+	return result;
 }
 
-void rai::network::send_buffer (uint8_t const * data_a, size_t size_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
+void rai::network::send_buffer (std::shared_ptr <std::vector <uint8_t> const> const & buffer_a, rai::endpoint const & endpoint_a, size_t rebroadcast_a, rai::send_priority priority_a, std::function <void (boost::system::error_code const &, size_t)> callback_a)
 {
 	std::unique_lock <std::mutex> lock (socket_mutex);
-	auto initiate (sends.empty ());
-	sends.push ({data_a, size_a, endpoint_a, rebroadcast_a, callback_a});
-	if (initiate)
+	scheduler.push ({buffer_a, endpoint_a, rebroadcast_a, priority_a, std::move (callback_a), false});
+	initiate_send ();
+}
+
+bool rai::network::send_realtime (rai::send_info const & send_a)
+{
+	auto result (true);
+	if (node.config.realtime_tcp && send_a.priority != rai::send_priority::keepalive && !send_a.udp)
 	{
-		initiate_send ();
+		auto channel (realtime.find (send_a.endpoint));
+		if (channel != nullptr)
+		{
+			auto node_l (node.shared ());
+			// Channels are reliable so the message goes once without rebroadcasts
+			result = channel->send (send_a.buffer, [node_l, send_a] (boost::system::error_code const & ec, size_t size_a)
+			{
+				if (!ec)
+				{
+					if (send_a.callback)
+					{
+						send_a.callback (ec, size_a);
+					}
+				}
+				else
+				{
+					// The channel closed, the message and its rebroadcasts go over UDP instead
+					auto retry (send_a);
+					retry.udp = true;
+					auto & network (node_l->network);
+					std::unique_lock <std::mutex> lock (network.socket_mutex);
+					network.scheduler.push (retry);
+					network.initiate_send ();
+				}
+			});
+		}
 	}
+	return result;
 }
 
-void rai::network::send_complete (boost::system::error_code const & ec, size_t size_a)
+void rai::network::send_complete (rai::send_info const & send_a, boost::system::error_code const & ec, size_t size_a)
 {
     if (node.config.logging.network_packet_logging ())
     {
         BOOST_LOG (node.log) << "Packet send complete";
     }
+	if (ec && node.config.logging.network_logging ())
+	{
+		BOOST_LOG (node.log) << boost::str (boost::format ("Error sending packet to %1%: %2%") % send_a.endpoint % ec.message ());
+	}
+	if (send_a.rebroadcast == 0 && send_a.callback)
+	{
+		send_a.callback (ec, size_a);
+	}
 	std::unique_lock <std::mutex> lock (socket_mutex);
-	assert (!sends.empty ());
-	sends.pop ();
-	if (!sends.empty ())
+	assert (in_flight > 0);
+	--in_flight;
+	if (send_a.rebroadcast > 0)
 	{
-		if (node.config.logging.network_packet_logging ())
-		{
-			BOOST_LOG (node.log) << boost::str (boost::format ("Delaying next packet send %1% microseconds") % node.config.packet_delay_microseconds);
-		}
-		node.alarm.add (std::chrono::system_clock::now () + std::chrono::microseconds (node.config.packet_delay_microseconds), [this] ()
-		{
-			std::unique_lock <std::mutex> lock (socket_mutex);
-			initiate_send ();
-		});
+		auto retry (send_a);
+		--retry.rebroadcast;
+		scheduler.retry (retry, std::chrono::steady_clock::now () + std::chrono::seconds (node.config.rebroadcast_delay));
 	}
+	initiate_send ();
 }
 
 uint64_t rai::block_store::now ()
@@ -2069,9 +4098,9 @@ uint64_t rai::block_store::now ()
 
 bool rai::peer_container::known_peer (rai::endpoint const & endpoint_a)
 {
-    std::lock_guard <std::mutex> lock (mutex);
-    auto existing (peers.find (endpoint_a));
-    return existing != peers.end () && existing->last_contact > std::chrono::system_clock::now () - rai::node::cutoff;
+    auto snapshot_l (snapshot ());
+    auto existing (snapshot_l->peers.find (rai::endpoint_key (endpoint_a)));
+    return existing != snapshot_l->peers.end () && existing->second.last_contact > std::chrono::system_clock::now () - rai::node::cutoff;
 }
 
 std::shared_ptr <rai::node> rai::node::shared ()
@@ -2124,14 +4153,13 @@ void rai::election::recompute_winner ()
 void rai::election::broadcast_winner ()
 {
 	recompute_winner ();
-	std::unique_ptr <rai::block> winner_l;
+	std::shared_ptr <rai::block const> winner_l;
 	{
 		rai::transaction transaction (node.store.environment, nullptr, false);
 		winner_l = node.ledger.winner (transaction, votes).second;
 	}
 	assert (winner_l != nullptr);
-	auto list (node.peers.list ());
-	node.network.confirm_broadcast (list, std::move (winner_l), 0);
+	node.network.confirm_broadcast (node.peers.fanout (std::numeric_limits <size_t>::max ()), winner_l->clone (), 0);
 }
 
 rai::uint128_t rai::election::quorum_threshold (MDB_txn * transaction_a, rai::ledger & ledger_a)
@@ -2146,8 +4174,13 @@ void rai::election::confirm_once ()
 	{
 		auto winner_l (last_winner);
 		auto confirmation_action_l (confirmation_action);
-		node.background ([winner_l, confirmation_action_l] ()
+		auto node_l (node.shared ());
+		node.background ([node_l, winner_l, confirmation_action_l] ()
 		{
+			{
+				rai::transaction transaction (node_l->store.environment, nullptr, true);
+				node_l->ledger.confirm (transaction, winner_l->hash ());
+			}
 			confirmation_action_l (*winner_l);
 		});
 	}
@@ -2163,16 +4196,19 @@ bool rai::election::recalculate_winner (MDB_txn * transaction_a)
 	if (!(*winner->second == *last_winner) && (winner->first > quorum_threshold_l))
 	{
 		BOOST_LOG (node.log) << boost::str (boost::format ("Rolling back %1% and replacing with %2%") % last_winner->hash ().to_string () % winner->second->hash ().to_string ());
-		for (auto i (votes.rep_votes.begin ()), n (votes.rep_votes.end ()); i != n; ++i)
 		{
-			BOOST_LOG (node.log) << boost::str (boost::format ("%1% %2%") % i->first.to_account () % i->second->hash ().to_string ());
+			std::lock_guard <std::mutex> lock (votes.mutex);
+			for (auto i (votes.rep_votes.begin ()), n (votes.rep_votes.end ()); i != n; ++i)
+			{
+				BOOST_LOG (node.log) << boost::str (boost::format ("%1% %2%") % i->first.to_account () % i->second->hash ().to_string ());
+			}
 		}
 		// Replace our block with the winner and roll back any dependent blocks
 		auto error (node.ledger.rollback (transaction_a, last_winner->hash ()));
 		if (!error)
 		{
 			node.ledger.process (transaction_a, *winner->second);
-			last_winner = std::move (winner->second);
+			last_winner = winner->second->clone ();
 		}
 		else
 		{
@@ -2209,7 +4245,7 @@ void rai::election::confirm_cutoff ()
 void rai::election::vote (rai::vote const & vote_a)
 {
 	rai::transaction transaction (node.store.environment, nullptr, true);
-	auto tally_changed (votes.vote (transaction, node.store, vote_a));
+	auto tally_changed (votes.vote (transaction, node.store, vote_a, true));
 	if (tally_changed)
 	{
 		confirm_if_quarum (transaction);
@@ -2260,6 +4296,7 @@ void rai::active_transactions::announce_votes ()
 	{
 		assert (roots.find (*i) != roots.end ());
 		roots.erase (*i);
+		blocks.get <1> ().erase (*i);
 	}
 	auto now (std::chrono::system_clock::now ());
 	auto node_l (node.shared ());
@@ -2275,25 +4312,48 @@ void rai::active_transactions::start (rai::block const & block_a, std::function
     {
         auto election (std::make_shared <rai::election> (node, block_a, confirmation_action_a));
         roots.insert (rai::conflict_info {root, election, 0});
+		blocks.insert (rai::election_block {block_a.hash (), root});
     }
 }
 
-// Validate a vote and apply it to the current election if one exists
-void rai::active_transactions::vote (rai::vote const & vote_a)
+// Validate a vote and apply it to the current elections for its blocks
+void rai::active_transactions::vote (rai::vote const & vote_a, bool validated_a)
 {
-	std::shared_ptr <rai::election> election;
+	std::vector <std::shared_ptr <rai::election>> elections;
+	if (validated_a || !rai::validate_message (vote_a.account, vote_a.hash (), vote_a.signature))
 	{
 		std::lock_guard <std::mutex> lock (mutex);
-		auto root (vote_a.block->root ());
-		auto existing (roots.find (root));
-		if (existing != roots.end ())
+		if (vote_a.block != nullptr)
+		{
+			auto root (vote_a.block->root ());
+			auto existing (roots.find (root));
+			if (existing != roots.end ())
+			{
+				elections.push_back (existing->election);
+				// Later votes by hash for this fork find the election even though the fork isn't in our ledger
+				blocks.insert (rai::election_block {vote_a.block->hash (), root});
+			}
+		}
+		else
 		{
-			election = existing->election;
+			// A vote by hash only counts for blocks already in an election's rep_votes
+			std::vector <rai::block_hash> found;
+			for (auto & i: vote_a.hashes)
+			{
+				auto block (blocks.find (i));
+				if (block != blocks.end () && std::find (found.begin (), found.end (), block->root) == found.end ())
+				{
+					found.push_back (block->root);
+					auto existing (roots.find (block->root));
+					assert (existing != roots.end ());
+					elections.push_back (existing->election);
+				}
+			}
 		}
 	}
-	if (election)
+	for (auto & i: elections)
 	{
-        election->vote (vote_a);
+        i->vote (vote_a);
 	}
 }
 
@@ -2376,6 +4436,8 @@ void rai::add_node_options (boost::program_options::options_description & descri
 	("account_create", "Insert next deterministic key in to <wallet>")
 	("account_get", "Get account number for the <key>")
 	("account_key", "Get the public key for <account>")
+	("block_export", "Write all blocks in the ledger to <file> as length prefixed binary records")
+	("block_import", "Read binary block records from <file> in to the ledger")
 	("diagnostics", "Run internal diagnostics")
 	("key_create", "Generates a adhoc random keypair and prints it to stdout")
 	("key_expand", "Derive public key and account number from <key>")
@@ -2473,6 +4535,65 @@ bool rai::handle_node_options (boost::program_options::variables_map & vm)
 			result = true;
 		}
 	}
+	else if (vm.count ("block_export"))
+	{
+		if (vm.count ("file") == 1)
+		{
+			std::string filename (vm ["file"].as <std::string> ());
+			std::ofstream stream;
+			stream.open (filename.c_str (), std::ios::binary);
+			if (!stream.fail ())
+			{
+				inactive_node node;
+				rai::block_export exporter (node.node->store, stream);
+				auto count (exporter.export_all ());
+				std::cout << boost::str (boost::format ("Exported %1% blocks\n") % count);
+			}
+			else
+			{
+				std::cerr << "Unable to open <file>\n";
+				result = true;
+			}
+		}
+		else
+		{
+			std::cerr << "block_export requires one <file> option\n";
+			result = true;
+		}
+	}
+	else if (vm.count ("block_import"))
+	{
+		if (vm.count ("file") == 1)
+		{
+			std::string filename (vm ["file"].as <std::string> ());
+			std::ifstream stream;
+			stream.open (filename.c_str (), std::ios::binary);
+			if (!stream.fail ())
+			{
+				inactive_node node;
+				rai::block_import importer (*node.node, stream);
+				auto begin (std::chrono::steady_clock::now ());
+				auto error (importer.run ());
+				auto end (std::chrono::steady_clock::now ());
+				std::cout << boost::str (boost::format ("Read %1% blocks in %2%ms, %3% imported, %4% old, %5% invalid, %6% rejected, %7% unresolved\n") % importer.read_count % std::chrono::duration_cast <std::chrono::milliseconds> (end - begin).count () % importer.progress_count % importer.old_count % importer.invalid_count % importer.rejected_count % importer.unresolved_count);
+				if (error)
+				{
+					std::cerr << "Malformed block record in <file>\n";
+					result = true;
+				}
+			}
+			else
+			{
+				std::cerr << "Unable to open <file>\n";
+				result = true;
+			}
+		}
+		else
+		{
+			std::cerr << "block_import requires one <file> option\n";
+			result = true;
+		}
+	}
 	else if (vm.count ("diagnostics"))
 	{
 		inactive_node node;
@@ -4,6 +4,8 @@
 #include <rai/node/wallet.hpp>
 
 #include <unordered_set>
+#include <unordered_map>
+#include <map>
 #include <memory>
 #include <queue>
 #include <mutex>
@@ -40,6 +42,7 @@ class election : public std::enable_shared_from_this <rai::election>
 	void confirm_once ();
 public:
     election (rai::node &, rai::block const &, std::function <void (rai::block &)> const &);
+	// The vote's signature must already be validated
     void vote (rai::vote const &);
 	// Set last_winner based on our current state of the ledger
 	bool recalculate_winner (MDB_txn *);
@@ -66,6 +69,13 @@ public:
 	// Number of announcements in a row for this fork
 	int announcements;
 };
+// A block that can be in an election's rep_votes, votes by hash find their election through it even if the block isn't in our ledger
+class election_block
+{
+public:
+	rai::block_hash hash;
+	rai::block_hash root;
+};
 // Core class for determining concensus
 // Holds all active blocks i.e. recently added blocks that need confirmation
 class active_transactions
@@ -75,7 +85,8 @@ public:
 	// Start an election for a block
 	// Call action with confirmed block, may be different than what we started with
     void start (rai::block const &, std::function <void (rai::block &)> const &);
-    void vote (rai::vote const &);
+	// The signature is validated once for all elections unless the caller already did
+    void vote (rai::vote const &, bool = false);
 	bool active (rai::block const &);
 	void announce_votes ();
     boost::multi_index_container
@@ -86,6 +97,16 @@ public:
 			boost::multi_index::ordered_unique <boost::multi_index::member <rai::conflict_info, rai::block_hash, &rai::conflict_info::root>>
 		>
 	> roots;
+	// Blocks started and blocks received in signed votes for each election in roots
+	boost::multi_index_container
+	<
+		rai::election_block,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::hashed_unique <boost::multi_index::member <rai::election_block, rai::block_hash, &rai::election_block::hash>>,
+			boost::multi_index::hashed_non_unique <boost::multi_index::member <rai::election_block, rai::block_hash, &rai::election_block::root>>
+		>
+	> blocks;
     rai::node & node;
     std::mutex mutex;
 	// Maximum number of conflicts to vote on per interval, lowest root hash first
@@ -96,22 +117,46 @@ public:
 class operation
 {
 public:
-    bool operator > (rai::operation const &) const;
-    std::chrono::system_clock::time_point wakeup;
     std::function <void ()> function;
+	// Wheel revolutions left before the operation is due
+	uint64_t rounds;
+	std::atomic <bool> cancelled;
 };
+// Hashed timer wheel, add and cancel are O(1) and operations expiring in the same tick are posted to the io_service together
 class alarm
 {
 public:
     alarm (boost::asio::io_service &);
 	~alarm ();
-    void add (std::chrono::system_clock::time_point const &, std::function <void ()> const &);
+    std::shared_ptr <rai::operation> add (std::chrono::system_clock::time_point const &, std::function <void ()> const &);
+	// The operation won't run unless it already started
+	void cancel (std::shared_ptr <rai::operation> const &);
 	void run ();
+	// First tick with an operation due, a revolution ahead if every operation is in a later round
+	uint64_t next_due ();
+	uint64_t ticks (std::chrono::steady_clock::time_point const &);
+	// Mark whether the slot holds an operation due when the wheel next reaches it
+	void set_due (size_t, bool);
 	boost::asio::io_service & service;
     std::mutex mutex;
     std::condition_variable condition;
-    std::priority_queue <operation, std::vector <operation>, std::greater <operation>> operations;
+	// Guards operation functions between cancel and the posted batch, shared so a batch that runs after the alarm is gone doesn't touch it
+	std::shared_ptr <std::mutex> function_mutex;
+	std::chrono::steady_clock::time_point start;
+	std::vector <std::vector <std::shared_ptr <rai::operation>>> wheel;
+	// One bit per slot, set if it holds an operation in its last round, so next_due skips empty slots a word at a time
+	std::array <uint64_t, 64> due_slots;
+	// Next tick to expire
+	uint64_t current;
+	// Tick the thread is sleeping until, add only wakes it for something earlier
+	uint64_t next;
+	// Operations in the wheel including cancelled ones not swept yet
+	size_t count;
+	bool stopped;
 	std::thread thread;
+	static std::chrono::milliseconds constexpr tick = std::chrono::milliseconds (1);
+	static size_t constexpr slots = 4096;
+	static_assert (slots == 64 * 64, "due_slots has one bit per slot");
 };
 class gap_information
 {
@@ -128,6 +173,7 @@ public:
     gap_cache (rai::node &);
     void add (rai::block const &, rai::block_hash);
     std::vector <std::unique_ptr <rai::block>> get (rai::block_hash const &);
+	// Votes reach here through vote_filter which validated their signature
     void vote (MDB_txn *, rai::vote const &);
     rai::uint128_t bootstrap_threshold (MDB_txn *);
     boost::multi_index_container
@@ -145,14 +191,52 @@ public:
     rai::node & node;
 };
 class work_pool;
+// Bloom filter over the most recent 512 to 1024 hashes inserted, older hashes age out a generation at a time
+class rolling_bloom
+{
+public:
+	rolling_bloom ();
+	void insert (rai::block_hash const &);
+	bool contains (rai::block_hash const &) const;
+	// Estimated chance contains returns true for a hash that was never inserted
+	double false_positive_rate () const;
+	// Filters are shared with peer snapshots so they carry their own lock
+	mutable std::mutex mutex;
+	std::array <std::bitset <8192>, 2> generations;
+	size_t current;
+	size_t count;
+	static size_t constexpr hashes = 4;
+	static size_t constexpr capacity = 512;
+};
 class peer_information
 {
 public:
+	peer_information (rai::endpoint const &, std::chrono::system_clock::time_point const &, std::chrono::system_clock::time_point const &, std::chrono::system_clock::time_point const & = std::chrono::system_clock::time_point (), std::shared_ptr <rai::rolling_bloom> = nullptr);
 	rai::endpoint endpoint;
+	// Packed copy of endpoint the peer table is indexed by
+	rai::endpoint_key key;
 	std::chrono::system_clock::time_point last_contact;
 	std::chrono::system_clock::time_point last_attempt;
 	std::chrono::system_clock::time_point last_bootstrap_failure;
-	rai::block_hash most_recent;
+	// Blocks the peer announced to us or we sent to it
+	std::shared_ptr <rai::rolling_bloom> known;
+	// Keepalive round trip in milliseconds smoothed across probes, negative until a probe is answered
+	double rtt;
+	// Smoothed fraction of probes left unanswered
+	double loss;
+	// Outstanding probe, 0 if there is none
+	uint64_t probe_nonce;
+	std::chrono::steady_clock::time_point probe_sent;
+};
+// Immutable copy of the peer table, readers hold a reference instead of the container lock
+class peer_snapshot
+{
+public:
+	std::unordered_map <rai::endpoint_key, rai::peer_information> peers;
+	// The same peers indexable for random sampling
+	std::vector <rai::endpoint> endpoints;
+	// Measured peers, lowest score first
+	std::vector <rai::endpoint> preferred;
 };
 class peer_container
 {
@@ -170,17 +254,39 @@ public:
 	bool insert (rai::endpoint const &, rai::block_hash const &);
 	// Does this peer probably know about this block
 	bool knows_about (rai::endpoint const &, rai::block_hash const &);
+	// We sent this block to the peer
+	void sent (rai::endpoint const &, rai::block_hash const &);
+	// Mean estimated false positive rate of knows_about across peers
+	double known_false_positive_rate ();
+	// Nonce to send in a keepalive probe, 0 for unknown peers. A probe unanswered after probe_timeout counts as lost
+	uint64_t probe (rai::endpoint const &);
+	// Record the echo of a probe, returns true if it doesn't match the outstanding one
+	bool probe_reply (rai::endpoint const &, uint64_t);
+	// Up to `count' measured peers with the lowest score
+	std::vector <rai::endpoint> preferred (size_t);
+	// Expected milliseconds for a message to get through including retries, infinite for unmeasured peers
+	static double score (rai::peer_information const &);
 	// Notify of bootstrap failure
 	void bootstrap_failed (rai::endpoint const &);
 	void random_fill (std::array <rai::endpoint, 8> &);
 	// List of all peers
 	std::vector <peer_information> list ();
-	// List of peers that haven't failed bootstrapping in a while
+	// Up to `count' peers from a cached random permutation, successive calls continue where the last one stopped
+	std::vector <rai::endpoint> fanout (size_t);
+	// List of peers that haven't failed bootstrapping in a while, lowest score first
 	std::vector <peer_information> bootstrap_candidates ();
 	// Purge any peer where last_contact < time_point and return what was left
 	std::vector <rai::peer_information> purge_list (std::chrono::system_clock::time_point const &);
 	size_t size ();
 	bool empty ();
+	// Current snapshot, safe to read from any thread without the mutex
+	std::shared_ptr <rai::peer_snapshot const> snapshot ();
+	// Rebuild and swap in the snapshot from peers, caller holds mutex
+	void publish ();
+	// Publish after peers was modified directly
+	void refresh ();
+	// Publish if anything was modified since the last publish
+	void publish_dirty ();
 	std::mutex mutex;
 	rai::endpoint self;
 	boost::multi_index_container
@@ -188,22 +294,174 @@ public:
 		peer_information,
 		boost::multi_index::indexed_by
 		<
-			boost::multi_index::hashed_unique <boost::multi_index::member <peer_information, rai::endpoint, &peer_information::endpoint>>,
+			boost::multi_index::hashed_unique <boost::multi_index::member <peer_information, rai::endpoint_key, &peer_information::key>>,
 			boost::multi_index::ordered_non_unique <boost::multi_index::member <peer_information, std::chrono::system_clock::time_point, &peer_information::last_contact>>,
 			boost::multi_index::ordered_non_unique <boost::multi_index::member <peer_information, std::chrono::system_clock::time_point, &peer_information::last_attempt>, std::greater <std::chrono::system_clock::time_point>>
 		>
 	> peers;
 	std::function <void (rai::endpoint const &)> peer_observer;
 	std::function <void ()> disconnect_observer;
+	std::shared_ptr <rai::peer_snapshot const> current;
+	// Peers modified since the last publish
+	bool dirty;
+	std::chrono::steady_clock::time_point published;
+	// A peer's last_contact is rewritten at most once per contact_interval, refreshes are published at most once per publish_interval
+	static std::chrono::seconds constexpr contact_interval = std::chrono::seconds (5);
+	static std::chrono::milliseconds constexpr publish_interval = std::chrono::milliseconds (100);
+	// Times insert had to take the mutex
+	std::atomic <uint64_t> locked_count;
+	// Rebuilt when the peer count changes or after permutation_period
+	std::vector <rai::endpoint> permutation;
+	size_t permutation_position;
+	std::chrono::steady_clock::time_point permutation_refresh;
+	static std::chrono::seconds constexpr permutation_period = std::chrono::seconds (10);
+	// Weight of each new sample in rtt and loss
+	static double constexpr probe_weight = 0.2;
+	static std::chrono::seconds constexpr probe_timeout = std::chrono::seconds (5);
+	// Block sends skipped because knows_about said the peer had it, and sends made
+	std::atomic <uint64_t> known_suppressed_count;
+	std::atomic <uint64_t> known_sent_count;
+};
+// Send classes in the order the scheduler drains them
+enum class send_priority : uint8_t
+{
+	vote,
+	confirm_req,
+	publish,
+	keepalive
 };
 class send_info
 {
 public:
-	uint8_t const * data;
-	size_t size;
+	std::shared_ptr <std::vector <uint8_t> const> buffer;
 	rai::endpoint endpoint;
 	size_t rebroadcast;
+	rai::send_priority priority;
 	std::function <void (boost::system::error_code const &, size_t)> callback;
+	// Requeued after its realtime channel failed, goes over UDP
+	bool udp;
+};
+// Admits `rate' packets per second with bursts of up to `burst', a rate of 0 is unlimited
+class token_bucket
+{
+public:
+	token_bucket (size_t, size_t);
+	// Take a token, returns true if none are available
+	bool consume (std::chrono::steady_clock::time_point const &);
+	// How long until a token is available
+	std::chrono::steady_clock::duration delay (std::chrono::steady_clock::time_point const &);
+	// Take a token even if it hasn't been refilled yet, returns how long until it would have been available
+	std::chrono::steady_clock::duration reserve (std::chrono::steady_clock::time_point const &);
+	void refill (std::chrono::steady_clock::time_point const &);
+	bool full (std::chrono::steady_clock::time_point const &);
+	size_t rate;
+	size_t burst;
+	double tokens;
+	std::chrono::steady_clock::time_point last;
+};
+// Orders outgoing packets by priority and releases them as the global and per peer token buckets allow, not thread safe
+class send_scheduler
+{
+public:
+	send_scheduler (size_t, size_t, size_t, size_t);
+	void push (rai::send_info const &);
+	// Queue a rebroadcast to be released at the given time
+	void retry (rai::send_info const &, std::chrono::steady_clock::time_point const &);
+	// Move up to `count' releasable sends in to the vector, sets the time point to when more may become available
+	void pop (std::vector <rai::send_info> &, size_t, std::chrono::steady_clock::time_point const &, std::chrono::steady_clock::time_point &);
+	// Release the send if its peer's bucket has a token, otherwise hold it in throttled until its reserved token refills
+	void release (rai::send_info const &, std::chrono::steady_clock::time_point const &, std::vector <rai::send_info> &);
+	size_t size () const;
+	std::array <std::deque <rai::send_info>, 4> queues;
+	std::multimap <std::chrono::steady_clock::time_point, rai::send_info> retries;
+	// Sends by the time their peer's token was reserved for, each peer's sends stay in order
+	std::multimap <std::chrono::steady_clock::time_point, rai::send_info> throttled;
+	rai::token_bucket global;
+	std::unordered_map <rai::endpoint_key, rai::token_bucket> peers;
+	size_t peer_rate;
+	size_t peer_burst;
+	static size_t constexpr peers_max = 4096;
+};
+// Load balance datagrams across sockets bound to the same port, returns true if the platform doesn't support it
+bool udp_reuse_port (boost::asio::ip::udp::socket &);
+// Datagrams the kernel dropped for this socket because its receive buffer was full
+uint64_t udp_drop_count (boost::asio::ip::udp::socket &);
+// Have the kernel attach its drop counter to every datagram as SO_RXQ_OVFL ancillary data, returns true if the platform doesn't support it
+bool udp_drop_counter (boost::asio::ip::udp::socket &);
+class udp_datagram
+{
+public:
+	uint8_t * data;
+	size_t size;
+	rai::endpoint endpoint;
+	// Datagrams dropped on the socket before this one was queued, 0 without udp_drop_counter
+	uint32_t drops;
+};
+// Whether udp_receive_batch and udp_send_batch move more than one datagram per system call on this platform
+bool udp_batch_supported ();
+// Read up to `count' pending datagrams without blocking, `size' is the buffer capacity on entry and the datagram length on return
+size_t udp_receive_batch (boost::asio::ip::udp::socket &, rai::udp_datagram *, size_t, boost::system::error_code &);
+// Send datagrams without blocking, returns how many were sent
+size_t udp_send_batch (boost::asio::ip::udp::socket &, rai::udp_datagram const *, size_t, boost::system::error_code &);
+// Appends inbound datagrams to a stream as records of microseconds since the capture started, the sender as an endpoint_key, a 16 bit length and the datagram
+class packet_capture
+{
+public:
+	packet_capture (std::ostream &);
+	void record (uint8_t const *, size_t, rai::endpoint const &);
+	// Return true if there are no more records, error is set if the record was truncated
+	static bool read_record (std::istream &, uint64_t &, rai::endpoint &, std::vector <uint8_t> &, bool &);
+	std::mutex mutex;
+	std::ostream & stream;
+	std::chrono::steady_clock::time_point start;
+	// Flushed about once a second so a capture ended by a signal loses little
+	std::chrono::steady_clock::time_point flushed;
+	uint64_t count;
+};
+class node;
+// Feeds a capture through a node's receive path and measures how it keeps up
+class packet_replay
+{
+public:
+	packet_replay (rai::node &, std::istream &);
+	// Replay at `speed' times the recorded pace, 0 as fast as possible, and wait for the block processor to drain. Returns true if the capture was malformed or has more senders than ports above sender_port
+	bool run (double);
+	rai::node & node;
+	std::istream & stream;
+	size_t read_count;
+	// Block processor depth sampled after every datagram
+	size_t queue_max;
+	double queue_mean;
+	// Blocks added to the ledger
+	size_t committed_count;
+	std::chrono::steady_clock::duration receive_time;
+	std::chrono::steady_clock::duration process_time;
+	// Senders are moved to distinct loopback ports from here up, skipping the node's own, so replies don't go to the recorded peers
+	static uint16_t constexpr sender_port = 20000;
+};
+class network;
+// An outstanding receive operation on a socket with its own buffer
+class udp_receiver
+{
+public:
+	udp_receiver (rai::network &, boost::asio::ip::udp::socket &);
+	void receive ();
+	void receive_action (boost::system::error_code const &, size_t);
+	void receive_batch (boost::system::error_code const &);
+	void receive_error (boost::system::error_code const &);
+	void process (uint8_t const *, size_t, rai::endpoint const &);
+	rai::network & network;
+	boost::asio::ip::udp::socket & socket;
+	rai::endpoint remote;
+	std::array <uint8_t, 512> buffer;
+	// Buffers for udp_receive_batch, only allocated when batching is enabled
+	std::vector <std::array <uint8_t, 512>> batch_buffers;
+	std::atomic <uint64_t> receive_count;
+	// Kernel drops accumulated from the counter in ancillary data
+	std::atomic <uint64_t> drop_count;
+	// Previous counter reading, only touched by the outstanding receive
+	uint32_t drops_last;
+	static size_t constexpr batch_size = 64;
 };
 class network
 {
@@ -211,36 +469,58 @@ public:
     network (boost::asio::io_service &, uint16_t, rai::node &);
     void receive ();
     void stop ();
-    void receive_action (boost::system::error_code const &, size_t);
     void rpc_action (boost::system::error_code const &, size_t);
-    void republish_block (rai::block &, size_t);
+    void republish_block (rai::block const &, size_t);
     void publish_broadcast (std::vector <rai::peer_information> &, std::unique_ptr <rai::block>);
-    bool confirm_broadcast (std::vector <rai::peer_information> &, std::unique_ptr <rai::block>, size_t);
+    bool confirm_broadcast (std::vector <rai::endpoint> const &, std::unique_ptr <rai::block>, size_t);
 	void confirm_block (rai::raw_key const &, rai::public_key const &, std::unique_ptr <rai::block>, uint64_t, rai::endpoint const &, size_t);
     void merge_peers (std::array <rai::endpoint, 8> const &);
     void send_keepalive (rai::endpoint const &);
+	// Answer a keepalive probe with its nonce
+	void echo_keepalive (rai::endpoint const &, uint64_t);
 	void broadcast_confirm_req (rai::block const &);
+	size_t fanout (size_t);
     void send_confirm_req (rai::endpoint const &, rai::block const &);
 	void initiate_send ();
-    void send_buffer (uint8_t const *, size_t, rai::endpoint const &, size_t, std::function <void (boost::system::error_code const &, size_t)>);
-    void send_complete (boost::system::error_code const &, size_t);
+	// Parse a received message and dispatch it as coming from the endpoint
+	void process (uint8_t const *, size_t, rai::endpoint const &);
+	// Apply the configured buffer sizes and drop accounting to a socket
+	void configure (boost::asio::ip::udp::socket &);
+	// Datagrams the kernel reported dropping across every socket
+	uint64_t drop_count ();
+	size_t send_batch (std::vector <rai::send_info> const &);
+	// Hand a released send to the peer's realtime channel, returns true if it should go over UDP
+	bool send_realtime (rai::send_info const &);
+	// Queue a serialized message, the callback is optional and send errors are logged either way
+    void send_buffer (std::shared_ptr <std::vector <uint8_t> const> const &, rai::endpoint const &, size_t, rai::send_priority, std::function <void (boost::system::error_code const &, size_t)> = nullptr);
+    void send_complete (rai::send_info const &, boost::system::error_code const &, size_t);
     rai::endpoint endpoint ();
-    rai::endpoint remote;
-    std::array <uint8_t, 512> buffer;
     boost::asio::ip::udp::socket socket;
+	// Additional SO_REUSEPORT sockets bound to the same port as `socket'
+	std::vector <std::unique_ptr <boost::asio::ip::udp::socket>> sockets;
+	std::vector <std::unique_ptr <rai::udp_receiver>> receivers;
     std::mutex socket_mutex;
     boost::asio::io_service & service;
     boost::asio::ip::udp::resolver resolver;
     rai::node & node;
-    uint64_t bad_sender_count;
-    std::queue <rai::send_info> sends;
+	rai::realtime_channels realtime;
+    std::atomic <uint64_t> bad_sender_count;
+    rai::send_scheduler scheduler;
+	size_t in_flight;
+	// Earliest pending scheduler wakeup on the alarm
+	std::chrono::steady_clock::time_point wakeup;
+	std::shared_ptr <rai::operation> wakeup_operation;
     bool on;
-    uint64_t keepalive_count;
-    uint64_t publish_count;
-    uint64_t confirm_req_count;
-    uint64_t confirm_ack_count;
-    uint64_t insufficient_work_count;
-    uint64_t error_count;
+    std::atomic <uint64_t> keepalive_count;
+    std::atomic <uint64_t> publish_count;
+    std::atomic <uint64_t> confirm_req_count;
+    std::atomic <uint64_t> confirm_ack_count;
+    std::atomic <uint64_t> insufficient_work_count;
+	// Votes by hash from representatives below vote_minimum
+	std::atomic <uint64_t> insufficient_weight_count;
+    std::atomic <uint64_t> error_count;
+	// Records every datagram passed to process when set, assign before the node starts
+	std::shared_ptr <rai::packet_capture> capture;
     static uint16_t const node_port = rai::rai_network == rai::rai_networks::rai_live_network ? 7075 : 54000;
 };
 class logging
@@ -300,7 +580,18 @@ public:
 	std::vector <std::pair <boost::asio::ip::address, uint16_t>> work_peers;
 	std::vector <std::string> preconfigured_peers;
 	std::vector <rai::account> preconfigured_representatives;
-	unsigned packet_delay_microseconds;
+	// Packets per second and burst sizes for all outgoing traffic and for each peer, a rate of 0 is unlimited
+	unsigned send_rate;
+	unsigned send_burst;
+	unsigned send_peer_rate;
+	unsigned send_peer_burst;
+	// Asynchronous sends outstanding on the socket at once
+	unsigned send_max_in_flight;
+	// Publishes go to max (broadcast_fanout, sqrt (peers)) peers, 0 sends to every peer
+	unsigned broadcast_fanout;
+	// Carry publish, confirm_req and confirm_ack over persistent TCP channels to peers' bootstrap ports, UDP remains the fallback
+	bool realtime_tcp;
+	unsigned realtime_channels_max;
 	unsigned bootstrap_fraction_numerator;
 	unsigned creation_rebroadcast;
 	unsigned rebroadcast_delay;
@@ -309,6 +600,21 @@ public:
 	unsigned password_fanout;
 	unsigned io_threads;
 	unsigned work_threads;
+	// Concurrent UDP receive operations, more than one binds extra SO_REUSEPORT sockets where supported
+	unsigned network_receivers;
+	// Move up to 64 datagrams per system call with recvmmsg and sendmmsg where supported
+	bool udp_batching;
+	// SO_RCVBUF and SO_SNDBUF for the UDP sockets in bytes, 0 keeps the system default
+	unsigned socket_receive_buffer;
+	unsigned socket_send_buffer;
+	// Sign votes for confirm_req answers and our own elections by hash, several blocks per signature
+	bool vote_bundling;
+	// Put a nonce in keepalives to measure peer round trip times, peers that predate it reject these keepalives
+	bool latency_probing;
+	// Votes by hash carry no work, ones from representatives with less weight are dropped before their signature is checked
+	rai::amount vote_minimum;
+	// Blocks kept per account when pruning, 0 keeps the full history
+	unsigned prune_depth;
     static std::chrono::seconds constexpr keepalive_period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr keepalive_cutoff = keepalive_period * 5;
 	static std::chrono::minutes constexpr wallet_backup_interval = std::chrono::minutes (5);
@@ -333,6 +639,180 @@ public:
 	std::vector <std::function <void (rai::endpoint const &)>> endpoint;
 	std::vector <std::function <void ()>> disconnect;
 };
+// Lock free record of blocks recently received from the network so copies arriving from other peers can skip the ledger
+// Each block maps to one slot holding a 40 bit fingerprint of its hash and work and the second it was first seen
+class recent_blocks
+{
+public:
+	recent_blocks ();
+	// Returns true if this block with this work was inserted less than max_age ago
+	bool check (rai::block_hash const &, uint64_t);
+	void insert (rai::block_hash const &, uint64_t);
+	// Forget the block if it's still the entry in its slot
+	void erase (rai::block_hash const &, uint64_t);
+	uint64_t entry (rai::block_hash const &, uint64_t, uint64_t);
+	uint64_t now ();
+	std::array <std::atomic <uint64_t>, 64 * 1024> slots;
+	std::chrono::steady_clock::time_point start;
+	std::atomic <uint64_t> duplicate_count;
+	static std::chrono::seconds constexpr max_age = std::chrono::seconds (60);
+	static uint64_t constexpr time_mask = 0xffffff;
+};
+class vote_filter_entry
+{
+public:
+	rai::account account;
+	std::chrono::steady_clock::time_point last;
+	// Digests of the most recent accepted votes, over the vote hash and signature
+	std::array <rai::uint256_union, 8> recent;
+	size_t recent_next;
+	std::chrono::steady_clock::time_point window_start;
+	size_t window_votes;
+	// Votes per root in the current window
+	std::unordered_map <rai::block_hash, size_t> roots;
+	// Accepted votes per second, averaged over windows
+	double rate;
+};
+// Drops repeated and excessive votes from a representative before they reach elections and their write transactions
+class vote_filter
+{
+public:
+	vote_filter ();
+	// Returns true if the vote should be dropped, votes from accounts without weight are dropped before they get an entry so they can't evict representatives
+	bool filter (rai::vote const &, rai::uint128_t const &);
+	// Representatives with the highest vote rates
+	std::vector <std::pair <rai::account, double>> rates (size_t);
+	size_t size ();
+	rai::uint256_union digest (rai::vote const &);
+	// Returns true if the vote repeats a recent one or exceeds the entry's window limits, must be called with mutex held
+	bool limited (rai::vote_filter_entry const &, rai::uint256_union const &, std::vector <rai::block_hash> const &, std::chrono::steady_clock::time_point const &);
+	boost::multi_index_container
+	<
+		rai::vote_filter_entry,
+		boost::multi_index::indexed_by
+		<
+			boost::multi_index::hashed_unique <boost::multi_index::member <rai::vote_filter_entry, rai::account, &rai::vote_filter_entry::account>>,
+			boost::multi_index::ordered_non_unique <boost::multi_index::member <rai::vote_filter_entry, std::chrono::steady_clock::time_point, &rai::vote_filter_entry::last>>
+		>
+	> entries;
+	std::mutex mutex;
+	std::atomic <uint64_t> duplicate_count;
+	std::atomic <uint64_t> limited_count;
+	std::atomic <uint64_t> invalid_count;
+	std::atomic <uint64_t> unweighted_count;
+	static size_t constexpr max_entries = 4096;
+	// Accepted votes allowed per window for one root and for all roots from one representative
+	static size_t constexpr root_votes = 4;
+	static size_t constexpr representative_votes = 256;
+	static std::chrono::milliseconds const window;
+};
+// Collects blocks to vote on for peers over a short window so each representative signs one vote for up to vote::hashes_max of them
+// Our own votes aren't bundled, election::recompute_winner applies them straight away so the tally it broadcasts includes them
+class vote_bundler
+{
+public:
+	vote_bundler (rai::node &);
+	// Answer a confirm_req from the endpoint
+	void add (rai::block_hash const &, rai::endpoint const &);
+	void flush ();
+	void schedule ();
+	rai::node & node;
+	std::unordered_map <rai::endpoint_key, std::unordered_set <rai::block_hash>> remote;
+	bool scheduled;
+	std::mutex mutex;
+	std::atomic <uint64_t> signature_count;
+	std::atomic <uint64_t> hash_count;
+	static std::chrono::milliseconds const delay;
+};
+// Collects blocks to request votes on over a short window so each peer is asked about up to confirm_req::roots_hashes_max of them per message
+class confirm_req_batcher
+{
+public:
+	confirm_req_batcher (rai::node &);
+	// Without vote_bundling the block is requested on its own straight away
+	void add (rai::block const &);
+	void flush ();
+	void schedule ();
+	rai::node & node;
+	std::vector <std::pair <rai::block_hash, rai::block_hash>> pending;
+	bool scheduled;
+	std::mutex mutex;
+	std::atomic <uint64_t> request_count;
+	static std::chrono::milliseconds const delay;
+};
+// Queues are drained in this order, each getting a share of every batch
+enum class block_origin : uint8_t
+{
+	local,
+	confirm_ack,
+	publish,
+	confirm_req
+};
+class block_processor_item
+{
+public:
+	// Null when the block was a recent duplicate and only the callback needs to run
+	std::shared_ptr <rai::block const> block;
+	size_t rebroadcast;
+	std::chrono::steady_clock::time_point arrival;
+	// Run once the block has been processed and committed
+	std::function <void ()> processed;
+	rai::block_origin origin;
+	rai::endpoint sender;
+	// Work value for published and requested blocks, 0 for votes until their signature is checked, higher is processed first
+	uint64_t priority;
+};
+// Bounded queue for one message type, highest priority first
+class block_processor_queue
+{
+public:
+	block_processor_queue (size_t, size_t);
+	// Returns true if the item was dropped, a full queue evicts its lowest priority item for a higher one and appends it to `evicted'
+	bool push (rai::block_processor_item, std::vector <rai::block_processor_item> & evicted);
+	rai::block_processor_item pop ();
+	bool empty () const;
+	size_t size () const;
+	void clear ();
+	void remove (std::multimap <uint64_t, rai::block_processor_item, std::greater <uint64_t>>::iterator);
+	size_t capacity;
+	// Once the queue is half full a sender may hold at most this many items
+	size_t peer_max;
+	std::multimap <uint64_t, rai::block_processor_item, std::greater <uint64_t>> items;
+	std::unordered_map <rai::endpoint_key, size_t> senders;
+	uint64_t drop_count;
+};
+// Processes blocks received from the network on a dedicated thread, in batches that share one write transaction
+class block_processor
+{
+public:
+	block_processor (rai::node &);
+	~block_processor ();
+	void stop ();
+	// Returns true if the queue is full and the block was dropped
+	bool add (std::unique_ptr <rai::block>, size_t, std::function <void ()> const & = nullptr);
+	bool add (rai::block_processor_item);
+	// Wait until all queued blocks have been processed
+	void flush ();
+	size_t size ();
+	size_t size_locked ();
+	void run ();
+	void process_batch (std::deque <rai::block_processor_item> &);
+	rai::node & node;
+	// Indexed by block_origin
+	std::array <rai::block_processor_queue, 4> queues;
+	bool stopped;
+	bool active;
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::atomic <uint64_t> processed_count;
+	std::atomic <uint64_t> drop_count;
+	// Sum of queueing delays in microseconds, divide by processed_count for the average
+	std::atomic <uint64_t> latency_total;
+	std::atomic <uint64_t> latency_max;
+	std::thread thread;
+	static size_t constexpr max_size = 16384;
+	static size_t constexpr batch_size = 256;
+};
 class node : public std::enable_shared_from_this <rai::node>
 {
 public:
@@ -354,8 +834,13 @@ public:
     void process_confirmed (rai::block const &);
 	void process_message (rai::message &, rai::endpoint const &);
     void process_confirmation (rai::block const &, rai::endpoint const &);
+    void process_confirmation (std::vector <std::pair <rai::block_hash, rai::block_hash>> const &, rai::endpoint const &);
+    // Sign and send a vote carrying the block from each of our representatives
+    void send_votes (rai::block const &, rai::endpoint const &);
     void process_receive_republish (std::unique_ptr <rai::block>, size_t);
+    void process_receive_republish (rai::transaction &, std::shared_ptr <rai::block const>, size_t, std::vector <std::tuple <rai::process_return, std::shared_ptr <rai::block const>>> &);
     void process_receive_many (rai::transaction &, rai::block const &, std::function <void (rai::process_return, rai::block const &)> = [] (rai::process_return, rai::block const &) {});
+    void process_receive_many (rai::transaction &, std::shared_ptr <rai::block const>, std::function <void (rai::process_return, std::shared_ptr <rai::block const> const &)> const &);
     rai::process_return process_receive_one (rai::transaction &, rai::block const &);
 	rai::process_return process (rai::block const &);
     void keepalive_preconfigured (std::vector <std::string> const &);
@@ -365,6 +850,8 @@ public:
 	rai::account representative (rai::account const &);
     void ongoing_keepalive ();
 	void backup_wallet ();
+	void ongoing_prune ();
+	void ongoing_peer_publish ();
 	int price (rai::uint128_t const &, int);
 	void generate_work (rai::block &);
 	uint64_t generate_work (rai::uint256_union const &);
@@ -384,11 +871,21 @@ public:
     rai::peer_container peers;
 	boost::filesystem::path application_path;
 	rai::node_observers observers;
+	rai::recent_blocks recent_blocks;
+	rai::vote_filter vote_filter;
+	rai::vote_bundler vote_bundler;
+	rai::confirm_req_batcher confirm_req_batcher;
+	// Declared after the members its thread uses since the thread starts in its constructor
+	rai::block_processor block_processor;
 	static double constexpr price_max = 16.0;
 	static double constexpr free_cutoff = 1024.0;
     static std::chrono::seconds constexpr period = std::chrono::seconds (60);
     static std::chrono::seconds constexpr cutoff = period * 5;
 	static std::chrono::minutes constexpr backup_interval = std::chrono::minutes (5);
+	static std::chrono::minutes constexpr prune_interval = std::chrono::minutes (10);
+	// Contact and probe updates batched by peer_container are published at least this often
+	static std::chrono::seconds constexpr peer_publish_interval = std::chrono::seconds (1);
+	static size_t constexpr prune_batch = 1024;
 };
 class thread_runner
 {
@@ -421,6 +421,33 @@ void rai::rpc_handler::chain ()
 	}
 }
 
+void rai::rpc_handler::confirmation_height ()
+{
+	std::string account_text (request.get <std::string> ("account"));
+	rai::uint256_union account;
+	auto error (account.decode_account (account_text));
+	if (!error)
+	{
+		rai::transaction transaction (rpc.node.store.environment, nullptr, false);
+		rai::account_info info;
+		if (!rpc.node.store.account_get (transaction, account, info))
+		{
+			boost::property_tree::ptree response_l;
+			response_l.put ("confirmation_height", std::to_string (info.confirmation_height));
+			response_l.put ("block_count", std::to_string (info.block_count));
+			rpc.send_response (connection, response_l);
+		}
+		else
+		{
+			rpc.error_response (connection, "Account not found");
+		}
+	}
+	else
+	{
+		rpc.error_response (connection, "Bad account number");
+	}
+}
+
 void rai::rpc_handler::frontiers ()
 {
 	std::string account_text (request.get <std::string> ("account"));
@@ -663,6 +690,89 @@ void rai::rpc_handler::krai_to_raw ()
 	}
 }
 
+void rai::rpc_handler::network_stats ()
+{
+	auto & network (rpc.node.network);
+	boost::property_tree::ptree response_l;
+	response_l.put ("keepalive", std::to_string (network.keepalive_count));
+	response_l.put ("publish", std::to_string (network.publish_count));
+	response_l.put ("confirm_req", std::to_string (network.confirm_req_count));
+	response_l.put ("confirm_ack", std::to_string (network.confirm_ack_count));
+	response_l.put ("error", std::to_string (network.error_count));
+	response_l.put ("bad_sender", std::to_string (network.bad_sender_count));
+	response_l.put ("insufficient_work", std::to_string (network.insufficient_work_count));
+	response_l.put ("insufficient_weight", std::to_string (network.insufficient_weight_count));
+	response_l.put ("drop", std::to_string (network.drop_count ()));
+	auto & peers (rpc.node.peers);
+	response_l.put ("known_suppressed", std::to_string (peers.known_suppressed_count));
+	response_l.put ("known_sent", std::to_string (peers.known_sent_count));
+	response_l.put ("known_false_positive_rate", std::to_string (peers.known_false_positive_rate ()));
+	boost::property_tree::ptree receivers;
+	for (auto & i: network.receivers)
+	{
+		boost::property_tree::ptree entry;
+		entry.put ("port", std::to_string (i->socket.local_endpoint ().port ()));
+		entry.put ("received", std::to_string (i->receive_count));
+		entry.put ("kernel_drops", std::to_string (rai::udp_drop_count (i->socket)));
+		entry.put ("drop_counter", std::to_string (i->drop_count));
+		receivers.push_back (std::make_pair ("", entry));
+	}
+	response_l.add_child ("receivers", receivers);
+	boost::property_tree::ptree realtime_l;
+	realtime_l.put ("channels", std::to_string (network.realtime.size ()));
+	realtime_l.put ("sent", std::to_string (network.realtime.sent_count));
+	realtime_l.put ("sent_bytes", std::to_string (network.realtime.sent_bytes));
+	realtime_l.put ("received", std::to_string (network.realtime.received_count));
+	realtime_l.put ("received_bytes", std::to_string (network.realtime.received_bytes));
+	realtime_l.put ("latency_us", std::to_string (network.realtime.latency_microseconds));
+	response_l.add_child ("realtime", realtime_l);
+	{
+		std::lock_guard <std::mutex> lock (network.socket_mutex);
+		response_l.put ("send_queue", std::to_string (network.scheduler.size ()));
+		response_l.put ("send_in_flight", std::to_string (network.in_flight));
+	}
+	auto & block_processor (rpc.node.block_processor);
+	boost::property_tree::ptree block_processor_l;
+	block_processor_l.put ("depth", std::to_string (block_processor.size ()));
+	block_processor_l.put ("processed", std::to_string (block_processor.processed_count));
+	block_processor_l.put ("dropped", std::to_string (block_processor.drop_count));
+	block_processor_l.put ("latency_total_us", std::to_string (block_processor.latency_total));
+	block_processor_l.put ("latency_max_us", std::to_string (block_processor.latency_max));
+	block_processor_l.put ("duplicates", std::to_string (rpc.node.recent_blocks.duplicate_count));
+	{
+		std::lock_guard <std::mutex> lock (block_processor.mutex);
+		std::array <char const *, 4> names ({{"local", "confirm_ack", "publish", "confirm_req"}});
+		boost::property_tree::ptree queues_l;
+		for (size_t i (0); i < block_processor.queues.size (); ++i)
+		{
+			boost::property_tree::ptree entry;
+			entry.put ("depth", std::to_string (block_processor.queues [i].size ()));
+			entry.put ("dropped", std::to_string (block_processor.queues [i].drop_count));
+			queues_l.add_child (names [i], entry);
+		}
+		block_processor_l.add_child ("queues", queues_l);
+	}
+	response_l.add_child ("block_processor", block_processor_l);
+	auto & vote_filter (rpc.node.vote_filter);
+	boost::property_tree::ptree votes_l;
+	votes_l.put ("duplicates", std::to_string (vote_filter.duplicate_count));
+	votes_l.put ("limited", std::to_string (vote_filter.limited_count));
+	votes_l.put ("invalid", std::to_string (vote_filter.invalid_count));
+	votes_l.put ("unweighted", std::to_string (vote_filter.unweighted_count));
+	votes_l.put ("representatives", std::to_string (vote_filter.size ()));
+	boost::property_tree::ptree rates_l;
+	for (auto & i: vote_filter.rates (16))
+	{
+		rates_l.put (i.first.to_account (), std::to_string (i.second));
+	}
+	votes_l.add_child ("rates", rates_l);
+	votes_l.put ("bundled_signatures", std::to_string (rpc.node.vote_bundler.signature_count));
+	votes_l.put ("bundled_hashes", std::to_string (rpc.node.vote_bundler.hash_count));
+	votes_l.put ("batched_confirm_reqs", std::to_string (rpc.node.confirm_req_batcher.request_count));
+	response_l.add_child ("votes", votes_l);
+	rpc.send_response (connection, response_l);
+}
+
 void rai::rpc_handler::password_change ()
 {
 	if (rpc.config.enable_control)
@@ -1612,6 +1722,10 @@ void rai::rpc_handler::process_request ()
 		{
 			chain ();
 		}
+		else if (action == "confirmation_height")
+		{
+			confirmation_height ();
+		}
 		else if (action == "frontiers")
 		{
 			frontiers ();
@@ -1644,6 +1758,10 @@ void rai::rpc_handler::process_request ()
 		{
 			mrai_to_raw ();
 		}
+		else if (action == "network_stats")
+		{
+			network_stats ();
+		}
 		else if (action == "password_change")
 		{
 			// Processed before logging
@@ -1796,7 +1914,7 @@ connection (connection_a)
 void rai::payment_observer::start (uint64_t timeout)
 {
 	auto this_l (shared_from_this ());
-	rpc.node.alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (timeout), [this_l] ()
+	timeout_operation = rpc.node.alarm.add (std::chrono::system_clock::now () + std::chrono::milliseconds (timeout), [this_l] ()
 	{
 		this_l->complete (rai::payment_status::nothing);
 	});
@@ -1845,6 +1963,9 @@ void rai::payment_observer::complete (rai::payment_status status)
 				break;
 			}
 		}
+		// The pending timeout holds a reference to this observer, cancelling releases it now rather than when the timeout would have expired
+		rpc.node.alarm.cancel (timeout_operation);
+		timeout_operation.reset ();
 		std::lock_guard <std::mutex> lock (rpc.mutex);
 		assert (rpc.payment_observers.find (account) != rpc.payment_observers.end ());
 		rpc.payment_observers.erase (account);
@@ -14,6 +14,7 @@
 namespace rai
 {
 class node;
+class operation;
 class rpc_config
 {
 public:
@@ -74,6 +75,7 @@ public:
 	rai::account account;
 	rai::amount amount;
 	boost::network::http::async_server <rai::rpc>::connection_ptr connection;
+	std::shared_ptr <rai::operation> timeout_operation;
 	std::atomic_flag completed;
 };
 class rpc_handler : public std::enable_shared_from_this <rai::rpc_handler>
@@ -93,6 +95,7 @@ public:
 	void block_account ();
 	void block_count ();
 	void chain ();
+	void confirmation_height ();
 	void frontiers ();
 	void frontier_count ();
 	void history ();
@@ -101,6 +104,7 @@ public:
 	void krai_from_raw ();
 	void mrai_to_raw ();
 	void mrai_from_raw ();
+	void network_stats ();
 	void password_change ();
 	void password_enter ();
 	void password_valid ();
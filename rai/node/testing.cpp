@@ -215,6 +215,40 @@ void rai::system::generate_mass_activity (uint32_t count_a, rai::node & node_a)
     }
 }
 
+std::chrono::milliseconds rai::system::propagate (rai::block const & block_a, uint64_t & packets_a)
+{
+	auto hash (block_a.hash ());
+	auto received ([this] ()
+	{
+		uint64_t result (0);
+		for (auto & i: nodes)
+		{
+			result += i->network.publish_count + i->network.confirm_ack_count;
+		}
+		return result;
+	});
+	auto initial (received ());
+	auto start (std::chrono::steady_clock::now ());
+	nodes [0]->process_receive_republish (block_a.clone (), 0);
+	auto done (false);
+	while (!done)
+	{
+		poll ();
+		done = std::all_of (nodes.begin (), nodes.end (), [&hash] (std::shared_ptr <rai::node> const & node_a)
+		{
+			rai::transaction transaction (node_a->store.environment, nullptr, false);
+			return node_a->store.block_exists (transaction, hash);
+		});
+	}
+	auto result (std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - start));
+	// Let redundant copies still in flight be counted
+	while (service->poll () != 0)
+	{
+	}
+	packets_a = received () - initial;
+	return result;
+}
+
 void rai::system::stop ()
 {
 	for (auto i : nodes)
@@ -21,6 +21,8 @@ public:
     rai::account account (MDB_txn *, size_t);
 	void poll ();
 	void stop ();
+	// Publish a block from the first node and poll until every node has it, returns the time taken and counts the publish and confirm_ack packets received
+	std::chrono::milliseconds propagate (rai::block const &, uint64_t &);
     boost::shared_ptr <boost::asio::io_service> service;
     rai::alarm alarm;
     std::vector <std::shared_ptr <rai::node>> nodes;
@@ -143,7 +143,7 @@ bool rai::work_pool::work_validate (rai::block_hash const & root_a, uint64_t wor
 	return result;
 }
 
-bool rai::work_pool::work_validate (rai::block & block_a)
+bool rai::work_pool::work_validate (rai::block const & block_a)
 {
     return work_validate (block_a.root (), block_a.block_work ());
 }
@@ -1236,7 +1236,7 @@ public:
 							// If there were any forks for this account they've been rolled back and we can receive anything remaining from this account
 							this_l->receive_all (account);
 						});
-						this_l->wallet->node.network.broadcast_confirm_req (*block_l);
+						this_l->wallet->node.confirm_req_batcher.add (*block_l);
 					});
 					already_searched.insert (account);
 				}
@@ -24,7 +24,7 @@ public:
 	uint64_t generate (rai::uint256_union const &);
 	boost::optional <uint64_t> generate_maybe (rai::uint256_union const &);
 	uint64_t work_value (rai::block_hash const &, uint64_t);
-	bool work_validate (rai::block &);
+	bool work_validate (rai::block const &);
 	bool work_validate (rai::block_hash const &, uint64_t);
 	rai::uint256_union current;
 	std::atomic <int> ticket;
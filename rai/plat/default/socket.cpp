@@ -0,0 +1,33 @@
+#include <rai/node/node.hpp>
+
+bool rai::udp_reuse_port (boost::asio::ip::udp::socket &)
+{
+	return true;
+}
+
+uint64_t rai::udp_drop_count (boost::asio::ip::udp::socket &)
+{
+	return 0;
+}
+
+bool rai::udp_drop_counter (boost::asio::ip::udp::socket &)
+{
+	return true;
+}
+
+bool rai::udp_batch_supported ()
+{
+	return false;
+}
+
+size_t rai::udp_receive_batch (boost::asio::ip::udp::socket &, rai::udp_datagram *, size_t, boost::system::error_code & ec)
+{
+	ec = boost::asio::error::operation_not_supported;
+	return 0;
+}
+
+size_t rai::udp_send_batch (boost::asio::ip::udp::socket &, rai::udp_datagram const *, size_t, boost::system::error_code & ec)
+{
+	ec = boost::asio::error::operation_not_supported;
+	return 0;
+}
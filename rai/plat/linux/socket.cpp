@@ -0,0 +1,152 @@
+#include <rai/node/node.hpp>
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <sstream>
+
+bool rai::udp_reuse_port (boost::asio::ip::udp::socket & socket_a)
+{
+	int enable (1);
+	return setsockopt (socket_a.native_handle (), SOL_SOCKET, SO_REUSEPORT, &enable, sizeof (enable)) != 0;
+}
+
+uint64_t rai::udp_drop_count (boost::asio::ip::udp::socket & socket_a)
+{
+	uint64_t result (0);
+	struct stat status;
+	if (fstat (socket_a.native_handle (), &status) == 0)
+	{
+		// The last column of /proc/net/udp6 is the drop counter, rows are matched by socket inode
+		std::ifstream table ("/proc/net/udp6");
+		std::string line;
+		std::getline (table, line);
+		auto found (false);
+		while (!found && std::getline (table, line))
+		{
+			std::istringstream columns (line);
+			std::string column;
+			uint64_t inode (0);
+			for (auto i (0); i < 10 && columns >> column; ++i)
+			{
+				if (i == 9)
+				{
+					inode = std::strtoull (column.c_str (), nullptr, 10);
+				}
+			}
+			if (inode == status.st_ino)
+			{
+				found = true;
+				std::string drops;
+				while (columns >> column)
+				{
+					drops = column;
+				}
+				result = std::strtoull (drops.c_str (), nullptr, 10);
+			}
+		}
+	}
+	return result;
+}
+
+bool rai::udp_drop_counter (boost::asio::ip::udp::socket & socket_a)
+{
+	int enable (1);
+	return setsockopt (socket_a.native_handle (), SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof (enable)) != 0;
+}
+
+bool rai::udp_batch_supported ()
+{
+	return true;
+}
+
+size_t rai::udp_receive_batch (boost::asio::ip::udp::socket & socket_a, rai::udp_datagram * datagrams_a, size_t count_a, boost::system::error_code & ec)
+{
+	assert (count_a <= rai::udp_receiver::batch_size);
+	std::array <mmsghdr, rai::udp_receiver::batch_size> messages;
+	std::array <iovec, rai::udp_receiver::batch_size> vectors;
+	std::array <sockaddr_in6, rai::udp_receiver::batch_size> addresses;
+	// Room for the SO_RXQ_OVFL counter
+	std::array <std::aligned_storage <CMSG_SPACE (sizeof (uint32_t)), alignof (cmsghdr)>::type, rai::udp_receiver::batch_size> controls;
+	for (auto i (0u); i < count_a; ++i)
+	{
+		vectors [i].iov_base = datagrams_a [i].data;
+		vectors [i].iov_len = datagrams_a [i].size;
+		messages [i].msg_hdr = msghdr ();
+		messages [i].msg_hdr.msg_name = &addresses [i];
+		messages [i].msg_hdr.msg_namelen = sizeof (addresses [i]);
+		messages [i].msg_hdr.msg_iov = &vectors [i];
+		messages [i].msg_hdr.msg_iovlen = 1;
+		messages [i].msg_hdr.msg_control = &controls [i];
+		messages [i].msg_hdr.msg_controllen = sizeof (controls [i]);
+		messages [i].msg_len = 0;
+	}
+	size_t result (0);
+	auto status (recvmmsg (socket_a.native_handle (), messages.data (), count_a, MSG_DONTWAIT, nullptr));
+	if (status >= 0)
+	{
+		ec = boost::system::error_code ();
+		result = status;
+		for (auto i (0u); i < result; ++i)
+		{
+			datagrams_a [i].size = messages [i].msg_len;
+			auto length (std::min <size_t> (messages [i].msg_hdr.msg_namelen, datagrams_a [i].endpoint.capacity ()));
+			std::copy (reinterpret_cast <uint8_t const *> (&addresses [i]), reinterpret_cast <uint8_t const *> (&addresses [i]) + length, reinterpret_cast <uint8_t *> (datagrams_a [i].endpoint.data ()));
+			datagrams_a [i].endpoint.resize (length);
+			datagrams_a [i].drops = 0;
+			for (auto control (CMSG_FIRSTHDR (&messages [i].msg_hdr)); control != nullptr; control = CMSG_NXTHDR (&messages [i].msg_hdr, control))
+			{
+				if (control->cmsg_level == SOL_SOCKET && control->cmsg_type == SO_RXQ_OVFL)
+				{
+					std::copy (CMSG_DATA (control), CMSG_DATA (control) + sizeof (uint32_t), reinterpret_cast <uint8_t *> (&datagrams_a [i].drops));
+				}
+			}
+		}
+	}
+	else if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+		ec = boost::system::error_code ();
+	}
+	else
+	{
+		ec = boost::system::error_code (errno, boost::system::system_category ());
+	}
+	return result;
+}
+
+size_t rai::udp_send_batch (boost::asio::ip::udp::socket & socket_a, rai::udp_datagram const * datagrams_a, size_t count_a, boost::system::error_code & ec)
+{
+	assert (count_a <= rai::udp_receiver::batch_size);
+	std::array <mmsghdr, rai::udp_receiver::batch_size> messages;
+	std::array <iovec, rai::udp_receiver::batch_size> vectors;
+	for (auto i (0u); i < count_a; ++i)
+	{
+		vectors [i].iov_base = datagrams_a [i].data;
+		vectors [i].iov_len = datagrams_a [i].size;
+		messages [i].msg_hdr = msghdr ();
+		messages [i].msg_hdr.msg_name = const_cast <sockaddr *> (datagrams_a [i].endpoint.data ());
+		messages [i].msg_hdr.msg_namelen = datagrams_a [i].endpoint.size ();
+		messages [i].msg_hdr.msg_iov = &vectors [i];
+		messages [i].msg_hdr.msg_iovlen = 1;
+		messages [i].msg_len = 0;
+	}
+	size_t result (0);
+	auto status (sendmmsg (socket_a.native_handle (), messages.data (), count_a, MSG_DONTWAIT));
+	if (status >= 0)
+	{
+		ec = boost::system::error_code ();
+		result = status;
+	}
+	else if (errno == EAGAIN || errno == EWOULDBLOCK)
+	{
+		ec = boost::system::error_code ();
+	}
+	else
+	{
+		ec = boost::system::error_code (errno, boost::system::system_category ());
+	}
+	return result;
+}
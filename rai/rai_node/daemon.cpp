@@ -95,7 +95,7 @@ bool rai_daemon::daemon_config::upgrade_json (unsigned version_a, boost::propert
 	return result;
 }
 
-void rai_daemon::daemon::run ()
+void rai_daemon::daemon::run (std::ostream * capture_a)
 {
     auto working (rai::working_path ());
 	boost::filesystem::create_directories (working);
@@ -115,6 +115,10 @@ void rai_daemon::daemon::run ()
 		auto pool (boost::make_shared <boost::network::utils::thread_pool> (node->config.io_threads));
 		if (!init.error ())
 		{
+			if (capture_a != nullptr)
+			{
+				node->network.capture = std::make_shared <rai::packet_capture> (*capture_a);
+			}
 			node->start ();
 			rai::rpc rpc (service, pool, *node, config.rpc);
 			if (config.rpc_enable)
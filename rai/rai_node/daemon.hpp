@@ -6,7 +6,8 @@ namespace rai_daemon
     class daemon
     {
     public:
-        void run ();
+        // Record inbound datagrams to the stream when it's set
+        void run (std::ostream * = nullptr);
     };
     class daemon_config
     {
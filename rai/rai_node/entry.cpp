@@ -115,14 +115,19 @@ int main (int argc, char * const * argv)
 		("daemon", "Start node daemon")
 		("debug_block_count", "Display the number of block")
 		("debug_bootstrap_generate", "Generate bootstrap sequence of blocks")
+		("debug_capture", "Run the node daemon recording every inbound datagram to <file>")
 		("debug_dump_representatives", "List representatives and weights")
 		("debug_frontier_count", "Display the number of accounts")
 		("debug_mass_activity", "Generates fake debug activity")
 		("debug_profile_generate", "Profile work generation")
 		("debug_profile_verify", "Profile work verification")
 		("debug_profile_kdf", "Profile kdf function")
+		("debug_profile_udp", "Profile loopback UDP packets per second with and without recvmmsg/sendmmsg batching")
+		("debug_replay", "Feed datagrams recorded by debug_capture in <file> to a fresh node, or a copy of the node in <data_path>, at <speed> and report throughput")
 		("debug_verify_profile", "Profile signature verification")
-		("debug_xorshift_profile", "Profile xorshift algorithms");
+		("debug_xorshift_profile", "Profile xorshift algorithms")
+		("data_path", boost::program_options::value <std::string> (), "Data directory of the capturing node for debug_replay, its data.ldb is copied so the original isn't modified, stop that node first")
+		("speed", boost::program_options::value <double> ()->default_value (1.0), "Multiple of the recorded pace for debug_replay, 0 replays as fast as possible");
 	boost::program_options::variables_map vm;
 	boost::program_options::store (boost::program_options::parse_command_line(argc, argv, description), vm);
 	boost::program_options::notify (vm);
@@ -217,6 +222,30 @@ int main (int argc, char * const * argv)
 			std::cout << boost::str(boost::format("%1% %2% %3%\n") % i->first.to_account () % i->second.convert_to <std::string> () % total.convert_to<std::string> ());
 		}
 	}
+	else if (vm.count ("debug_capture"))
+	{
+		if (vm.count ("file") == 1)
+		{
+			std::string filename (vm ["file"].as <std::string> ());
+			std::ofstream stream;
+			stream.open (filename.c_str (), std::ios::binary);
+			if (!stream.fail ())
+			{
+				rai_daemon::daemon daemon;
+				daemon.run (&stream);
+			}
+			else
+			{
+				std::cerr << "Unable to open <file>\n";
+				result = -1;
+			}
+		}
+		else
+		{
+			std::cerr << "debug_capture requires one <file> option\n";
+			result = -1;
+		}
+	}
 	else if (vm.count ("debug_frontier_count"))
 	{
 		rai::inactive_node node;
@@ -242,6 +271,162 @@ int main (int argc, char * const * argv)
             std::cerr << boost::str (boost::format ("Derivation time: %1%us\n") % std::chrono::duration_cast <std::chrono::microseconds> (end1 - begin1).count ());
         }
     }
+    else if (vm.count ("debug_profile_udp"))
+    {
+		size_t const count (200000);
+		size_t const size (216);
+		for (auto batched : {false, true})
+		{
+			if (batched && !rai::udp_batch_supported ())
+			{
+				std::cerr << "Batched datagram I/O isn't supported on this platform\n";
+				break;
+			}
+			boost::asio::io_service service;
+			boost::asio::ip::udp::socket receiver (service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0));
+			boost::asio::ip::udp::socket sender (service, rai::endpoint (boost::asio::ip::address_v6::loopback (), 0));
+			receiver.non_blocking (true);
+			sender.non_blocking (true);
+			rai::endpoint destination (receiver.local_endpoint ());
+			std::atomic <size_t> received (0);
+			std::atomic <bool> sending (true);
+			std::chrono::steady_clock::time_point last_receive;
+			auto begin (std::chrono::steady_clock::now ());
+			std::thread thread ([&] ()
+			{
+				std::vector <std::array <uint8_t, 512>> buffers (rai::udp_receiver::batch_size);
+				auto idle (std::chrono::steady_clock::now ());
+				while (sending || std::chrono::steady_clock::now () - idle < std::chrono::milliseconds (200))
+				{
+					size_t count (0);
+					if (batched)
+					{
+						std::array <rai::udp_datagram, rai::udp_receiver::batch_size> datagrams;
+						for (auto i (0u); i < datagrams.size (); ++i)
+						{
+							datagrams [i].data = buffers [i].data ();
+							datagrams [i].size = buffers [i].size ();
+						}
+						boost::system::error_code ec;
+						count = rai::udp_receive_batch (receiver, datagrams.data (), datagrams.size (), ec);
+					}
+					else
+					{
+						rai::endpoint remote;
+						boost::system::error_code ec;
+						receiver.receive_from (boost::asio::buffer (buffers [0].data (), buffers [0].size ()), remote, 0, ec);
+						count = ec ? 0 : 1;
+					}
+					if (count > 0)
+					{
+						received += count;
+						idle = last_receive = std::chrono::steady_clock::now ();
+					}
+					else
+					{
+						std::this_thread::yield ();
+					}
+				}
+			});
+			std::vector <uint8_t> payload (size, 0);
+			std::array <rai::udp_datagram, rai::udp_receiver::batch_size> datagrams;
+			for (auto & i: datagrams)
+			{
+				i.data = payload.data ();
+				i.size = payload.size ();
+				i.endpoint = destination;
+			}
+			size_t sent (0);
+			while (sent < count)
+			{
+				boost::system::error_code ec;
+				if (batched)
+				{
+					sent += rai::udp_send_batch (sender, datagrams.data (), std::min (datagrams.size (), count - sent), ec);
+				}
+				else
+				{
+					sender.send_to (boost::asio::buffer (payload.data (), payload.size ()), destination, 0, ec);
+					sent += ec ? 0 : 1;
+				}
+			}
+			auto send_end (std::chrono::steady_clock::now ());
+			sending = false;
+			thread.join ();
+			auto send_us (std::max <int64_t> (1, std::chrono::duration_cast <std::chrono::microseconds> (send_end - begin).count ()));
+			auto receive_us (std::max <int64_t> (1, std::chrono::duration_cast <std::chrono::microseconds> (last_receive - begin).count ()));
+			std::cerr << boost::str (boost::format ("%1%: sent %2% packets at %3% pps, received %4% packets at %5% pps\n") % (batched ? "sendmmsg/recvmmsg" : "send_to/receive_from") % sent % (sent * 1000000 / send_us) % received % (received * 1000000 / receive_us));
+		}
+    }
+    else if (vm.count ("debug_replay"))
+    {
+		if (vm.count ("file") == 1)
+		{
+			std::string filename (vm ["file"].as <std::string> ());
+			std::ifstream stream;
+			stream.open (filename.c_str (), std::ios::binary);
+			auto error (stream.fail ());
+			if (error)
+			{
+				std::cerr << "Unable to open <file>\n";
+			}
+			// Replaying onto the capturing node's ledger processes blocks the way it did, a fresh node only knows the genesis
+			rai::system system (24000, vm.count ("data_path") ? 0 : 1);
+			if (!error && vm.count ("data_path"))
+			{
+				boost::filesystem::path data_path (vm ["data_path"].as <std::string> ());
+				auto path (rai::unique_path ());
+				boost::filesystem::create_directories (path);
+				boost::system::error_code ec;
+				boost::filesystem::copy_file (data_path / "data.ldb", path / "data.ldb", ec);
+				error = !!ec;
+				if (!error)
+				{
+					rai::node_init init;
+					auto node_l (std::make_shared <rai::node> (init, *system.service, path, system.alarm, rai::node_config (24000, system.logging), system.work));
+					error = init.error ();
+					if (!error)
+					{
+						node_l->start ();
+						system.nodes.push_back (node_l);
+					}
+				}
+				if (error)
+				{
+					std::cerr << boost::str (boost::format ("Unable to open a copy of %1%\n") % (data_path / "data.ldb").string ());
+				}
+			}
+			if (!error)
+			{
+				auto & node (*system.nodes [0]);
+				rai::packet_replay replay (node, stream);
+				std::thread runner ([&system] () { system.service->run (); });
+				auto malformed (replay.run (vm ["speed"].as <double> ()));
+				auto receive_ms (std::max <int64_t> (1, std::chrono::duration_cast <std::chrono::milliseconds> (replay.receive_time).count ()));
+				auto process_ms (std::max <int64_t> (1, std::chrono::duration_cast <std::chrono::milliseconds> (replay.process_time).count ()));
+				std::cout << boost::str (boost::format ("Replayed %1% datagrams in %2%ms, %3% per second\n") % replay.read_count % receive_ms % (replay.read_count * 1000 / receive_ms));
+				std::cout << boost::str (boost::format ("Block processor depth: mean %1%, max %2%\n") % replay.queue_mean % replay.queue_max);
+				std::cout << boost::str (boost::format ("Committed %1% blocks in %2%ms, %3% per second\n") % replay.committed_count % process_ms % (replay.committed_count * 1000 / process_ms));
+				std::cout << boost::str (boost::format ("Parse errors: %1%, insufficient work: %2%, duplicate or limited votes: %3%\n") % node.network.error_count % node.network.insufficient_work_count % (node.vote_filter.duplicate_count + node.vote_filter.limited_count));
+				if (malformed)
+				{
+					std::cerr << "Malformed record in <file>\n";
+					result = -1;
+				}
+				system.service->stop ();
+				runner.join ();
+			}
+			else
+			{
+				result = -1;
+			}
+		}
+		else
+		{
+			std::cerr << "debug_replay requires one <file> option\n";
+			result = -1;
+		}
+    }
     else if (vm.count ("debug_profile_generate"))
     {
 		rai::work_pool work (nullptr);
@@ -79,6 +79,7 @@ size_t constexpr rai::send_block::size;
 size_t constexpr rai::receive_block::size;
 size_t constexpr rai::open_block::size;
 size_t constexpr rai::change_block::size;
+size_t constexpr rai::vote::hashes_max;
 
 rai::keypair const & rai::zero_key (globals.zero_key);
 rai::keypair const & rai::test_genesis_key (globals.test_genesis_key);
@@ -123,11 +124,20 @@ bool rai::unique_ptr_block_hash::operator () (std::unique_ptr <rai::block> const
 	return *lhs == *rhs;
 }
 
-bool rai::votes::vote (MDB_txn * transaction_a, rai::block_store & store_a, rai::vote const & vote_a)
+bool rai::votes::vote (MDB_txn * transaction_a, rai::block_store & store_a, rai::vote const & vote_a, bool validated_a)
 {
 	auto result (false);
+	std::lock_guard <std::mutex> lock (mutex);
+	auto block (vote_a.block);
+	for (auto i (rep_votes.begin ()), n (rep_votes.end ()); block == nullptr && i != n; ++i)
+	{
+		if (std::find (vote_a.hashes.begin (), vote_a.hashes.end (), i->second->hash ()) != vote_a.hashes.end ())
+		{
+			block = i->second;
+		}
+	}
 	// Reject unsigned votes
-	if (!rai::validate_message (vote_a.account, vote_a.hash (), vote_a.signature))
+	if (block != nullptr && (validated_a || !rai::validate_message (vote_a.account, vote_a.hash (), vote_a.signature)))
 	{
 		// Make sure this sequence number is > any we've seen from this account before
 		if (store_a.sequence_atomic_observe (transaction_a, vote_a.account, vote_a.sequence) == vote_a.sequence)
@@ -137,58 +147,105 @@ bool rai::votes::vote (MDB_txn * transaction_a, rai::block_store & store_a, rai:
 			if (existing == rep_votes.end ())
 			{
 				result = true;
-				rep_votes.insert (std::make_pair (vote_a.account, vote_a.block->clone ()));
+				rep_votes.insert (std::make_pair (vote_a.account, block));
 			}
 			else
 			{
-				result = !(*existing->second == *vote_a.block);
+				result = !(*existing->second == *block);
 				if (result)
 				{
-					existing->second = vote_a.block->clone ();
+					remove_total (existing->second->hash (), rep_weights [vote_a.account]);
+					existing->second = block;
 				}
 			}
+			if (result)
+			{
+				auto weight (store_a.representation_get (transaction_a, vote_a.account));
+				rep_weights [vote_a.account] = weight;
+				add_total (block, weight);
+			}
 		}
 	}
 	return result;
 }
 
-// Sum the weights for each vote and return the winning block with its vote tally
-std::pair <rai::uint128_t, std::unique_ptr <rai::block>> rai::ledger::winner (MDB_txn * transaction_a, rai::votes const & votes_a)
-{
-	auto tally_l (tally (transaction_a, votes_a));
-	auto existing (tally_l.begin ());
-	return std::make_pair (existing->first, existing->second->clone ());
-}
-
-std::map <rai::uint128_t, std::unique_ptr <rai::block>, std::greater <rai::uint128_t>> rai::ledger::tally (MDB_txn * transaction_a, rai::votes const & votes_a)
+std::map <rai::uint128_t, std::shared_ptr <rai::block const>, std::greater <rai::uint128_t>> rai::votes::tally (MDB_txn * transaction_a, rai::block_store & store_a)
 {
-	std::unordered_map <std::unique_ptr <block>, rai::uint128_t, rai::unique_ptr_block_hash, rai::unique_ptr_block_hash> totals;
-	// Construct a map of blocks -> vote total.
-	for (auto & i: votes_a.rep_votes)
+	std::lock_guard <std::mutex> lock (mutex);
+	auto version (store_a.environment.representation_version.load ());
+	// Weights are only reread after a commit changed representation or while this transaction has changes of its own
+	if (version != weights_version || store_a.environment.representation_writer == transaction_a)
 	{
-		auto existing (totals.find (i.second));
-		if (existing == totals.end ())
+		for (auto & i: rep_votes)
 		{
-			totals.insert (std::make_pair (i.second->clone (), 0));
-			existing = totals.find (i.second);
-			assert (existing != totals.end ());
+			auto weight (store_a.representation_get (transaction_a, i.first));
+			auto & counted (rep_weights [i.first]);
+			if (weight != counted)
+			{
+				auto & total (totals [i.second->hash ()]);
+				total.weight = total.weight - counted + weight;
+				counted = weight;
+			}
 		}
-		auto weight_l (weight (transaction_a, i.first));
-		existing->second += weight_l;
+		weights_version = version;
 	}
-	// Construction a map of vote total -> block in decreasing order.
-	std::map <rai::uint128_t, std::unique_ptr <rai::block>, std::greater <rai::uint128_t>> result;
+	std::map <rai::uint128_t, std::shared_ptr <rai::block const>, std::greater <rai::uint128_t>> result;
 	for (auto & i: totals)
 	{
-		result [i.second] = i.first->clone ();
+		result [i.second.weight] = i.second.block;
 	}
 	return result;
 }
 
+void rai::votes::add_total (std::shared_ptr <rai::block const> const & block_a, rai::uint128_t const & weight_a)
+{
+	auto & total (totals [block_a->hash ()]);
+	if (total.block == nullptr)
+	{
+		total.block = block_a;
+	}
+	total.weight += weight_a;
+	++total.voters;
+}
+
+void rai::votes::remove_total (rai::block_hash const & hash_a, rai::uint128_t const & weight_a)
+{
+	auto existing (totals.find (hash_a));
+	assert (existing != totals.end ());
+	existing->second.weight -= weight_a;
+	if (--existing->second.voters == 0)
+	{
+		totals.erase (existing);
+	}
+}
+
+rai::vote_total::vote_total () :
+weight (0),
+voters (0)
+{
+}
+
+// Return the winning block with its vote tally
+std::pair <rai::uint128_t, std::shared_ptr <rai::block const>> rai::ledger::winner (MDB_txn * transaction_a, rai::votes & votes_a)
+{
+	auto tally_l (tally (transaction_a, votes_a));
+	auto existing (tally_l.begin ());
+	return std::make_pair (existing->first, existing->second);
+}
+
+std::map <rai::uint128_t, std::shared_ptr <rai::block const>, std::greater <rai::uint128_t>> rai::ledger::tally (MDB_txn * transaction_a, rai::votes & votes_a)
+{
+	return votes_a.tally (transaction_a, store);
+}
+
 rai::votes::votes (rai::block const & block_a) :
-id (block_a.root ())
+id (block_a.root ()),
+weights_version (0)
 {
-	rep_votes.insert (std::make_pair (0, block_a.clone ()));
+	std::shared_ptr <rai::block const> block (block_a.clone ());
+	rep_votes.insert (std::make_pair (0, block));
+	rep_weights [0] = 0;
+	add_total (block, 0);
 }
 
 // Create a new random keypair
@@ -611,7 +668,7 @@ rai::block_hash rai::block::hash () const
     return result;
 }
 
-std::string rai::block::to_json ()
+std::string rai::block::to_json () const
 {
 	std::string result;
 	serialize_json (result);
@@ -1307,23 +1364,27 @@ head (0),
 rep_block (0),
 open_block (0),
 balance (0),
-modified (0)
+modified (0),
+block_count (0),
+confirmation_height (0)
 {
 }
 
 rai::account_info::account_info (MDB_val const & val_a)
 {
 	assert (val_a.mv_size == sizeof (*this));
-	static_assert (sizeof (head) + sizeof (rep_block) + sizeof (open_block) + sizeof (balance) + sizeof (modified) == sizeof (*this), "Class not packed");
+	static_assert (sizeof (head) + sizeof (rep_block) + sizeof (open_block) + sizeof (balance) + sizeof (modified) + sizeof (block_count) + sizeof (confirmation_height) == sizeof (*this), "Class not packed");
 	std::copy (reinterpret_cast <uint8_t const *> (val_a.mv_data), reinterpret_cast <uint8_t const *> (val_a.mv_data) + sizeof (*this), reinterpret_cast <uint8_t *> (this));
 }
 
-rai::account_info::account_info (rai::block_hash const & head_a, rai::block_hash const & rep_block_a, rai::block_hash const & open_block_a, rai::amount const & balance_a, uint64_t modified_a) :
+rai::account_info::account_info (rai::block_hash const & head_a, rai::block_hash const & rep_block_a, rai::block_hash const & open_block_a, rai::amount const & balance_a, uint64_t modified_a, uint64_t block_count_a, uint64_t confirmation_height_a) :
 head (head_a),
 rep_block (rep_block_a),
 open_block (open_block_a),
 balance (balance_a),
-modified (modified_a)
+modified (modified_a),
+block_count (block_count_a),
+confirmation_height (confirmation_height_a)
 {
 }
 
@@ -1334,6 +1395,8 @@ void rai::account_info::serialize (rai::stream & stream_a) const
 	write (stream_a, open_block.bytes);
     write (stream_a, balance.bytes);
     write (stream_a, modified);
+    write (stream_a, block_count);
+    write (stream_a, confirmation_height);
 }
 
 bool rai::account_info::deserialize (rai::stream & stream_a)
@@ -1351,6 +1414,14 @@ bool rai::account_info::deserialize (rai::stream & stream_a)
 				if (!result)
 				{
 					result = read (stream_a, modified);
+					if (!result)
+					{
+						result = read (stream_a, block_count);
+						if (!result)
+						{
+							result = read (stream_a, confirmation_height);
+						}
+					}
 				}
 			}
         }
@@ -1360,7 +1431,7 @@ bool rai::account_info::deserialize (rai::stream & stream_a)
 
 bool rai::account_info::operator == (rai::account_info const & other_a) const
 {
-    return head == other_a.head && rep_block == other_a.rep_block && open_block == other_a.open_block && balance == other_a.balance && modified == other_a.modified;
+    return head == other_a.head && rep_block == other_a.rep_block && open_block == other_a.open_block && balance == other_a.balance && modified == other_a.modified && block_count == other_a.block_count && confirmation_height == other_a.confirmation_height;
 }
 
 bool rai::account_info::operator != (rai::account_info const & other_a) const
@@ -1489,6 +1560,77 @@ bool rai::store_iterator::operator != (rai::store_iterator const & other_a) cons
     return !(*this == other_a);
 }
 
+size_t constexpr rai::block_cache::shard_count;
+size_t constexpr rai::block_store::cache_size;
+
+rai::block_cache::block_cache (size_t capacity_a) :
+hits (0),
+misses (0),
+shard_capacity (std::max <size_t> (capacity_a / shard_count, 1))
+{
+}
+
+rai::block_cache::shard & rai::block_cache::shard_for (rai::block_hash const & hash_a)
+{
+	// Hashes are uniformly distributed, the last byte is independent of the bytes std::hash uses
+	return shards [hash_a.bytes [hash_a.bytes.size () - 1] % shard_count];
+}
+
+// Hits and misses are counted by the store, which knows whether the cached block was visible to the reader
+std::shared_ptr <rai::block const> rai::block_cache::get (rai::block_hash const & hash_a)
+{
+	std::shared_ptr <rai::block const> result;
+	auto & shard_l (shard_for (hash_a));
+	std::lock_guard <std::mutex> lock (shard_l.mutex);
+	auto existing (shard_l.index.find (hash_a));
+	if (existing != shard_l.index.end ())
+	{
+		shard_l.entries.splice (shard_l.entries.begin (), shard_l.entries, existing->second);
+		result = existing->second->second;
+	}
+	return result;
+}
+
+void rai::block_cache::put (rai::block_hash const & hash_a, std::shared_ptr <rai::block const> block_a)
+{
+	auto & shard_l (shard_for (hash_a));
+	std::lock_guard <std::mutex> lock (shard_l.mutex);
+	auto existing (shard_l.index.find (hash_a));
+	if (existing == shard_l.index.end ())
+	{
+		shard_l.entries.emplace_front (hash_a, block_a);
+		shard_l.index [hash_a] = shard_l.entries.begin ();
+		if (shard_l.entries.size () > shard_capacity)
+		{
+			shard_l.index.erase (shard_l.entries.back ().first);
+			shard_l.entries.pop_back ();
+		}
+	}
+}
+
+void rai::block_cache::erase (rai::block_hash const & hash_a)
+{
+	auto & shard_l (shard_for (hash_a));
+	std::lock_guard <std::mutex> lock (shard_l.mutex);
+	auto existing (shard_l.index.find (hash_a));
+	if (existing != shard_l.index.end ())
+	{
+		shard_l.entries.erase (existing->second);
+		shard_l.index.erase (existing);
+	}
+}
+
+size_t rai::block_cache::size ()
+{
+	size_t result (0);
+	for (auto & i: shards)
+	{
+		std::lock_guard <std::mutex> lock (i.mutex);
+		result += i.entries.size ();
+	}
+	return result;
+}
+
 rai::block_store::block_store (bool & error_a, boost::filesystem::path const & path_a) :
 environment (error_a, path_a),
 frontiers (0),
@@ -1502,7 +1644,9 @@ representation (0),
 unchecked (0),
 unsynced (0),
 stack (0),
-checksum (0)
+checksum (0),
+pruned (0),
+cache (cache_size)
 {
 	if (!error_a)
 	{
@@ -1521,6 +1665,7 @@ checksum (0)
 		error_a |= mdb_dbi_open (transaction, "checksum", MDB_CREATE, &checksum) != 0;
 		error_a |= mdb_dbi_open (transaction, "sequence", MDB_CREATE, &sequence) != 0;
 		error_a |= mdb_dbi_open (transaction, "meta", MDB_CREATE, &meta) != 0;
+		error_a |= mdb_dbi_open (transaction, "pruned", MDB_CREATE, &pruned) != 0;
 		if (!error_a)
 		{
 			do_upgrades (transaction);
@@ -1562,11 +1707,11 @@ void rai::block_store::do_upgrades (MDB_txn * transaction_a)
 	{
 		case 1:
 			upgrade_v1_to_v2 (transaction_a);
-			break;
 		case 2:
 			upgrade_v2_to_v3 (transaction_a);
-			break;
 		case 3:
+			upgrade_v3_to_v4 (transaction_a);
+		case 4:
 		break;
 		default:
 		assert (false);
@@ -1585,7 +1730,7 @@ void rai::block_store::upgrade_v1_to_v2 (MDB_txn * transaction_a)
 		{
 			account = i->first;
 			rai::account_info_v1 v1 (i->second);
-			rai::account_info v2;
+			rai::account_info_v3 v2;
 			v2.balance = v1.balance;
 			v2.head = v1.head;
 			v2.modified = v1.modified;
@@ -1614,17 +1759,25 @@ public:
     representative_visitor (MDB_txn * transaction_a, rai::block_store & store_a) :
 	transaction (transaction_a),
     store (store_a),
-	result (0)
+	result (0),
+	missing (false)
     {
     }
     void compute (rai::block_hash const & hash_a)
     {
 		current = hash_a;
-		while (result.is_zero ())
+		while (result.is_zero () && !missing)
 		{
-			auto block (store.block_get (transaction, current));
-			assert (block != nullptr);
-			block->visit (*this);
+			auto block (store.block_get_shared (transaction, current));
+			if (block != nullptr)
+			{
+				block->visit (*this);
+			}
+			else
+			{
+				// History below this point was pruned
+				missing = true;
+			}
 		}
     }
     void send_block (rai::send_block const & block_a) override
@@ -1647,6 +1800,7 @@ public:
     rai::block_store & store;
 	rai::block_hash current;
     rai::account result;
+	bool missing;
 };
 
 void rai::block_store::upgrade_v2_to_v3 (MDB_txn * transaction_a)
@@ -1656,7 +1810,7 @@ void rai::block_store::upgrade_v2_to_v3 (MDB_txn * transaction_a)
 	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
 	{
 		rai::account account_l (i->first);
-		account_info info (i->second);
+		rai::account_info_v3 info (i->second);
 		representative_visitor visitor (transaction_a, *this);
 		visitor.compute (info.head);
 		assert (!visitor.result.is_zero ());
@@ -1666,6 +1820,26 @@ void rai::block_store::upgrade_v2_to_v3 (MDB_txn * transaction_a)
 	}
 }
 
+void rai::block_store::upgrade_v3_to_v4 (MDB_txn * transaction_a)
+{
+	version_put (transaction_a, 4);
+	for (auto i (latest_begin (transaction_a)), n (latest_end ()); i != n; ++i)
+	{
+		rai::account account_l (i->first);
+		rai::account_info_v3 v3 (i->second);
+		uint64_t block_count (1);
+		auto block (block_get (transaction_a, v3.head));
+		// Stop at a pruned boundary, the count then starts there rather than at the open block and ledger::height is relative to it
+		while (block != nullptr && !block->previous ().is_zero ())
+		{
+			++block_count;
+			block = block_get (transaction_a, block->previous ());
+		}
+		rai::account_info info (v3.head, v3.rep_block, v3.open_block, v3.balance, v3.modified, block_count, 0);
+		mdb_cursor_put (i.cursor, account_l.val (), info.val (), MDB_CURRENT);
+	}
+}
+
 void rai::block_store::clear (MDB_dbi db_a)
 {
 	rai::transaction transaction (environment, nullptr, true);
@@ -1686,13 +1860,7 @@ public:
 	}
 	void fill_value (rai::block const & block_a)
 	{
-		auto hash (block_a.hash ());
-		rai::block_type type;
-		auto value (store.block_get_raw (transaction, block_a.previous (), type));
-		assert (value.mv_size != 0);
-		std::vector <uint8_t> data (static_cast <uint8_t *> (value.mv_data), static_cast <uint8_t *> (value.mv_data) + value.mv_size);
-		std::copy (hash.bytes.begin (), hash.bytes.end (), data.end () - hash.bytes.size ());
-		store.block_put_raw (transaction, store.block_database (type), block_a.previous (), rai::mdb_val (data.size (), data.data()));
+		store.block_successor_set (transaction, block_a.previous (), block_a.hash ());
 	}
 	void send_block (rai::send_block const & block_a) override
 	{
@@ -1741,6 +1909,7 @@ MDB_dbi rai::block_store::block_database (rai::block_type type_a)
 
 void rai::block_store::block_put_raw (MDB_txn * transaction_a, MDB_dbi database_a, rai::block_hash const & hash_a, MDB_val value_a)
 {
+	cache.erase (hash_a);
     auto status2 (mdb_put (transaction_a, database_a, hash_a.val (), &value_a, 0));
 	assert (status2 == 0);
 }
@@ -1824,22 +1993,66 @@ void rai::block_store::block_successor_clear (MDB_txn * transaction_a, rai::bloc
 	block_put (transaction_a, hash_a, *block);
 }
 
-std::unique_ptr <rai::block> rai::block_store::block_get (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+void rai::block_store::block_successor_set (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::block_hash const & successor_a)
 {
 	rai::block_type type;
 	auto value (block_get_raw (transaction_a, hash_a, type));
+	assert (value.mv_size != 0);
+	std::vector <uint8_t> data (static_cast <uint8_t *> (value.mv_data), static_cast <uint8_t *> (value.mv_data) + value.mv_size);
+	std::copy (successor_a.bytes.begin (), successor_a.bytes.end (), data.end () - successor_a.bytes.size ());
+	block_put_raw (transaction_a, block_database (type), hash_a, rai::mdb_val (data.size (), data.data ()));
+}
+
+std::unique_ptr <rai::block> rai::block_store::block_get (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
     std::unique_ptr <rai::block> result;
-    if (value.mv_size != 0)
-    {
-        rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
-		result = rai::deserialize_block (stream, type);
-        assert (result != nullptr);
-    }
+	auto block (block_get_shared (transaction_a, hash_a));
+	if (block != nullptr)
+	{
+		// Callers own and may modify this copy, read only callers should use block_get_shared
+		result = block->clone ();
+	}
     return result;
 }
 
+std::shared_ptr <rai::block const> rai::block_store::block_get_shared (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	auto result (cache.get (hash_a));
+	if (result != nullptr)
+	{
+		// The cache is shared by all transactions, make sure this one can see the block. This is a single key lookup in the block's own table instead of searching each table and deserializing.
+		MDB_val junk;
+		auto status (mdb_get (transaction_a, block_database (result->type ()), hash_a.val (), &junk));
+		assert (status == 0 || status == MDB_NOTFOUND);
+		if (status != 0)
+		{
+			result.reset ();
+		}
+	}
+	if (result != nullptr)
+	{
+		++cache.hits;
+	}
+	else
+	{
+		++cache.misses;
+		rai::block_type type;
+		auto value (block_get_raw (transaction_a, hash_a, type));
+		if (value.mv_size != 0)
+		{
+			rai::bufferstream stream (reinterpret_cast <uint8_t const *> (value.mv_data), value.mv_size);
+			std::shared_ptr <rai::block const> block (rai::deserialize_block (stream, type));
+			assert (block != nullptr);
+			cache.put (hash_a, block);
+			result = block;
+		}
+	}
+	return result;
+}
+
 void rai::block_store::block_del (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
+	cache.erase (hash_a);
 	auto status (mdb_del (transaction_a, send_blocks, hash_a.val (), nullptr));
     assert (status == 0 || status == MDB_NOTFOUND);
 	if (status != 0)
@@ -2128,6 +2341,7 @@ void rai::block_store::representation_put (MDB_txn * transaction_a, rai::account
     rai::uint128_union rep (representation_a);
 	auto status (mdb_put (transaction_a, representation, account_a.val (), rep.val (), 0));
     assert (status == 0);
+	environment.representation_writer = transaction_a;
 }
 
 rai::store_iterator rai::block_store::representation_begin(MDB_txn * transaction_a)
@@ -2314,6 +2528,40 @@ uint64_t rai::block_store::sequence_atomic_observe (MDB_txn * transaction_a, rai
 	return result;
 }
 
+void rai::block_store::pruned_put (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash const & hash_a)
+{
+	auto status (mdb_put (transaction_a, pruned, account_a.val (), hash_a.val (), 0));
+	assert (status == 0);
+}
+
+bool rai::block_store::pruned_get (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash & hash_a)
+{
+	MDB_val value;
+	auto status (mdb_get (transaction_a, pruned, account_a.val (), &value));
+	assert (status == 0 || status == MDB_NOTFOUND);
+	auto result (status != 0);
+	if (!result)
+	{
+		hash_a = value;
+	}
+	return result;
+}
+
+void rai::block_store::pruned_del (MDB_txn * transaction_a, rai::account const & account_a)
+{
+	auto status (mdb_del (transaction_a, pruned, account_a.val (), nullptr));
+	assert (status == 0 || status == MDB_NOTFOUND);
+}
+
+size_t rai::block_store::pruned_count (MDB_txn * transaction_a)
+{
+	MDB_stat pruned_stats;
+	auto status (mdb_stat (transaction_a, pruned, &pruned_stats));
+	assert (status == 0);
+	auto result (pruned_stats.ms_entries);
+	return result;
+}
+
 namespace
 {
 class root_visitor : public rai::block_visitor
@@ -2336,10 +2584,10 @@ public:
     {
 		rai::transaction transaction (store.environment, nullptr, false);
         auto hash (block_a.source ());
-        auto source (store.block_get (transaction, hash));
+        auto source (store.block_get_shared (transaction, hash));
         if (source != nullptr)
 		{
-			auto send (dynamic_cast <rai::send_block *> (source.get ()));
+			auto send (dynamic_cast <rai::send_block const *> (source.get ()));
 			if (send != nullptr)
 			{
 				result = send->hashables.destination;
@@ -2410,6 +2658,7 @@ public:
 	MDB_txn * transaction;
     rai::block_store & store;
     rai::uint128_t result;
+	bool missing;
 };
 
 // Determine the balance as of this block
@@ -2426,11 +2675,13 @@ public:
     rai::block_store & store;
 	rai::block_hash current;
     rai::uint128_t result;
+	bool missing;
 };
 
 amount_visitor::amount_visitor (MDB_txn * transaction_a, rai::block_store & store_a) :
 transaction (transaction_a),
-store (store_a)
+store (store_a),
+missing (false)
 {
 }
 
@@ -2439,6 +2690,17 @@ void amount_visitor::send_block (rai::send_block const & block_a)
     balance_visitor prev (transaction, store);
     prev.compute (block_a.hashables.previous);
     result = prev.result - block_a.hashables.balance.number ();
+	missing = prev.missing;
+	if (missing)
+	{
+		// Pruning keeps unreceived sends without their history, the pending entry still has the amount
+		rai::pending_info pending;
+		if (!store.pending_get (transaction, block_a.hash (), pending))
+		{
+			result = pending.amount.number ();
+			missing = false;
+		}
+	}
 }
 
 void amount_visitor::receive_block (rai::receive_block const & block_a)
@@ -2465,16 +2727,23 @@ void amount_visitor::change_block (rai::change_block const & block_a)
 
 void amount_visitor::from_send (rai::block_hash const & hash_a)
 {
-    auto source_block (store.block_get (transaction, hash_a));
-    assert (source_block != nullptr);
-	source_block->visit (*this);
+    auto source_block (store.block_get_shared (transaction, hash_a));
+	if (source_block != nullptr)
+	{
+		source_block->visit (*this);
+	}
+	else
+	{
+		missing = true;
+	}
 }
 
 balance_visitor::balance_visitor (MDB_txn * transaction_a, rai::block_store & store_a) :
 transaction (transaction_a),
 store (store_a),
 current (0),
-result (0)
+result (0),
+missing (false)
 {
 }
 
@@ -2489,6 +2758,7 @@ void balance_visitor::receive_block (rai::receive_block const & block_a)
     amount_visitor source (transaction, store);
     source.compute (block_a.hashables.source);
     result += source.result;
+	missing |= source.missing;
 	current = block_a.hashables.previous;
 }
 
@@ -2497,6 +2767,7 @@ void balance_visitor::open_block (rai::open_block const & block_a)
     amount_visitor source (transaction, store);
     source.compute (block_a.hashables.source);
     result += source.result;
+	missing |= source.missing;
 	current = 0;
 }
 
@@ -2509,15 +2780,16 @@ void balance_visitor::change_block (rai::change_block const & block_a)
 class rollback_visitor : public rai::block_visitor
 {
 public:
-    rollback_visitor (MDB_txn * transaction_a, rai::ledger & ledger_a) :
+    rollback_visitor (MDB_txn * transaction_a, rai::ledger & ledger_a, rai::account const & account_a) :
 	transaction (transaction_a),
     ledger (ledger_a),
+	account (account_a),
 	error (false)
     {
     }
     void send_block (rai::send_block const & block_a) override
     {
-		if (!ledger.rollback_predicate (block_a))
+		if (!ledger.rollback_predicate (block_a) && !pruned (block_a.hashables.previous, 0))
 		{
 			auto hash (block_a.hash ());
 			rai::pending_info pending;
@@ -2532,7 +2804,7 @@ public:
 				assert (!error);
 				ledger.store.pending_del (transaction, hash);
 				ledger.store.representation_add (transaction, ledger.representative (transaction, hash), pending.amount.number ());
-				ledger.change_latest (transaction, pending.source, block_a.hashables.previous, info.rep_block, ledger.balance (transaction, block_a.hashables.previous));
+				ledger.change_latest (transaction, pending.source, block_a.hashables.previous, info.rep_block, ledger.balance (transaction, block_a.hashables.previous), info.block_count - 1);
 				ledger.store.block_del (transaction, hash);
 				ledger.store.frontier_del (transaction, hash);
 				ledger.store.frontier_put (transaction, block_a.hashables.previous, pending.source);
@@ -2546,14 +2818,17 @@ public:
     }
     void receive_block (rai::receive_block const & block_a) override
     {
-		if (!ledger.rollback_predicate (block_a))
+		if (!ledger.rollback_predicate (block_a) && !pruned (block_a.hashables.previous, block_a.hashables.source))
 		{
 			auto hash (block_a.hash ());
 			auto representative (ledger.representative (transaction, block_a.hashables.previous));
 			auto amount (ledger.amount (transaction, block_a.hashables.source));
 			auto destination_account (ledger.account (transaction, hash));
+			rai::account_info info;
+			auto latest_error (ledger.store.account_get (transaction, destination_account, info));
+			assert (!latest_error);
 			ledger.store.representation_add (transaction, ledger.representative (transaction, hash), 0 - amount);
-			ledger.change_latest (transaction, destination_account, block_a.hashables.previous, representative, ledger.balance (transaction, block_a.hashables.previous));
+			ledger.change_latest (transaction, destination_account, block_a.hashables.previous, representative, ledger.balance (transaction, block_a.hashables.previous), info.block_count - 1);
 			ledger.store.block_del (transaction, hash);
 			ledger.store.pending_put (transaction, block_a.hashables.source, {ledger.account (transaction, block_a.hashables.source), amount, destination_account});
 			ledger.store.frontier_del (transaction, hash);
@@ -2567,14 +2842,14 @@ public:
     }
     void open_block (rai::open_block const & block_a) override
     {
-		if (!ledger.rollback_predicate (block_a))
+		if (!ledger.rollback_predicate (block_a) && !pruned (0, block_a.hashables.source))
 		{
 			auto hash (block_a.hash ());
 			auto representative (ledger.representative (transaction, block_a.hashables.source));
 			auto amount (ledger.amount (transaction, block_a.hashables.source));
 			auto destination_account (ledger.account (transaction, hash));
 			ledger.store.representation_add (transaction, ledger.representative (transaction, hash), 0 - amount);
-			ledger.change_latest (transaction, destination_account, 0, representative, 0);
+			ledger.change_latest (transaction, destination_account, 0, representative, 0, 0);
 			ledger.store.block_del (transaction, hash);
 			ledger.store.pending_put (transaction, block_a.hashables.source, {ledger.account (transaction, block_a.hashables.source), amount, destination_account});
 			ledger.store.frontier_del (transaction, hash);
@@ -2586,7 +2861,7 @@ public:
     }
     void change_block (rai::change_block const & block_a) override
     {
-		if (!ledger.rollback_predicate (block_a))
+		if (!ledger.rollback_predicate (block_a) && !pruned (block_a.hashables.previous, 0))
 		{
 			auto hash (block_a.hash ());
 			auto representative (ledger.representative (transaction, block_a.hashables.previous));
@@ -2598,7 +2873,7 @@ public:
 			ledger.store.representation_add (transaction, representative, balance);
 			ledger.store.representation_add (transaction, hash, 0 - balance);
 			ledger.store.block_del (transaction, hash);
-			ledger.change_latest (transaction, account, block_a.hashables.previous, representative, info.balance);
+			ledger.change_latest (transaction, account, block_a.hashables.previous, representative, info.balance, info.block_count - 1);
 			ledger.store.frontier_del (transaction, hash);
 			ledger.store.frontier_put (transaction, block_a.hashables.previous, account);
 			ledger.store.block_successor_clear (transaction, block_a.hashables.previous);
@@ -2608,15 +2883,42 @@ public:
 			error = true;
 		}
     }
+	// Return true if the balance, representative or source amount needed to undo a block was pruned
+	// History is only walked for an account with a pruned boundary and sources only once anything was pruned
+	bool pruned (rai::block_hash const & previous_a, rai::block_hash const & source_a)
+	{
+		auto result (false);
+		rai::block_hash boundary;
+		if (!previous_a.is_zero () && !ledger.store.pruned_get (transaction, account, boundary))
+		{
+			balance_visitor balance (transaction, ledger.store);
+			balance.compute (previous_a);
+			representative_visitor representative (transaction, ledger.store);
+			representative.compute (previous_a);
+			result = balance.missing || representative.missing;
+		}
+		if (!result && !source_a.is_zero () && ledger.store.pruned_count (transaction) > 0)
+		{
+			// A kept source is still chained to its frontier through successors so only its amount and representative can be missing
+			amount_visitor amount (transaction, ledger.store);
+			amount.compute (source_a);
+			representative_visitor representative (transaction, ledger.store);
+			representative.compute (source_a);
+			result = amount.missing || representative.missing;
+		}
+		return result;
+	}
 	MDB_txn * transaction;
     rai::ledger & ledger;
+	// Account being rolled back
+	rai::account account;
 	bool error;
 };
 }
 
 void amount_visitor::compute (rai::block_hash const & block_hash)
 {
-    auto block (store.block_get (transaction, block_hash));
+    auto block (store.block_get_shared (transaction, block_hash));
 	if (block != nullptr)
 	{
 		block->visit (*this);
@@ -2629,7 +2931,8 @@ void amount_visitor::compute (rai::block_hash const & block_hash)
 		}
 		else
 		{
-			assert (false);
+			// Source was pruned
+			missing = true;
 			result = 0;
 		}
 	}
@@ -2640,9 +2943,17 @@ void balance_visitor::compute (rai::block_hash const & block_hash)
 	current = block_hash;
 	while (!current.is_zero ())
 	{
-		auto block (store.block_get (transaction, current));
-		assert (block != nullptr);
-		block->visit (*this);
+		auto block (store.block_get_shared (transaction, current));
+		if (block != nullptr)
+		{
+			block->visit (*this);
+		}
+		else
+		{
+			// History below this point was pruned
+			missing = true;
+			current = 0;
+		}
 	}
 }
 
@@ -2714,19 +3025,138 @@ rai::uint128_t rai::ledger::weight (MDB_txn * transaction_a, rai::account const
 bool rai::ledger::rollback (MDB_txn * transaction_a, rai::block_hash const & frontier_a)
 {
     auto account_l (account (transaction_a, frontier_a));
-    rollback_visitor rollback (transaction_a, *this);
+    rollback_visitor rollback (transaction_a, *this, account_l);
     rai::account_info info;
     do
     {
         auto latest_error (store.account_get (transaction_a, account_l, info));
         assert (!latest_error);
-        auto block (store.block_get (transaction_a, info.head));
-        block->visit (rollback);
+        if (info.block_count > info.confirmation_height)
+        {
+            auto block (store.block_get (transaction_a, info.head));
+            block->visit (rollback);
+        }
+        else
+        {
+            // Confirmed blocks are final
+            rollback.error = true;
+        }
     // Continue rolling back until this block is the frontier
     } while (info.head != frontier_a && rollback.error == false);
 	return rollback.error;
 }
 
+// Position of `hash_a' in its account chain, the open block is at height 1
+uint64_t rai::ledger::height (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	rai::account account_l;
+	return height (transaction_a, hash_a, account_l);
+}
+
+// The height is the head's block count less the number of successors up to the head, which is short for the recent blocks being confirmed.
+// Accounts pruned before block counts were stored only counted back to their pruned boundary, heights on those chains are relative
+// to it and confirmation heights are recorded on the same scale. Returns 0 if the block isn't in the ledger.
+uint64_t rai::ledger::height (MDB_txn * transaction_a, rai::block_hash const & hash_a, rai::account & account_a)
+{
+	uint64_t result (0);
+	account_a.clear ();
+	if (store.block_exists (transaction_a, hash_a))
+	{
+		// One walk finds the head, which gives the account, and the distance to it
+		uint64_t distance (0);
+		auto head (hash_a);
+		for (auto successor (store.block_successor (transaction_a, head)); !successor.is_zero (); successor = store.block_successor (transaction_a, head))
+		{
+			head = successor;
+			++distance;
+		}
+		account_a = store.frontier_get (transaction_a, head);
+		rai::account_info info;
+		if (!account_a.is_zero () && !store.account_get (transaction_a, account_a, info) && info.block_count > distance)
+		{
+			assert (info.head == head);
+			result = info.block_count - distance;
+		}
+	}
+	return result;
+}
+
+// Mark `hash_a' and all its predecessors as confirmed, returns true if the block isn't in the ledger
+bool rai::ledger::confirm (MDB_txn * transaction_a, rai::block_hash const & hash_a)
+{
+	rai::account account_l;
+	auto block_height (height (transaction_a, hash_a, account_l));
+	auto result (block_height == 0);
+	if (!result)
+	{
+		rai::account_info info;
+		auto error (store.account_get (transaction_a, account_l, info));
+		assert (!error);
+		if (block_height > info.confirmation_height)
+		{
+			info.confirmation_height = block_height;
+			store.account_put (transaction_a, account_l, info);
+		}
+	}
+	return result;
+}
+
+// Delete confirmed blocks more than depth_a below the head of account_a, keeping the open block, the representative block and unreceived sends
+// Kept blocks are chained to each other through their successors so walking forward from any of them still reaches the head
+size_t rai::ledger::prune (MDB_txn * transaction_a, rai::account const & account_a, size_t depth_a)
+{
+	assert (depth_a > 0);
+	size_t result (0);
+	rai::account_info info;
+	auto error (store.account_get (transaction_a, account_a, info));
+	// Unconfirmed blocks may still be rolled back so the boundary never goes above the confirmation height
+	auto boundary_height (error || info.block_count <= depth_a ? 0 : std::min <uint64_t> (info.block_count - depth_a + 1, info.confirmation_height));
+	if (boundary_height > 1)
+	{
+		rai::block_hash pruned (0);
+		store.pruned_get (transaction_a, account_a, pruned);
+		auto boundary (info.head);
+		std::unique_ptr <rai::block> block (store.block_get (transaction_a, boundary));
+		for (auto i (info.block_count); i > boundary_height && block != nullptr; --i)
+		{
+			// Heights below an earlier boundary no longer match the chain
+			boundary = boundary == pruned ? 0 : block->previous ();
+			block = boundary.is_zero () ? nullptr : store.block_get (transaction_a, boundary);
+		}
+		if (block != nullptr && boundary != info.open_block)
+		{
+			store.pruned_put (transaction_a, account_a, boundary);
+			// Walk forward from the open block, this passes every block kept by an earlier pass as well as the newly pruned range
+			auto kept (info.open_block);
+			auto current (store.block_successor (transaction_a, kept));
+			while (current != boundary)
+			{
+				assert (!current.is_zero ());
+				auto next (store.block_successor (transaction_a, current));
+				if (current != info.rep_block && !store.pending_exists (transaction_a, current))
+				{
+					store.block_del (transaction_a, current);
+					++result;
+				}
+				else
+				{
+					if (store.block_successor (transaction_a, kept) != current)
+					{
+						store.block_successor_set (transaction_a, kept, current);
+					}
+					kept = current;
+				}
+				current = next;
+			}
+			if (store.block_successor (transaction_a, kept) != boundary)
+			{
+				store.block_successor_set (transaction_a, kept, boundary);
+			}
+		}
+	}
+	return result;
+}
+
 // Return account containing hash
 rai::account rai::ledger::account (MDB_txn * transaction_a, rai::block_hash const & hash_a)
 {
@@ -2756,7 +3186,7 @@ rai::uint128_t rai::ledger::amount (MDB_txn * transaction_a, rai::block_hash con
 
 void rai::block_store::representation_add (MDB_txn * transaction_a, rai::block_hash const & source_a, rai::uint128_t const & amount_a)
 {
-	auto source_block (block_get (transaction_a, source_a));
+	auto source_block (block_get_shared (transaction_a, source_a));
 	assert (source_block != nullptr);
 	auto source_rep (source_block->representative ());
 	assert (!source_rep.is_zero ());
@@ -2819,7 +3249,7 @@ void rai::ledger::checksum_update (MDB_txn * transaction_a, rai::block_hash cons
     store.checksum_put (transaction_a, 0, 0, value);
 }
 
-void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash const & hash_a, rai::block_hash const & rep_block_a, rai::amount const & balance_a)
+void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & account_a, rai::block_hash const & hash_a, rai::block_hash const & rep_block_a, rai::amount const & balance_a, uint64_t block_count_a)
 {
     rai::account_info info;
     auto exists (!store.account_get (transaction_a, account_a, info));
@@ -2838,12 +3268,15 @@ void rai::ledger::change_latest (MDB_txn * transaction_a, rai::account const & a
         info.rep_block = rep_block_a;
         info.balance = balance_a;
         info.modified = store.now ();
+        info.block_count = block_count_a;
+        assert (info.confirmation_height <= info.block_count);
         store.account_put (transaction_a, account_a, info);
         checksum_update (transaction_a, hash_a);
     }
     else
     {
         store.account_del (transaction_a, account_a);
+        store.pruned_del (transaction_a, account_a);
     }
 }
 
@@ -2892,10 +3325,11 @@ void ledger_processor::change_block (rai::change_block const & block_a)
 				if (result.code == rai::process_result::progress)
 				{
 					ledger.store.block_put (transaction, hash, block_a);
-					auto balance (ledger.balance (transaction, block_a.hashables.previous));
+					// Previous is the head, use the stored balance instead of walking history that may be pruned
+					auto balance (info.balance.number ());
 					ledger.store.representation_add (transaction, hash, balance);
 					ledger.store.representation_add (transaction, info.rep_block, 0 - balance);
-					ledger.change_latest (transaction, account, hash, hash, info.balance);
+					ledger.change_latest (transaction, account, hash, hash, info.balance, info.block_count + 1);
 					ledger.store.frontier_del (transaction, block_a.hashables.previous);
 					ledger.store.frontier_put (transaction, hash, account);
 					result.account = account;
@@ -2934,7 +3368,7 @@ void ledger_processor::send_block (rai::send_block const & block_a)
 						auto amount (info.balance.number () - block_a.hashables.balance.number ());
 						ledger.store.representation_add (transaction, info.rep_block, 0 - amount);
 						ledger.store.block_put (transaction, hash, block_a);
-						ledger.change_latest (transaction, account, hash, info.rep_block, block_a.hashables.balance);
+						ledger.change_latest (transaction, account, hash, info.rep_block, block_a.hashables.balance, info.block_count + 1);
 						ledger.store.pending_put (transaction, hash, {account, amount, block_a.hashables.destination});
 						ledger.store.frontier_del (transaction, block_a.hashables.previous);
 						ledger.store.frontier_put (transaction, hash, account);
@@ -2954,13 +3388,13 @@ void ledger_processor::receive_block (rai::receive_block const & block_a)
     result.code = existing ? rai::process_result::old : rai::process_result::progress; // Have we seen this block already?  (Harmless)
     if (result.code == rai::process_result::progress)
     {
-		auto block (ledger.store.block_get (transaction, block_a.hashables.source));
+		auto block (ledger.store.block_get_shared (transaction, block_a.hashables.source));
         auto source_missing (block == nullptr);
         result.code = source_missing ? rai::process_result::gap_source : rai::process_result::progress; // Have we seen the source block already? (Harmless)
         if (result.code == rai::process_result::progress)
         {
-			assert (dynamic_cast <rai::send_block *> (block.get ()) != nullptr);
-			auto source (static_cast <rai::send_block *> (block.get ()));
+			assert (dynamic_cast <rai::send_block const *> (block.get ()) != nullptr);
+			auto source (static_cast <rai::send_block const *> (block.get ()));
 			result.code = rai::validate_message (source->hashables.destination, hash, block_a.signature) ? rai::process_result::bad_signature : rai::process_result::progress; // Is the signature valid (Malformed)
 			if (result.code == rai::process_result::progress)
 			{
@@ -2982,7 +3416,7 @@ void ledger_processor::receive_block (rai::receive_block const & block_a)
                             assert (!error);
 							ledger.store.pending_del (transaction, block_a.hashables.source);
 							ledger.store.block_put (transaction, hash, block_a);
-							ledger.change_latest (transaction, pending.destination, hash, info.rep_block, new_balance);
+							ledger.change_latest (transaction, pending.destination, hash, info.rep_block, new_balance, info.block_count + 1);
 							ledger.store.representation_add (transaction, info.rep_block, pending.amount.number ());
 							ledger.store.frontier_del (transaction, block_a.hashables.previous);
 							ledger.store.frontier_put (transaction, hash, pending.destination);
@@ -3030,7 +3464,7 @@ void ledger_processor::open_block (rai::open_block const & block_a)
 							assert (!error);
 							ledger.store.pending_del (transaction, block_a.hashables.source);
 							ledger.store.block_put (transaction, hash, block_a);
-							ledger.change_latest (transaction, pending.destination, hash, hash, pending.amount.number ());
+							ledger.change_latest (transaction, pending.destination, hash, hash, pending.amount.number (), 1);
 							ledger.store.representation_add (transaction, hash, pending.amount.number ());
 							ledger.store.frontier_put (transaction, hash, pending.destination);
 							result.account = pending.destination;
@@ -3062,8 +3496,22 @@ rai::vote::vote (bool & error_a, rai::stream & stream_a, rai::block_type type_a)
 				error_a = rai::read (stream_a, sequence);
 				if (!error_a)
 				{
-					block = rai::deserialize_block (stream_a, type_a);
-					error_a = block == nullptr;
+					if (type_a == rai::block_type::not_a_block)
+					{
+						uint8_t count;
+						error_a = rai::read (stream_a, count) || count == 0 || count > hashes_max;
+						for (size_t i (0); !error_a && i < count; ++i)
+						{
+							rai::block_hash hash;
+							error_a = rai::read (stream_a, hash);
+							hashes.push_back (hash);
+						}
+					}
+					else
+					{
+						block = rai::deserialize_block (stream_a, type_a);
+						error_a = block == nullptr;
+					}
 				}
 			}
 		}
@@ -3078,12 +3526,25 @@ signature (rai::sign_message (prv_a, account_a, hash ()))
 {
 }
 
+rai::vote::vote (rai::account const & account_a, rai::raw_key const & prv_a, uint64_t sequence_a, std::vector <rai::block_hash> const & hashes_a) :
+sequence (sequence_a),
+hashes (hashes_a),
+account (account_a),
+signature (rai::sign_message (prv_a, account_a, hash ()))
+{
+	assert (!hashes.empty () && hashes.size () <= hashes_max);
+}
+
+// A vote by hash for a single block signs the same message as a vote carrying the block
 rai::uint256_union rai::vote::hash () const
 {
     rai::uint256_union result;
     blake2b_state hash;
 	blake2b_init (&hash, sizeof (result.bytes));
-    blake2b_update (&hash, block->hash ().bytes.data (), sizeof (result.bytes));
+	for (auto & i: blocks ())
+	{
+		blake2b_update (&hash, i.bytes.data (), sizeof (i.bytes));
+	}
     union {
         uint64_t qword;
         std::array <uint8_t, 8> bytes;
@@ -3094,6 +3555,20 @@ rai::uint256_union rai::vote::hash () const
     return result;
 }
 
+std::vector <rai::block_hash> rai::vote::blocks () const
+{
+	std::vector <rai::block_hash> result;
+	if (block != nullptr)
+	{
+		result.push_back (block->hash ());
+	}
+	else
+	{
+		result = hashes;
+	}
+	return result;
+}
+
 rai::genesis::genesis ()
 {
 	boost::property_tree::ptree tree;
@@ -3109,7 +3584,7 @@ void rai::genesis::initialize (MDB_txn * transaction_a, rai::block_store & store
 	auto hash_l (hash ());
 	assert (store_a.latest_begin (transaction_a) == store_a.latest_end ());
 	store_a.block_put (transaction_a, hash_l, *open);
-	store_a.account_put (transaction_a, genesis_account, {hash_l, open->hash (), open->hash (), std::numeric_limits <rai::uint128_t>::max (), store_a.now ()});
+	store_a.account_put (transaction_a, genesis_account, {hash_l, open->hash (), open->hash (), std::numeric_limits <rai::uint128_t>::max (), store_a.now (), 1, 1});
 	store_a.representation_put (transaction_a, genesis_account, std::numeric_limits <rai::uint128_t>::max ());
 	store_a.checksum_put (transaction_a, 0, 0, hash_l);
 	store_a.frontier_put (transaction_a, hash_l, genesis_account);
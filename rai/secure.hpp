@@ -4,6 +4,9 @@
 
 #include <boost/property_tree/ptree.hpp>
 
+#include <atomic>
+#include <list>
+#include <mutex>
 #include <unordered_map>
 namespace boost
 {
@@ -42,7 +45,7 @@ class block
 public:
 	// Return a digest of the hashables in this block.
 	rai::block_hash hash () const;
-	std::string to_json ();
+	std::string to_json () const;
 	virtual void hash (blake2b_state &) const = 0;
 	virtual uint64_t block_work () const = 0;
 	virtual void block_work_set (uint64_t) = 0;
@@ -241,7 +244,7 @@ public:
 	account_info ();
 	account_info (MDB_val const &);
 	account_info (rai::account_info const &) = default;
-	account_info (rai::block_hash const &, rai::block_hash const &, rai::block_hash const &, rai::amount const &, uint64_t);
+	account_info (rai::block_hash const &, rai::block_hash const &, rai::block_hash const &, rai::amount const &, uint64_t, uint64_t, uint64_t);
 	void serialize (rai::stream &) const;
 	bool deserialize (rai::stream &);
 	bool operator == (rai::account_info const &) const;
@@ -252,6 +255,10 @@ public:
 	rai::block_hash open_block;
 	rai::amount balance;
 	uint64_t modified;
+	// Number of blocks in the chain, the head block's height
+	uint64_t block_count;
+	// Blocks up to and including this height are confirmed and can't be rolled back
+	uint64_t confirmation_height;
 };
 class store_entry
 {
@@ -295,6 +302,30 @@ public:
 	rai::amount amount;
 	rai::account destination;
 };
+// Size bounded LRU of deserialized blocks, split in to independently locked shards
+class block_cache
+{
+public:
+	block_cache (size_t);
+	std::shared_ptr <rai::block const> get (rai::block_hash const &);
+	void put (rai::block_hash const &, std::shared_ptr <rai::block const>);
+	void erase (rai::block_hash const &);
+	size_t size ();
+	std::atomic <uint64_t> hits;
+	std::atomic <uint64_t> misses;
+	static size_t constexpr shard_count = 16;
+private:
+	class shard
+	{
+	public:
+		std::mutex mutex;
+		std::list <std::pair <rai::block_hash, std::shared_ptr <rai::block const>>> entries;
+		std::unordered_map <rai::block_hash, decltype (entries)::iterator> index;
+	};
+	rai::block_cache::shard & shard_for (rai::block_hash const &);
+	size_t shard_capacity;
+	std::array <rai::block_cache::shard, shard_count> shards;
+};
 class block_store
 {
 public:
@@ -307,7 +338,10 @@ public:
 	MDB_val block_get_raw (MDB_txn *, rai::block_hash const &, rai::block_type &);
 	rai::block_hash block_successor (MDB_txn *, rai::block_hash const &);
 	void block_successor_clear (MDB_txn *, rai::block_hash const &);
+	void block_successor_set (MDB_txn *, rai::block_hash const &, rai::block_hash const &);
 	std::unique_ptr <rai::block> block_get (MDB_txn *, rai::block_hash const &);
+	// Shares the cached block instead of copying it
+	std::shared_ptr <rai::block const> block_get_shared (MDB_txn *, rai::block_hash const &);
 	void block_del (MDB_txn *, rai::block_hash const &);
 	bool block_exists (MDB_txn *, rai::block_hash const &);
 	size_t block_count (MDB_txn *);
@@ -363,11 +397,17 @@ public:
 	uint64_t sequence_atomic_inc (MDB_txn *, rai::account const &);
 	uint64_t sequence_atomic_observe (MDB_txn *, rai::account const &, uint64_t);
 	
+	void pruned_put (MDB_txn *, rai::account const &, rai::block_hash const &);
+	bool pruned_get (MDB_txn *, rai::account const &, rai::block_hash &);
+	void pruned_del (MDB_txn *, rai::account const &);
+	size_t pruned_count (MDB_txn *);
+	
 	void version_put (MDB_txn *, int);
 	int version_get (MDB_txn *);
 	void do_upgrades (MDB_txn *);
 	void upgrade_v1_to_v2 (MDB_txn *);
 	void upgrade_v2_to_v3 (MDB_txn *);
+	void upgrade_v3_to_v4 (MDB_txn *);
 	
 	void clear (MDB_dbi);
 	
@@ -400,6 +440,10 @@ public:
 	MDB_dbi sequence;
 	// uint256_union -> ?											// Meta information about block store
 	MDB_dbi meta;
+	// account -> block_hash										// Lowest block of an account chain still held after pruning
+	MDB_dbi pruned;
+	rai::block_cache cache;
+	static size_t constexpr cache_size = 32 * 1024;
 };
 enum class process_result
 {
@@ -427,31 +471,60 @@ public:
 	vote () = default;
 	vote (bool &, rai::stream &, rai::block_type);
 	vote (rai::account const &, rai::raw_key const &, uint64_t, std::unique_ptr <rai::block>);
+	vote (rai::account const &, rai::raw_key const &, uint64_t, std::vector <rai::block_hash> const &);
 	rai::uint256_union hash () const;
+	// Hashes of every block voted for
+	std::vector <rai::block_hash> blocks () const;
 	// Vote round sequence number
 	uint64_t sequence;
-	std::unique_ptr <rai::block> block;
+	// Null for a vote by hash, shared with the message it was parsed from
+	std::shared_ptr <rai::block const> block;
+	// Blocks voted for by hash, signed together with the sequence number
+	std::vector <rai::block_hash> hashes;
 	// Account that's voting
 	rai::account account;
 	// Signature of sequence + block hash
 	rai::signature signature;
+	static size_t constexpr hashes_max = 12;
+};
+class vote_total
+{
+public:
+	vote_total ();
+	std::shared_ptr <rai::block const> block;
+	rai::uint128_t weight;
+	// Representatives voting for the block, the entry goes away at 0
+	size_t voters;
 };
 class votes
 {
 public:
 	votes (rai::block const &);
-	bool vote (MDB_txn *, rai::block_store &, rai::vote const &);
+	// A vote by hash only counts for a block already in rep_votes. Returns true if the tally changed, which updates totals in constant time
+	// The signature is only checked if the caller hasn't already validated it
+	bool vote (MDB_txn *, rai::block_store &, rai::vote const &, bool = false);
+	// Vote total -> block in decreasing order, if representation changed since the last tally totals are first adjusted for voters whose weight differs from the one they were counted with
+	std::map <rai::uint128_t, std::shared_ptr <rai::block const>, std::greater <rai::uint128_t>> tally (MDB_txn *, rai::block_store &);
+	void add_total (std::shared_ptr <rai::block const> const &, rai::uint128_t const &);
+	void remove_total (rai::block_hash const &, rai::uint128_t const &);
 	// Root block of fork
 	rai::block_hash id;
 	// All votes received by account
-	std::unordered_map <rai::account, std::unique_ptr <rai::block>> rep_votes;
+	std::unordered_map <rai::account, std::shared_ptr <rai::block const>> rep_votes;
+	// Weight each representative is counted with in totals
+	std::unordered_map <rai::account, rai::uint128_t> rep_weights;
+	// Environment representation_version rep_weights were last reread at
+	uint64_t weights_version;
+	std::unordered_map <rai::block_hash, rai::vote_total> totals;
+	// Elections vote and tally from different threads
+	std::mutex mutex;
 };
 class ledger
 {
 public:
 	ledger (rai::block_store &, rai::uint128_t const & = 0, std::function <bool (rai::block const &)> = [] (rai::block const &) { return false; });
-	std::pair <rai::uint128_t, std::unique_ptr <rai::block>> winner (MDB_txn *, rai::votes const & votes_a);
-	std::map <rai::uint128_t, std::unique_ptr <rai::block>, std::greater <rai::uint128_t>> tally (MDB_txn *, rai::votes const &);
+	std::pair <rai::uint128_t, std::shared_ptr <rai::block const>> winner (MDB_txn *, rai::votes & votes_a);
+	std::map <rai::uint128_t, std::shared_ptr <rai::block const>, std::greater <rai::uint128_t>> tally (MDB_txn *, rai::votes &);
 	rai::account account (MDB_txn *, rai::block_hash const &);
 	rai::uint128_t amount (MDB_txn *, rai::block_hash const &);
 	rai::uint128_t balance (MDB_txn *, rai::block_hash const &);
@@ -466,7 +539,11 @@ public:
 	rai::uint128_t supply (MDB_txn *);
 	rai::process_return process (MDB_txn *, rai::block const &);
 	bool rollback (MDB_txn *, rai::block_hash const &);
-	void change_latest (MDB_txn *, rai::account const &, rai::block_hash const &, rai::account const &, rai::uint128_union const &);
+	size_t prune (MDB_txn *, rai::account const &, size_t);
+	uint64_t height (MDB_txn *, rai::block_hash const &);
+	uint64_t height (MDB_txn *, rai::block_hash const &, rai::account &);
+	bool confirm (MDB_txn *, rai::block_hash const &);
+	void change_latest (MDB_txn *, rai::account const &, rai::block_hash const &, rai::account const &, rai::uint128_union const &, uint64_t);
 	void checksum_update (MDB_txn *, rai::block_hash const &);
 	rai::checksum checksum (MDB_txn *, rai::account const &, rai::account const &);
 	void dump_account_chain (rai::account const &);
@@ -1,8 +1,60 @@
 #include <gtest/gtest.h>
 #include <rai/node/testing.hpp>
 
+#include <atomic>
+#include <cstdlib>
 #include <thread>
 
+namespace
+{
+// Counts heap allocations made on the constructing thread while in scope
+class allocation_counter
+{
+public:
+	// Only allocations of exactly `size' bytes are counted, 0 counts every size
+	allocation_counter (size_t = 0);
+	~allocation_counter ();
+	size_t size;
+	uint64_t count;
+	allocation_counter * previous;
+};
+thread_local allocation_counter * current_counter (nullptr);
+
+allocation_counter::allocation_counter (size_t size_a) :
+size (size_a),
+count (0),
+previous (current_counter)
+{
+	current_counter = this;
+}
+
+allocation_counter::~allocation_counter ()
+{
+	current_counter = previous;
+}
+}
+
+// Allocations are only counted inside an allocation_counter scope so the rest of the binary is unaffected
+void * operator new (size_t size_a)
+{
+	auto counter (current_counter);
+	if (counter != nullptr && (counter->size == 0 || counter->size == size_a))
+	{
+		++counter->count;
+	}
+	auto result (std::malloc (size_a));
+	if (result == nullptr)
+	{
+		throw std::bad_alloc ();
+	}
+	return result;
+}
+
+void operator delete (void * ptr_a) noexcept
+{
+	std::free (ptr_a);
+}
+
 TEST (system, generate_mass_activity)
 {
     rai::system system (24000, 1);
@@ -241,4 +293,172 @@ TEST (gap_cache, limit)
         cache.add (rai::send_block (block1), previous);
     }
     ASSERT_EQ (cache.max, cache.blocks.size ());
-}
\ No newline at end of file
+}
+TEST (network, broadcast_allocations)
+{
+	rai::system system (24000, 1);
+	auto & node1 (*system.nodes [0]);
+	node1.config.logging.network_logging_value = false;
+	rai::send_block block (0, 1, 2, rai::keypair ().prv, 4, 5);
+	std::vector <uint64_t> buffers;
+	uint16_t port (30000);
+	for (size_t peers: {100, 1000})
+	{
+		while (node1.peers.size () < peers)
+		{
+			node1.peers.insert (rai::endpoint (boost::asio::ip::address_v6::loopback (), port++));
+		}
+		// The first broadcast to new peers also creates their token buckets
+		node1.network.broadcast_confirm_req (block);
+		// message::to_bytes reserves exactly one datagram sized buffer per serialization
+		allocation_counter counter (512);
+		node1.network.broadcast_confirm_req (block);
+		buffers.push_back (counter.count);
+	}
+	std::cerr << boost::str (boost::format ("Datagram buffers allocated broadcasting to 100 peers: %1%, to 1000 peers: %2%") % buffers [0] % buffers [1]) << std::endl;
+	ASSERT_EQ (1, buffers [0]);
+	ASSERT_EQ (buffers [0], buffers [1]);
+}
+
+namespace
+{
+// Keeps every parsed block the way the block processor queue does
+class publish_collector : public rai::message_visitor
+{
+public:
+	void keepalive (rai::keepalive const &) override {}
+	void publish (rai::publish const & message_a) override
+	{
+		blocks.push_back (message_a.block);
+	}
+	void confirm_req (rai::confirm_req const &) override {}
+	void confirm_ack (rai::confirm_ack const &) override {}
+	void bulk_pull (rai::bulk_pull const &) override {}
+	void bulk_push (rai::bulk_push const &) override {}
+	void frontier_req (rai::frontier_req const &) override {}
+	void realtime (rai::realtime const &) override {}
+	std::vector <std::shared_ptr <rai::block const>> blocks;
+};
+}
+
+TEST (message_parser, publish_allocations)
+{
+	rai::work_pool work (nullptr);
+	size_t count (10000);
+	rai::send_block block (1, 1, 2, rai::keypair ().prv, 4, work.generate (1));
+	rai::publish message (block.clone ());
+	auto bytes (message.to_bytes ());
+	publish_collector collector;
+	collector.blocks.reserve (count);
+	rai::message_parser parser (collector, work);
+	uint64_t parsed;
+	{
+		allocation_counter counter;
+		for (size_t i (0); i < count; ++i)
+		{
+			parser.deserialize_buffer (bytes->data (), bytes->size ());
+		}
+		parsed = counter.count;
+	}
+	ASSERT_FALSE (parser.error);
+	ASSERT_FALSE (parser.insufficient_work);
+	ASSERT_EQ (count, collector.blocks.size ());
+	ASSERT_EQ (block, *collector.blocks.back ());
+	std::cerr << boost::str (boost::format ("Parsed %1% publish datagrams: %2% allocations, %3% per datagram") % count % parsed % (double (parsed) / count)) << std::endl;
+	// The block itself and its shared count, nothing is cloned on the way to the visitor
+	ASSERT_LE (parsed, 2 * count);
+}
+
+TEST (system, propagation_fanout)
+{
+	size_t count (32);
+	rai::system system (24000, count);
+	// Introduce every node to every other so fanout rather than topology limits propagation
+	for (auto & i: system.nodes)
+	{
+		for (auto & j: system.nodes)
+		{
+			if (i != j)
+			{
+				i->network.send_keepalive (j->network.endpoint ());
+			}
+		}
+	}
+	auto iterations (0);
+	while (std::any_of (system.nodes.begin (), system.nodes.end (), [count] (std::shared_ptr <rai::node> const & node_a) { return node_a->peers.size () < count - 1; }))
+	{
+		system.poll ();
+		++iterations;
+		ASSERT_LT (iterations, 2000);
+	}
+	rai::genesis genesis;
+	auto previous (genesis.hash ());
+	rai::uint128_t balance (rai::genesis_amount);
+	for (auto fanout: {0u, 1u, 8u})
+	{
+		for (auto & i: system.nodes)
+		{
+			i->config.broadcast_fanout = fanout;
+		}
+		balance -= 1;
+		rai::send_block send (previous, rai::keypair ().pub, balance, rai::test_genesis_key.prv, rai::test_genesis_key.pub, system.work.generate (previous));
+		uint64_t packets (0);
+		auto latency (system.propagate (send, packets));
+		std::cerr << boost::str (boost::format ("Fanout %1% over %2% nodes: %3% ms, %4% packets") % fanout % count % latency.count () % packets) << std::endl;
+		previous = send.hash ();
+	}
+}
+
+TEST (peer_container, contention)
+{
+	rai::peer_container peers (rai::endpoint {});
+	size_t count (256);
+	for (size_t i (0); i < count; ++i)
+	{
+		peers.insert (rai::endpoint (boost::asio::ip::address_v6::loopback (), 10000 + i));
+	}
+	auto threads_count (std::max (4u, std::thread::hardware_concurrency ()));
+	size_t iterations (200000);
+	// Per packet calls from every network thread, optionally serialized on the container mutex as every reader used to be
+	auto run ([&] (bool serialize_a)
+	{
+		std::vector <std::thread> threads;
+		auto start (std::chrono::steady_clock::now ());
+		for (auto i (0u); i < threads_count; ++i)
+		{
+			threads.push_back (std::thread ([&, i] ()
+			{
+				for (size_t j (0); j < iterations; ++j)
+				{
+					rai::endpoint endpoint (boost::asio::ip::address_v6::loopback (), 10000 + (i * iterations + j) % count);
+					rai::block_hash hash (j);
+					std::unique_lock <std::mutex> lock (peers.mutex, std::defer_lock);
+					if (serialize_a)
+					{
+						lock.lock ();
+					}
+					peers.known_peer (endpoint);
+					peers.knows_about (endpoint, hash);
+					if (serialize_a)
+					{
+						lock.unlock ();
+					}
+					peers.insert (endpoint, hash);
+				}
+			}));
+		}
+		for (auto & i: threads)
+		{
+			i.join ();
+		}
+		return std::chrono::duration_cast <std::chrono::milliseconds> (std::chrono::steady_clock::now () - start);
+	});
+	auto locked (run (true));
+	auto start (peers.locked_count.load ());
+	auto snapshot (run (false));
+	auto writes (peers.locked_count.load () - start);
+	auto operations (threads_count * iterations);
+	std::cerr << boost::str (boost::format ("%1% threads, %2% lookups each: locked readers %3% ms, snapshot readers %4% ms, %5% of %6% inserts took the mutex") % threads_count % iterations % locked.count () % snapshot.count () % writes % operations) << std::endl;
+	// Contact refreshes are coalesced so the write path is almost never taken
+	ASSERT_LT (writes * 100, operations);
+}
@@ -47,7 +47,9 @@ bool rai::from_string_hex (std::string const & value_a, uint64_t & target_a)
 rai::mdb_env::mdb_env (bool & error_a, boost::filesystem::path const & path_a) :
 open_transactions (0),
 transaction_iteration (0),
-resizing (false)
+resizing (false),
+representation_writer (nullptr),
+representation_version (0)
 {
 	boost::system::error_code error;
 	if (path_a.has_parent_path ())
@@ -155,7 +157,13 @@ environment (environment_a)
 
 rai::transaction::~transaction ()
 {
+	auto representation_changed (environment.representation_writer == handle);
 	auto status (mdb_txn_commit (handle));
+	if (representation_changed)
+	{
+		environment.representation_writer = nullptr;
+		++environment.representation_version;
+	}
 	environment.remove_transaction ();
 	assert (status == 0);
 }
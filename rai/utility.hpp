@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <atomic>
 #include <condition_variable>
 #include <type_traits>
 
@@ -145,6 +146,10 @@ public:
 	unsigned transaction_iteration;
 	std::condition_variable resize_notify;
 	bool resizing;
+	// Write transaction that has changed representation and not yet committed
+	std::atomic <MDB_txn *> representation_writer;
+	// Bumped after each commit that changed representation so anything cached against it is never newer than the data
+	std::atomic <uint64_t> representation_version;
 };
 class mdb_val
 {
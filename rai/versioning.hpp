@@ -19,4 +19,20 @@ public:
 	rai::amount balance;
 	uint64_t modified;
 };
-}
\ No newline at end of file
+class account_info_v3
+{
+public:
+	account_info_v3 ();
+	account_info_v3 (MDB_val const &);
+	account_info_v3 (rai::account_info_v3 const &) = default;
+	account_info_v3 (rai::block_hash const &, rai::block_hash const &, rai::block_hash const &, rai::amount const &, uint64_t);
+	void serialize (rai::stream &) const;
+	bool deserialize (rai::stream &);
+	rai::mdb_val val () const;
+	rai::block_hash head;
+	rai::block_hash rep_block;
+	rai::block_hash open_block;
+	rai::amount balance;
+	uint64_t modified;
+};
+}